@@ -4,8 +4,12 @@
 #include "Platform/Locks.h"
 #include "Platform/Process.h"
 #include "Platform/Exception.h"
+#include "Platform/Timer.h"
 
+#include "Foundation/Crc32.h"
+#include "Foundation/FileStream.h"
 #include "Foundation/Log.h"
+#include "Foundation/MemoryStream.h"
 #include "Foundation/Profile.h"
 
 #include "Reflect/Object.h"
@@ -15,6 +19,10 @@
 #include "Persist/ArchiveBson.h"
 #include "Persist/ArchiveJson.h"
 #include "Persist/ArchiveMessagePack.h"
+#include "Persist/ArchivePool.h"
+#include "Persist/Clone.h"
+#include "Persist/CompressedStream.h"
+#include "Persist/ReadAheadStream.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -24,6 +32,17 @@ using namespace Helium;
 using namespace Helium::Reflect;
 using namespace Helium::Persist;
 
+// a step always gets its first object done, after that it stops as soon as either budget is spent
+static bool IsBudgetSpent( uint64_t startTicks, uint32_t budgetMicroseconds, int64_t bytes, uint32_t budgetBytes )
+{
+	if ( budgetBytes && bytes >= budgetBytes )
+	{
+		return true;
+	}
+
+	return budgetMicroseconds && TimerTicksToMilliseconds( TimerGetClock() - startTicks ) * 1000.0f >= budgetMicroseconds;
+}
+
 const char* Persist::ArchiveExtensions[] =
 {
 	"bson",
@@ -31,10 +50,21 @@ const char* Persist::ArchiveExtensions[] =
 	"msgpack"
 };
 
+static uint64_t g_DefaultMemoryBudget = 0;
+
+static const char* ArchiveMemoryTypeNames[ ArchiveMemoryTypes::Count ] =
+{
+	"input",
+	"document",
+	"temporary",
+	"objects",
+};
+
 Archive::Archive( uint32_t flags )
 	: m_Progress( 0 )
 	, m_Abort( false )
 	, m_Flags( flags )
+	, m_MemoryBudget( g_DefaultMemoryBudget )
 {
 }
 
@@ -43,6 +73,7 @@ Archive::Archive( const FilePath& path, uint32_t flags )
 	, m_Progress( 0 )
 	, m_Abort( false )
 	, m_Flags( flags )
+	, m_MemoryBudget( g_DefaultMemoryBudget )
 {
 	HELIUM_ASSERT( !m_Path.empty() );
 }
@@ -51,7 +82,129 @@ Archive::~Archive()
 {
 }
 
-SmartPtr< ArchiveWriter > ArchiveWriter::GetWriter( const FilePath& path, ObjectIdentifier* identifier, ArchiveType archiveType )
+void Archive::SetCompressionDictionary( CompressionDictionary* dictionary )
+{
+	m_Dictionary = dictionary;
+}
+
+void Archive::ResetState()
+{
+	m_Path = FilePath();
+	m_Progress = 0;
+	m_Abort = false;
+	m_Dictionary = NULL;
+	m_MemoryBudget = g_DefaultMemoryBudget;
+
+	MutexScopeLock lock ( m_MemoryLock );
+	m_Memory = ArchiveMemoryStats();
+}
+
+void Archive::SetDefaultMemoryBudget( uint64_t bytes )
+{
+	g_DefaultMemoryBudget = bytes;
+}
+
+void Archive::SetMemoryBudget( uint64_t bytes )
+{
+	m_MemoryBudget = bytes;
+}
+
+ArchiveMemoryStats Archive::GetMemoryStats() const
+{
+	MutexScopeLock lock ( m_MemoryLock );
+	return m_Memory;
+}
+
+void Archive::ChargeMemory( ArchiveMemoryType type, uint64_t bytes )
+{
+	MutexScopeLock lock ( m_MemoryLock );
+
+	m_Memory.m_Held[ type ] += bytes;
+	m_Memory.m_Allocated[ type ] += bytes;
+	m_Memory.m_Current += bytes;
+	m_Memory.m_Total += bytes;
+	m_Memory.m_Peak = Max( m_Memory.m_Peak, m_Memory.m_Current );
+
+	if ( m_MemoryBudget && m_Memory.m_Current > m_MemoryBudget )
+	{
+		throw Persist::Exception(
+			TXT( "Archive exceeded its memory budget of %" PRIu64 " bytes with %" PRIu64 " bytes of %s (%s)" ),
+			m_MemoryBudget,
+			bytes,
+			ArchiveMemoryTypeNames[ type ],
+			m_Path.c_str() );
+	}
+}
+
+void Archive::ReleaseMemory( ArchiveMemoryType type, uint64_t bytes )
+{
+	MutexScopeLock lock ( m_MemoryLock );
+
+	HELIUM_ASSERT( bytes <= m_Memory.m_Held[ type ] );
+	m_Memory.m_Held[ type ] -= bytes;
+	m_Memory.m_Current -= bytes;
+}
+
+void Archive::HoldMemory( ArchiveMemoryType type, uint64_t bytes )
+{
+	uint64_t held;
+	{
+		MutexScopeLock lock ( m_MemoryLock );
+		held = m_Memory.m_Held[ type ];
+	}
+
+	if ( bytes > held )
+	{
+		ChargeMemory( type, bytes - held );
+	}
+	else if ( bytes < held )
+	{
+		ReleaseMemory( type, held - bytes );
+	}
+}
+
+Stream* Archive::OpenStream()
+{
+	// held until a stream that owns it is returned, constructing that (or opening this) can throw
+	AutoPtr< Stream > stream ( new FileStream() );
+
+	if ( GetMode() == ArchiveModes::Write )
+	{
+		static_cast< FileStream* >( stream.Ptr() )->Open( m_Path, FileStream::MODE_WRITE );
+
+		if ( m_Dictionary || CompressedStream::IsFramed( m_Flags ) )
+		{
+			CompressionCodec codec = m_Dictionary ? CompressionCodecs::Zstd : CompressedStream::GetCodec( m_Flags );
+			Stream* compressed = new CompressedStream( stream.Ptr(), codec, true, CompressedStream::DefaultBlockSize, m_Dictionary, ( m_Flags & ArchiveFlags::Checksum ) != 0 );
+			stream.Release();
+			return compressed;
+		}
+	}
+	else
+	{
+		static_cast< FileStream* >( stream.Ptr() )->Open( m_Path, FileStream::MODE_READ );
+
+		// compressed archives are recognized by their magic, whatever their extension
+		//  they are read (and verified) whole before anything is decompressed, so reading ahead wouldn't overlap anything
+		if ( CompressedStream::IsCompressed( *stream ) )
+		{
+			Stream* input = new CompressedStream( stream.Ptr(), true, m_Dictionary );
+			stream.Release();
+			return input;
+		}
+
+		if ( m_Flags & ArchiveFlags::Pipeline )
+		{
+			Stream* input = new ReadAheadStream( stream.Ptr(), true );
+			stream.Release();
+			return input;
+		}
+	}
+
+	return stream.Release();
+}
+
+SmartPtr< ArchiveWriter > ArchiveWriter::GetWriter( const FilePath& path, ObjectIdentifier* identifier, ArchiveType archiveType, uint32_t flags )
 {
 	switch ( archiveType )
 	{
@@ -59,27 +212,27 @@ SmartPtr< ArchiveWriter > ArchiveWriter::GetWriter( const FilePath& path, Object
 		{
 			if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::Bson ] ) == 0 )
 			{
-				return new ArchiveWriterBson( path, identifier );
+				return new ArchiveWriterBson( path, identifier, flags );
 			}
 			else if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::Json ] ) == 0 )
 			{
-				return new ArchiveWriterJson( path, identifier );
+				return new ArchiveWriterJson( path, identifier, flags );
 			}
 			else if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::MessagePack ] ) == 0 )
 			{
-				return new ArchiveWriterMessagePack( path, identifier );
+				return new ArchiveWriterMessagePack( path, identifier, flags );
 			}
 			break;
 		}
 
 	case ArchiveTypes::Bson:
-		return new ArchiveWriterBson( path, identifier );
+		return new ArchiveWriterBson( path, identifier, flags );
 
 	case ArchiveTypes::Json:
-		return new ArchiveWriterJson( path, identifier );
+		return new ArchiveWriterJson( path, identifier, flags );
 
 	case ArchiveTypes::MessagePack:
-		return new ArchiveWriterMessagePack( path, identifier );
+		return new ArchiveWriterMessagePack( path, identifier, flags );
 
 	default:
 		HELIUM_ASSERT( false );
@@ -89,12 +242,55 @@ SmartPtr< ArchiveWriter > ArchiveWriter::GetWriter( const FilePath& path, Object
 	throw Persist::StreamException( TXT( "Unknown archive type" ) );
 }
 
+SmartPtr< ArchiveWriter > ArchiveWriter::GetWriter( Stream* stream, ArchiveType archiveType, ObjectIdentifier* identifier, uint32_t flags )
+{
+	switch ( archiveType )
+	{
+	case ArchiveTypes::Bson:
+		return new ArchiveWriterBson( stream, identifier, flags );
+
+	case ArchiveTypes::Json:
+		return new ArchiveWriterJson( stream, identifier, flags );
+
+	case ArchiveTypes::MessagePack:
+		return new ArchiveWriterMessagePack( stream, identifier, flags );
+
+	default:
+		HELIUM_ASSERT( false ); // streams have no extension to deduce the type from
+		break;
+	}
+
+	throw Persist::StreamException( TXT( "Unknown archive type" ) );
+}
+
+void ArchiveWriter::WriteToStream( const ObjectPtr* objects, size_t count, Stream& stream, ArchiveType archiveType, ObjectIdentifier* identifier, uint32_t flags )
+{
+	if ( CompressedStream::IsFramed( flags ) )
+	{
+		CompressedStream compressed ( &stream, CompressedStream::GetCodec( flags ), false, CompressedStream::DefaultBlockSize, NULL, ( flags & ArchiveFlags::Checksum ) != 0 );
+		WriteToStream( objects, count, compressed, archiveType, identifier, flags & ~( ArchiveFlags::CompressMask | ArchiveFlags::Checksum ) );
+		compressed.Close();
+		return;
+	}
+
+	// streams are usually small messages, reuse this thread's warm writers
+	SmartPtr< ArchiveWriter > archive = ArchivePool::GetWriter( &stream, archiveType, identifier, flags );
+	archive->Write( objects, count );
+	archive->Close();
+	ArchivePool::Recycle( archive.Ptr() );
+}
+
 bool ArchiveWriter::WriteToFile( const FilePath& path, const ObjectPtr& object, ObjectIdentifier* identifier, ArchiveType archiveType, std::string* error )
 {
 	return WriteToFile( path, &object, 1, identifier, archiveType, error );
 }
 
-bool ArchiveWriter::WriteToFile( const FilePath& path, const ObjectPtr* objects, size_t count, ObjectIdentifier* identifier, ArchiveType archiveType, std::string* error )
+bool ArchiveWriter::WriteToFile( const FilePath& path, const ObjectPtr* objects, size_t count, ObjectIdentifier* identifier, ArchiveType archiveType, std::string* error, uint32_t flags )
+{
+	return WriteDeltaToFile( path, objects, NULL, count, identifier, archiveType, error, flags );
+}
+
+bool ArchiveWriter::WriteDeltaToFile( const FilePath& path, const ObjectPtr* objects, const ObjectPtr* baselines, size_t count, ObjectIdentifier* identifier, ArchiveType archiveType, std::string* error, uint32_t flags )
 {
 	HELIUM_ASSERT( !path.empty() );
 	HELIUM_PERSIST_SCOPE_TIMER( "%s", path.c_str() );
@@ -106,7 +302,11 @@ bool ArchiveWriter::WriteToFile( const FilePath& path, const ObjectPtr* objects,
 	FilePath safetyPath( path.Directory() + Helium::GetProcessString() );
 	safetyPath.ReplaceExtension( path.Extension() );
 
-	SmartPtr< ArchiveWriter > archive = GetWriter( safetyPath, identifier, archiveType );
+	SmartPtr< ArchiveWriter > archive = GetWriter( safetyPath, identifier, archiveType, flags );
+	if ( baselines )
+	{
+		archive->SetBaselines( baselines, count );
+	}
 
 	// generate the file to the safety location
 	if ( Helium::IsDebuggerPresent() )
@@ -184,6 +384,11 @@ bool ArchiveWriter::WriteToFile( const FilePath& path, const ObjectPtr* objects,
 ArchiveWriter::ArchiveWriter( ObjectIdentifier* identifier, uint32_t flags )
 	: Archive( flags )
 	, m_Identifier( identifier )
+	, m_Deduplicating( false )
+	, m_Parallel( false )
+	, m_Stepping( false )
+	, m_Step( 0 )
+	, m_Profile( NULL )
 {
 
 }
@@ -191,6 +396,11 @@ ArchiveWriter::ArchiveWriter( ObjectIdentifier* identifier, uint32_t flags )
 ArchiveWriter::ArchiveWriter( const FilePath& filePath, ObjectIdentifier* identifier, uint32_t flags )
 	: Archive( filePath, flags )
 	, m_Identifier( identifier )
+	, m_Deduplicating( false )
+	, m_Parallel( false )
+	, m_Stepping( false )
+	, m_Step( 0 )
+	, m_Profile( NULL )
 {
 }
 
@@ -199,14 +409,191 @@ ArchiveMode ArchiveWriter::GetMode() const
 	return ArchiveModes::Write;
 }
 
+void ArchiveWriter::SetBaselines( const ObjectPtr* baselines, size_t count )
+{
+	m_Baselines.Clear();
+	m_Baselines.AddArray( baselines, count );
+}
+
+void ArchiveWriter::SetProfile( ArchiveProfile* profile )
+{
+	m_Profile = profile;
+}
+
+void ArchiveWriter::Reset( Stream* stream, ObjectIdentifier* identifier )
+{
+	HELIUM_ASSERT( !m_Stepping && !m_Parallel );
+	ResetState();
+
+	// sized down, not freed
+	m_Objects.Resize( 0 );
+	m_Baselines.Resize( 0 );
+	m_Identifier = identifier;
+	m_Deduplicating = false;
+	m_Duplicates.Resize( 0 );
+	m_DuplicateHashes.clear();
+	m_DuplicateObjects.clear();
+	m_DuplicateVisited.clear();
+	m_Slices.Resize( 0 );
+	m_Step = 0;
+	m_Profile = NULL;
+}
+
+void ArchiveWriter::BeginSteps( const ObjectPtr* objects, size_t count )
+{
+	HELIUM_ASSERT( !m_Stepping );
+
+	ArchiveStatus info( *this, ArchiveStates::Starting );
+	e_Status.Raise( info );
+
+	// this has to see everything before the first object is written, so it can't be spread over the steps
+	if ( m_Flags & ArchiveFlags::Dedupe )
+	{
+		Deduplicate( objects, count );
+	}
+
+	m_Objects.AddArray( objects, count );
+	m_Step = 0;
+	m_Stepping = true;
+	Begin();
+}
+
+bool ArchiveWriter::Step( uint32_t budgetMicroseconds, uint32_t budgetBytes )
+{
+	HELIUM_ASSERT( m_Stepping );
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Write Step" );
+
+	uint64_t start = TimerGetClock();
+	int64_t position = GetPosition();
+
+	// objects can get added during this (in Identify), so check the size every time
+	while ( m_Step < m_Objects.GetSize() )
+	{
+		WriteNext( m_Step++ );
+
+		ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
+		info.m_Progress = (int)(((float)(m_Step) / (float)m_Objects.GetSize()) * 100.0f);
+		e_Status.Raise( info );
+
+		if ( IsBudgetSpent( start, budgetMicroseconds, GetPosition() - position, budgetBytes ) )
+		{
+			return false;
+		}
+	}
+
+	End();
+	m_Stepping = false;
+
+	ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
+	info.m_Progress = 100;
+	e_Status.Raise( info );
+
+	info.m_State = ArchiveStates::Complete;
+	e_Status.Raise( info );
+	return true;
+}
+
+void* ArchiveWriter::GetBaseline( size_t index, const MetaClass* objectClass )
+{
+	// a baseline is only usable if it has the exact same layout as the object being written
+	if ( index < m_Baselines.GetSize() )
+	{
+		Object* baseline = m_Baselines.GetElement( index );
+		if ( baseline && baseline->GetMetaClass() == objectClass )
+		{
+			return baseline;
+		}
+	}
+
+	return NULL;
+}
+
+void* ArchiveWriter::GetBaseline( const ObjectPtr& object, void* baseline )
+{
+	// baseline is the address of the ObjectPtr in the baseline instance that corresponds to object
+	if ( baseline && object )
+	{
+		Object* baseObject = static_cast< ObjectPtr* >( baseline )->Ptr();
+		if ( baseObject && baseObject != object.Ptr() && baseObject->GetMetaClass() == object->GetMetaClass() )
+		{
+			return baseObject;
+		}
+	}
+
+	return NULL;
+}
+
+bool ArchiveWriter::ShouldSerialize( const Field* field, void* instance, Object* object, void* baseline )
+{
+	if ( !baseline )
+	{
+		// no baseline, the field compares itself against the default instance of its structure
+		return field->ShouldSerialize( instance, object );
+	}
+
+	if ( field->m_Flags & FieldFlags::Discard )
+	{
+		return false;
+	}
+
+	if ( field->m_Flags & FieldFlags::Force )
+	{
+		return true;
+	}
+
+	for ( uint32_t i=0; i<field->m_Count; ++i )
+	{
+		if ( !field->m_Translator->Equals( Pointer ( field, instance, object, i ), Pointer ( field, baseline, NULL, i ) ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool ArchiveWriter::Identify( const ObjectPtr& object, Name* identity )
 {
 	if ( m_Identifier )
 	{
-		return m_Identifier->Identify( object, identity );
+		// the external identifier need not be thread safe
+		bool identified = false;
+		if ( m_Parallel )
+		{
+			MutexScopeLock lock ( m_IdentifyLock );
+			identified = m_Identifier->Identify( object, identity );
+		}
+		else
+		{
+			identified = m_Identifier->Identify( object, identity );
+		}
+
+		// unless asked to, objects the external identifier doesn't know about are written in place
+		if ( identified || !( m_Flags & ArchiveFlags::ShareDeclined ) )
+		{
+			return identified;
+		}
+	}
+
+	if ( m_Deduplicating )
+	{
+		return IdentifyDuplicate( object, identity );
 	}
 
+	// test ownership before anything else takes a reference to the object
 	bool strictOwnership = reinterpret_cast< RefCountProxy< Reflect::Object >* >( object.GetProxy() )->GetStrongRefCount() == 1;
+	Object* shared = object.Ptr();
+	if ( strictOwnership && ( m_Flags & ArchiveFlags::Dedupe ) )
+	{
+		// owned objects whose payload occurs more than once are all written as the first one
+		std::map< const Object*, size_t >::const_iterator found = m_DuplicateObjects.find( object.Ptr() );
+		if ( found != m_DuplicateObjects.end() && found->second != Invalid< size_t >() && m_Duplicates[ found->second ].m_Count > 1 )
+		{
+			shared = m_Duplicates[ found->second ].m_Canonical;
+			strictOwnership = false;
+		}
+	}
+
 	if ( !strictOwnership )
 	{
 		if ( identity )
@@ -214,7 +601,7 @@ bool ArchiveWriter::Identify( const ObjectPtr& object, Name* identity )
 			size_t index = Invalid< size_t >();
 			for ( DynamicArray< ObjectPtr >::ConstIterator itr = m_Objects.Begin(), end = m_Objects.End(); itr != end; ++itr )
 			{
-				if ( itr->Ptr() == object )
+				if ( itr->Ptr() == shared )
 				{
 					index = m_Objects.GetIndex( itr );
 					break;
@@ -223,10 +610,16 @@ bool ArchiveWriter::Identify( const ObjectPtr& object, Name* identity )
 
 			if ( index == Invalid< size_t >() )
 			{
+				// indices are handed out by WriteParallel before the workers start, and must not depend on which finishes first
+				if ( m_Parallel )
+				{
+					throw Persist::Exception( TXT( "Object of type '%s' was first referenced during a parallel write (was a pointer changed in PreSerialize?)" ), shared->GetMetaClass()->m_Name );
+				}
+
 				index = m_Objects.GetSize();
 
 				// this will cause it to be written after the current object-in-progress (see Write)
-				m_Objects.Push( object );
+				m_Objects.Push( shared );
 			}
 
 			String str;
@@ -240,159 +633,1031 @@ bool ArchiveWriter::Identify( const ObjectPtr& object, Name* identity )
 	return false;
 }
 
-SmartPtr< ArchiveReader > ArchiveReader::GetReader( const FilePath& path, ObjectResolver* resolver, ArchiveType archiveType )
+void ArchiveWriter::WriteParallel( ParallelFunction function )
 {
-	switch ( archiveType )
+	HELIUM_PERSIST_SCOPE_TIMER( "Persist - Parallel Write" );
+
+	// objects can get added during this iteration (in Identify), so use indices
+	for ( size_t index = 0; index < m_Objects.GetSize(); ++index )
 	{
-	case ArchiveTypes::Auto:
+		Object* object = m_Objects.GetElement( index );
+		if ( object )
 		{
-			if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::Bson ] ) == 0 )
-			{
-				return new ArchiveReaderBson( path, resolver );
-			}
-			else if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::Json ] ) == 0 )
-			{
-				return new ArchiveReaderJson( path, resolver );
-			}
-			else if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::MessagePack ] ) == 0 )
-			{
-				return new ArchiveReaderMessagePack( path, resolver );
-			}
-			break;
+			const MetaClass* objectClass = object->GetMetaClass();
+			IdentifyInstance( object, objectClass, object, GetBaseline( index, objectClass ) );
 		}
-
-	case ArchiveTypes::Bson:
-		return new ArchiveReaderBson( path, resolver );
-
-	case ArchiveTypes::Json:
-		return new ArchiveReaderJson( path, resolver );
-
-	case ArchiveTypes::MessagePack:
-		return new ArchiveReaderMessagePack( path, resolver );
-
-	default:
-		HELIUM_ASSERT( false );
-		break;
 	}
 
-	throw Persist::StreamException( TXT( "Unknown archive type" ) );
-}
+	// a few slices per worker evens out objects of different sizes
+	size_t count = Min< size_t >( GetParallelWorkerCount() * 4, m_Objects.GetSize() );
+	m_Slices.Resize( count );
+	for ( size_t i=0; i<count; ++i )
+	{
+		m_Slices[ i ].m_Begin = m_Objects.GetSize() * i / count;
+		m_Slices[ i ].m_End = m_Objects.GetSize() * ( i + 1 ) / count;
+		m_Slices[ i ].m_Buffer.Clear();
+	}
 
-bool ArchiveReader::ReadFromFile( const FilePath& path, ObjectPtr& object, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
-{
-	DynamicArray< ObjectPtr > objects;
-	if ( ReadFromFile( path, objects, resolver, archiveType, error ) )
+	m_Parallel = true;
+	try
 	{
-		HELIUM_ASSERT( !objects.IsEmpty() );
-		object = objects.GetFirst();
-		return true;
+		ParallelFor( count, function, this );
+	}
+	catch ( ... )
+	{
+		m_Parallel = false;
+		throw;
 	}
+	m_Parallel = false;
 
-	return false;
+	// held until the format has stitched them together
+	uint64_t sliceBytes = 0;
+	for ( DynamicArray< Slice >::ConstIterator itr = m_Slices.Begin(), end = m_Slices.End(); itr != end; ++itr )
+	{
+		sliceBytes += itr->m_Buffer.GetCapacity();
+	}
+	HoldMemory( ArchiveMemoryTypes::Temporary, sliceBytes );
 }
 
-bool ArchiveReader::ReadFromFile( const FilePath& path, DynamicArray< ObjectPtr >& objects, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+void ArchiveWriter::IdentifyInstance( void* instance, const MetaStruct* structure, Object* object, void* baseline )
 {
-	HELIUM_ASSERT( !path.empty() );
-	HELIUM_PERSIST_SCOPE_TIMER( "%s", path.c_str() );
-	Log::Debug( TXT( "Parsing '%s'\n" ), path.c_str() );
-
-	SmartPtr< ArchiveReader > archive = GetReader( path, resolver, archiveType );
-
-	if ( Helium::IsDebuggerPresent() )
+	// the same fields, in the same order, as the formats serialize
+	DynamicArray< const MetaStruct* > bases;
+	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
 	{
-		archive->Open();
-		archive->Read( objects );
-		archive->Close(); 
+		bases.Push( current );
 	}
-	else
-	{
-		bool open = false;
 
-		try
-		{
-			archive->Open();
-			open = true;
-			archive->Read( objects );
-			archive->Close(); 
-		}
-		catch ( Helium::Exception& ex )
+	while ( !bases.IsEmpty() )
+	{
+		const MetaStruct* current = bases.Pop();
+		for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end; ++itr )
 		{
-			std::stringstream str;
-			str << "While reading '" << path.c_str() << "': " << ex.Get();
-
-			if ( error )
+			const Field* field = &*itr;
+			if ( !ShouldSerialize( field, instance, object, baseline ) )
 			{
-				*error = str.str();
+				continue;
 			}
 
-			if ( open )
+			if ( field->m_Count > 1 )
 			{
-				archive->Close();
+				for ( uint32_t i=0; i<field->m_Count; ++i )
+				{
+					void* elementBaseline = baseline ? Pointer ( field, baseline, NULL, i ).m_Address : NULL;
+					IdentifyTranslator( Pointer ( field, instance, object, i ), field->m_Translator, object, elementBaseline );
+				}
 			}
-
-			return false;
+			else
+			{
+				void* fieldBaseline = baseline ? Pointer ( field, baseline, NULL ).m_Address : NULL;
+				IdentifyTranslator( Pointer ( field, instance, object ), field->m_Translator, object, fieldBaseline );
+			}
+		}
+	}
+}
+
+void ArchiveWriter::IdentifyTranslator( Pointer pointer, Translator* translator, Object* object, void* baseline )
+{
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		{
+			const ObjectPtr& pointed ( pointer.As< ObjectPtr >() );
+			if ( !pointed )
+			{
+				break;
+			}
+
+			// asking for the identity is what numbers a shared object, once per reference is enough
+			Name identity;
+			if ( !Identify( pointed, &identity ) )
+			{
+				IdentifyInstance( pointed, pointed->GetMetaClass(), pointed, GetBaseline( pointed, baseline ) );
+			}
+			break;
+		}
+
+	case MetaIds::StructureTranslator:
+		{
+			StructureTranslator* structure = static_cast< StructureTranslator* >( translator );
+			IdentifyInstance( pointer.m_Address, structure->GetMetaStruct(), object, baseline );
+			break;
+		}
+
+	case MetaIds::SetTranslator:
+		{
+			SetTranslator* set = static_cast< SetTranslator* >( translator );
+			DynamicArray< Pointer > items;
+			set->GetItems( pointer, items );
+			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+			{
+				IdentifyTranslator( *itr, set->GetItemTranslator(), object, NULL );
+			}
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		{
+			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
+			DynamicArray< Pointer > items;
+			sequence->GetItems( pointer, items );
+			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+			{
+				IdentifyTranslator( *itr, sequence->GetItemTranslator(), object, NULL );
+			}
+			break;
+		}
+
+	case MetaIds::AssociationTranslator:
+		{
+			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+			DynamicArray< Pointer > keys, values;
+			association->GetItems( pointer, keys, values );
+			for ( DynamicArray< Pointer >::Iterator keyItr = keys.Begin(), valueItr = values.Begin(), keyEnd = keys.End(), valueEnd = values.End();
+				keyItr != keyEnd && valueItr != valueEnd;
+				++keyItr, ++valueItr )
+			{
+				IdentifyTranslator( *keyItr, association->GetKeyTranslator(), object, NULL );
+				IdentifyTranslator( *valueItr, association->GetValueTranslator(), object, NULL );
+			}
+			break;
+		}
+
+	default:
+		// scalars don't reference other objects
+		break;
+	}
+}
+
+void ArchiveWriter::Deduplicate( const ObjectPtr* objects, size_t count )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Deduplicate" );
+
+	m_Duplicates.Clear();
+	m_DuplicateHashes.clear();
+	m_DuplicateObjects.clear();
+	m_DuplicateVisited.clear();
+
+	// owned objects are only ever shared by index, which an external identifier turns off unless it allows it
+	if ( m_Identifier && !( m_Flags & ArchiveFlags::ShareDeclined ) )
+	{
+		return;
+	}
+
+	// encoding each top-level object visits everything it references through IdentifyDuplicate
+	m_Deduplicating = true;
+	try
+	{
+		DynamicArray< uint8_t > payload;
+		for ( size_t i=0; i<count; ++i )
+		{
+			if ( objects[ i ] && m_DuplicateVisited.insert( objects[ i ].Ptr() ).second )
+			{
+				EncodeDuplicate( objects[ i ], payload );
+			}
+		}
+	}
+	catch ( ... )
+	{
+		m_Deduplicating = false;
+		throw;
+	}
+	m_Deduplicating = false;
+
+	// the payloads were only needed to confirm hash matches
+	for ( DynamicArray< Duplicate >::Iterator itr = m_Duplicates.Begin(), end = m_Duplicates.End(); itr != end; ++itr )
+	{
+		itr->m_Payload.Clear();
+	}
+	m_DuplicateHashes.clear();
+	m_DuplicateVisited.clear();
+}
+
+bool ArchiveWriter::IdentifyDuplicate( const ObjectPtr& object, Name* identity )
+{
+	const Object* target = object.Ptr();
+
+	bool strictOwnership = reinterpret_cast< RefCountProxy< Reflect::Object >* >( object.GetProxy() )->GetStrongRefCount() == 1;
+	if ( strictOwnership )
+	{
+		size_t duplicate = HashDuplicate( object );
+		if ( duplicate != Invalid< size_t >() )
+		{
+			target = m_Duplicates[ duplicate ].m_Canonical;
+		}
+	}
+	else if ( m_DuplicateVisited.insert( object.Ptr() ).second )
+	{
+		// shared objects aren't candidates themselves, but the objects they own are
+		DynamicArray< uint8_t > payload;
+		EncodeDuplicate( object, payload );
+	}
+
+	// referencing by address makes the payloads of owners with identical children identical too
+	if ( identity )
+	{
+		String str;
+		str.Format( "%p", target );
+		identity->Set( str );
+	}
+
+	return true;
+}
+
+size_t ArchiveWriter::HashDuplicate( const ObjectPtr& object )
+{
+	std::map< const Object*, size_t >::const_iterator found = m_DuplicateObjects.find( object.Ptr() );
+	if ( found != m_DuplicateObjects.end() )
+	{
+		return found->second;
+	}
+
+	// guard against cycles back into an object we are still encoding
+	m_DuplicateObjects[ object.Ptr() ] = Invalid< size_t >();
+
+	DynamicArray< uint8_t > payload;
+	EncodeDuplicate( object, payload );
+	uint32_t hash = Helium::Crc32( payload.GetData(), payload.GetSize() );
+
+	size_t duplicate = Invalid< size_t >();
+	typedef std::multimap< uint32_t, size_t >::const_iterator HashIterator;
+	std::pair< HashIterator, HashIterator > range = m_DuplicateHashes.equal_range( hash );
+	for ( HashIterator itr = range.first; itr != range.second; ++itr )
+	{
+		const Duplicate& candidate = m_Duplicates[ itr->second ];
+		if ( candidate.m_Payload.GetSize() == payload.GetSize() && MemoryCompare( candidate.m_Payload.GetData(), payload.GetData(), payload.GetSize() ) == 0 )
+		{
+			duplicate = itr->second;
+			break;
+		}
+	}
+
+	if ( duplicate == Invalid< size_t >() )
+	{
+		duplicate = m_Duplicates.GetSize();
+		Duplicate& added = *m_Duplicates.New();
+		added.m_Hash = hash;
+		added.m_Payload = payload;
+		added.m_Canonical = object.Ptr();
+		added.m_Count = 1;
+		m_DuplicateHashes.insert( std::make_pair( hash, duplicate ) );
+	}
+	else
+	{
+		m_Duplicates[ duplicate ].m_Count++;
+	}
+
+	m_DuplicateObjects[ object.Ptr() ] = duplicate;
+	return duplicate;
+}
+
+void ArchiveWriter::EncodeDuplicate( const ObjectPtr& object, DynamicArray< uint8_t >& payload )
+{
+	// the compact binary encoding is only ever hashed and compared, whatever format we are writing,
+	//  so it is written plainly (no compression or checksums) on this thread
+	payload.Resize( 0 );
+	DynamicMemoryStream stream ( &payload );
+	WriteToStream( &object, 1, stream, ArchiveTypes::MessagePack, this, m_Flags & ~( ArchiveFlags::Dedupe | ArchiveFlags::CompressMask | ArchiveFlags::Checksum | ArchiveFlags::ParallelWrite ) );
+}
+
+SmartPtr< ArchiveReader > ArchiveReader::GetReader( const FilePath& path, ObjectResolver* resolver, ArchiveType archiveType, uint32_t flags )
+{
+	switch ( archiveType )
+	{
+	case ArchiveTypes::Auto:
+		{
+			if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::Bson ] ) == 0 )
+			{
+				return new ArchiveReaderBson( path, resolver, flags );
+			}
+			else if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::Json ] ) == 0 )
+			{
+				return new ArchiveReaderJson( path, resolver, flags );
+			}
+			else if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ ArchiveTypes::MessagePack ] ) == 0 )
+			{
+				return new ArchiveReaderMessagePack( path, resolver, flags );
+			}
+			break;
+		}
+
+	case ArchiveTypes::Bson:
+		return new ArchiveReaderBson( path, resolver, flags );
+
+	case ArchiveTypes::Json:
+		return new ArchiveReaderJson( path, resolver, flags );
+
+	case ArchiveTypes::MessagePack:
+		return new ArchiveReaderMessagePack( path, resolver, flags );
+
+	default:
+		HELIUM_ASSERT( false );
+		break;
+	}
+
+	throw Persist::StreamException( TXT( "Unknown archive type" ) );
+}
+
+SmartPtr< ArchiveReader > ArchiveReader::GetReader( Stream* stream, ArchiveType archiveType, ObjectResolver* resolver, uint32_t flags )
+{
+	switch ( archiveType )
+	{
+	case ArchiveTypes::Bson:
+		return new ArchiveReaderBson( stream, resolver, flags );
+
+	case ArchiveTypes::Json:
+		return new ArchiveReaderJson( stream, resolver, flags );
+
+	case ArchiveTypes::MessagePack:
+		return new ArchiveReaderMessagePack( stream, resolver, flags );
+
+	default:
+		HELIUM_ASSERT( false ); // streams have no extension to deduce the type from
+		break;
+	}
+
+	throw Persist::StreamException( TXT( "Unknown archive type" ) );
+}
+
+void ArchiveReader::ReadFromStream( Stream& stream, DynamicArray< ObjectPtr >& objects, ArchiveType archiveType, ObjectResolver* resolver, uint32_t flags )
+{
+	if ( stream.CanSeek() && CompressedStream::IsCompressed( stream ) )
+	{
+		CompressedStream compressed ( &stream );
+		ReadFromStream( compressed, objects, archiveType, resolver, flags );
+		return;
+	}
+
+	SmartPtr< ArchiveReader > archive = ArchivePool::GetReader( &stream, archiveType, resolver, flags );
+	archive->Read( objects );
+	archive->Close();
+	ArchivePool::Recycle( archive.Ptr() );
+}
+
+bool ArchiveReader::ReadFromFile( const FilePath& path, ObjectPtr& object, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+{
+	DynamicArray< ObjectPtr > objects;
+	if ( ReadFromFile( path, objects, resolver, archiveType, error ) )
+	{
+		HELIUM_ASSERT( !objects.IsEmpty() );
+		object = objects.GetFirst();
+		return true;
+	}
+
+	return false;
+}
+
+bool ArchiveReader::ReadFromFile( const FilePath& path, DynamicArray< ObjectPtr >& objects, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+{
+	HELIUM_ASSERT( !path.empty() );
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", path.c_str() );
+	Log::Debug( TXT( "Parsing '%s'\n" ), path.c_str() );
+
+	SmartPtr< ArchiveReader > archive = GetReader( path, resolver, archiveType );
+	return ReadFromArchive( *archive, objects, error );
+}
+
+bool ArchiveReader::ReadDeltaFromFile( const FilePath& path, const DynamicArray< ObjectPtr >& baselines, DynamicArray< ObjectPtr >& objects, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+{
+	HELIUM_ASSERT( !path.empty() );
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", path.c_str() );
+	Log::Debug( TXT( "Parsing '%s' (delta)\n" ), path.c_str() );
+
+	// the delta only contains changed fields, so start from deep copies of the baselines and read over them
+	//  (cloned together, so objects the baselines share stay shared, and without callbacks, the delta read runs those)
+	Persist::Clone( baselines.GetData(), baselines.GetSize(), objects, NULL, 0x0 );
+
+	SmartPtr< ArchiveReader > archive = GetReader( path, resolver, archiveType );
+	return ReadFromArchive( *archive, objects, error );
+}
+
+bool ArchiveReader::ReadFilteredFromFile( const FilePath& path, DynamicArray< ObjectPtr >& objects, ClassFilter filter, void* filterData, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+{
+	HELIUM_ASSERT( !path.empty() );
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", path.c_str() );
+	Log::Debug( TXT( "Parsing '%s' (filtered)\n" ), path.c_str() );
+
+	SmartPtr< ArchiveReader > archive = GetReader( path, resolver, archiveType );
+	archive->SetClassFilter( filter, filterData );
+	return ReadFromArchive( *archive, objects, error );
+}
+
+bool ArchiveReader::ReadFromArchive( ArchiveReader& archive, DynamicArray< ObjectPtr >& objects, std::string* error )
+{
+	if ( Helium::IsDebuggerPresent() )
+	{
+		archive.Open();
+		archive.Read( objects );
+		archive.Close(); 
+	}
+	else
+	{
+		bool open = false;
+
+		try
+		{
+			archive.Open();
+			open = true;
+			archive.Read( objects );
+			archive.Close(); 
+		}
+		catch ( Helium::Exception& ex )
+		{
+			std::stringstream str;
+			str << "While reading '" << archive.GetPath().c_str() << "': " << ex.Get();
+
+			if ( error )
+			{
+				*error = str.str();
+			}
+
+			if ( open )
+			{
+				archive.Close();
+			}
+
+			return false;
+		}
+		catch ( ... )
+		{
+			if ( open )
+			{
+				archive.Close();
+			}
+
+			throw;
+		}
+	}
+
+	return true;
+}
+
+ObjectPtr ArchiveReader::ReadFromFile( const FilePath& path, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+{
+	ObjectPtr object;
+	ReadFromFile( path, object, resolver, archiveType, error );
+	return object;
+}
+
+ArchiveReader::ArchiveReader( ObjectResolver* resolver, uint32_t flags )
+	: Archive( flags )
+	, m_Resolver( resolver )
+	, m_ClassFilter( NULL )
+	, m_ClassFilterData( NULL )
+	, m_Parallel( false )
+	, m_Stepping( false )
+	, m_Step( 0 )
+	, m_Staging( 0 )
+{
+
+}
+
+ArchiveReader::ArchiveReader( const FilePath& filePath, ObjectResolver* resolver, uint32_t flags )
+	: Archive ( filePath, flags )
+	, m_Resolver( resolver )
+	, m_ClassFilter( NULL )
+	, m_ClassFilterData( NULL )
+	, m_Parallel( false )
+	, m_Stepping( false )
+	, m_Step( 0 )
+	, m_Staging( 0 )
+{
+}
+
+ArchiveMode ArchiveReader::GetMode() const
+{
+	return ArchiveModes::Read;
+}
+
+bool ArchiveReader::FilterByBaseClass( const MetaClass* type, void* baseClass )
+{
+	return type->IsType( static_cast< const MetaClass* >( baseClass ) );
+}
+
+void ArchiveReader::SetClassFilter( ClassFilter filter, void* userData )
+{
+	m_ClassFilter = filter;
+	m_ClassFilterData = userData;
+}
+
+void ArchiveReader::BeginSteps( const DynamicArray< ObjectPtr >& objects )
+{
+	HELIUM_ASSERT( !m_Stepping );
+
+	m_Objects = objects;
+	m_Step = 0;
+	m_Stepping = true;
+	Begin();
+}
+
+bool ArchiveReader::Step( DynamicArray< ObjectPtr >& objects, uint32_t budgetMicroseconds, uint32_t budgetBytes )
+{
+	HELIUM_ASSERT( m_Stepping );
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Read Step" );
+
+	uint64_t start = TimerGetClock();
+	int64_t position = GetPosition();
+
+	while ( !m_Abort && ReadObject( m_Step ) )
+	{
+		++m_Step;
+
+		ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
+		info.m_Progress = (int)(((float)(GetPosition()) / (float)GetSize()) * 100.0f);
+		e_Status.Raise( info );
+		m_Abort |= info.m_Abort;
+
+		if ( IsBudgetSpent( start, budgetMicroseconds, GetPosition() - position, budgetBytes ) )
+		{
+			return false;
+		}
+	}
+
+	// forward references can only be fixed up once everything has been read
+	End();
+	Resolve();
+	m_Stepping = false;
+
+	objects = m_Objects;
+	return true;
+}
+
+bool ArchiveReader::AcceptClass( const MetaClass* type, size_t index )
+{
+	if ( !m_ClassFilter || m_ClassFilter( type, m_ClassFilterData ) )
+	{
+		return true;
+	}
+
+	// remember the rejection so references to this index resolve to null instead of a dangling proxy
+	if ( m_Rejected.size() < index+1 )
+	{
+		m_Rejected.resize( index+1, false );
+	}
+	m_Rejected[ index ] = true;
+
+	// earlier forward references already hold a proxy for this index, it stays unbound so they read as null like later ones
+	//  (pinned by a reference the reader never releases, so the proxy never goes to destroy an object it doesn't have)
+	if ( index < m_Proxies.size() && m_Proxies[ index ] )
+	{
+		m_Proxies[ index ]->AddStrongRef();
+	}
+
+	return false;
+}
+
+Reflect::ObjectPtr ArchiveReader::AllocateObject( const Reflect::MetaClass* type, size_t index )
+{
+	ChargeMemory( ArchiveMemoryTypes::Objects, type->m_Size );
+	Object* object = type->m_Creator();
+
+	// if we pre-allocated a proxy, hook it up to the object
+	//  (growing the list for a later index leaves null slots for the ones never referenced early)
+	RefCountProxy< Object >* proxy = index < m_Proxies.size() ? m_Proxies[ index ] : NULL;
+	if ( proxy )
+	{
+		// associate the object with the proxy
+		proxy->SetObject( object );
+
+		// associate the proxy with the object
+		object->SetRefCountProxy( proxy );
+	}
+
+	return ObjectPtr( object );
+}
+
+void ArchiveReader::End()
+{
+}
+
+void ArchiveReader::Reset( Stream* stream, ObjectResolver* resolver )
+{
+	HELIUM_ASSERT( !m_Stepping && !m_Parallel );
+	ResetState();
+
+	// sized down, not freed (the schema maps stay cached, they never change)
+	m_Proxies.clear();
+	m_Fixups.Resize( 0 );
+	m_CloneFixups.Resize( 0 );
+	m_Referenced.clear();
+	m_Objects.Resize( 0 );
+	m_Resolver = resolver;
+	m_ClassFilter = NULL;
+	m_ClassFilterData = NULL;
+	m_Rejected.clear();
+	m_Step = 0;
+	m_Staging = 0;
+	m_Changed.Resize( 0 );
+	m_ChangedSet.clear();
+	m_UnknownFields.clear();
+	m_SchemaStats = SchemaStats();
+}
+
+const SchemaStats& ArchiveReader::GetSchemaStats() const
+{
+	return m_SchemaStats;
+}
+
+const DynamicArray< ObjectPtr >& ArchiveReader::GetChangedObjects() const
+{
+	return m_Changed;
+}
+
+const MetaClass* ArchiveReader::FindClass( uint32_t crc )
+{
+	bool renamed = false;
+	const MetaClass* type = crc ? Schema::FindClass( crc, &renamed ) : NULL;
+	if ( renamed )
+	{
+		MutexScopeLock lock ( m_SchemaLock );
+		++m_SchemaStats.m_RenamedClasses;
+	}
+
+	return type;
+}
+
+const SchemaField* ArchiveReader::FindField( const MetaStruct* structure, uint32_t crc, const char* name )
+{
+	// workers share the caches, a serial read needs no lock
+	if ( m_Parallel )
+	{
+		MutexScopeLock lock ( m_SchemaLock );
+		return MapField( structure, crc, name );
+	}
+
+	return MapField( structure, crc, name );
+}
+
+const SchemaField* ArchiveReader::MapField( const MetaStruct* structure, uint32_t crc, const char* name )
+{
+	const SchemaMap*& map = m_SchemaMaps[ structure ];
+	if ( !map )
+	{
+		map = Schema::GetMap( structure );
+	}
+
+	const SchemaField* field = NULL;
+	SchemaMap::const_iterator found = map->find( crc );
+	if ( found != map->end() )
+	{
+		if ( found->second.m_Migrated )
+		{
+			++m_SchemaStats.m_MigratedFields;
 		}
-		catch ( ... )
+
+		field = found->second.m_Field ? &found->second : NULL;
+	}
+	else
+	{
+		++m_SchemaStats.m_UnknownFields;
+
+		// once per archive is plenty
+		if ( m_UnknownFields.insert( std::make_pair( structure, crc ) ).second )
 		{
-			if ( open )
+			if ( name )
 			{
-				archive->Close();
+				HELIUM_TRACE(
+					TraceLevels::Debug,
+					"ArchiveReader::FindField - Could not find field '%s' in '%s' (CRC-32 = %" PRIu32 ")\n",
+					name,
+					structure->m_Name,
+					crc);
+			}
+			else
+			{
+				HELIUM_TRACE(
+					TraceLevels::Debug,
+					"ArchiveReader::FindField - Could not find field with CRC-32 %" PRIu32 " in '%s'\n",
+					crc,
+					structure->m_Name);
 			}
-
-			throw;
 		}
 	}
 
-	return true;
+	return field;
 }
 
-ObjectPtr ArchiveReader::ReadFromFile( const FilePath& path, ObjectResolver* resolver, ArchiveType archiveType, std::string* error )
+void ArchiveReader::ResetContainer( ContainerTranslator* translator, Pointer pointer )
 {
-	ObjectPtr object;
-	ReadFromFile( path, object, resolver, archiveType, error );
-	return object;
+	// when reading into existing objects (deltas, in place reads) containers must not accumulate old items
+	if ( translator->GetLength( pointer ) )
+	{
+		Variable empty ( translator );
+		translator->Copy( empty, pointer, 0x0 );
+	}
 }
 
-ArchiveReader::ArchiveReader( ObjectResolver* resolver, uint32_t flags )
-	: Archive( flags )
-	, m_Resolver( resolver )
+bool ArchiveReader::CanMerge( const Field* field )
 {
+	// fixed size arrays are read element by element as they are encoded, so they are read in place
+	return ( m_Flags & ArchiveFlags::Merge ) && !m_Staging && field->m_Count == 1 && CanStage( field->m_Translator );
+}
 
+void ArchiveReader::BeginMerge( Pointer current, Pointer staged, Translator* translator )
+{
+	// starting from what is there keeps the fields and items the archive leaves out, as an in place read would
+	StageValue( current, staged, translator );
+	++m_Staging;
 }
 
-ArchiveReader::ArchiveReader( const FilePath& filePath, ObjectResolver* resolver, uint32_t flags )
-	: Archive ( filePath, flags )
-	, m_Resolver( resolver )
+void ArchiveReader::EndMerge( Pointer staged, Pointer current, const Field* field, Object* object )
 {
+	HELIUM_ASSERT( m_Staging );
+	--m_Staging;
+
+	bool changed = false;
+	MergeValue( staged, current, field->m_Translator, field, object, changed );
+	if ( changed )
+	{
+		object->PostDeserialize( field );
+		Changed( object, field );
+	}
 }
 
-ArchiveMode ArchiveReader::GetMode() const
+void ArchiveReader::Changed( Object* object, const Field* field )
 {
-	return ArchiveModes::Read;
+	if ( m_Flags & ( ArchiveFlags::NotifyObjects | ArchiveFlags::NotifyArchive ) )
+	{
+		// workers share the list, a serial read needs no lock
+		if ( m_Parallel )
+		{
+			MutexScopeLock lock ( m_ChangedLock );
+			if ( m_ChangedSet.insert( object ).second )
+			{
+				m_Changed.Push( ObjectPtr( object ) );
+			}
+		}
+		else if ( m_ChangedSet.insert( object ).second )
+		{
+			m_Changed.Push( ObjectPtr( object ) );
+		}
+	}
+	else if ( m_Flags & ArchiveFlags::Notify )
+	{
+		object->RaiseChanged( field );
+	}
 }
 
-Reflect::ObjectPtr ArchiveReader::AllocateObject( const Reflect::MetaClass* type, size_t index )
+bool ArchiveReader::CanStage( Translator* translator )
 {
-	Object* object = type->m_Creator();
+	std::map< const Translator*, bool >::const_iterator found = m_Stageable.find( translator );
+	if ( found != m_Stageable.end() )
+	{
+		return found->second;
+	}
 
-	// if we pre-allocated a proxy, hook it up to the object
-	if ( index < m_Proxies.size() )
+	// pointers are staged by reference, translators copy sets and associations of them deeply so those are read in place
+	bool stageable = true;
+	switch ( translator->GetMetaId() )
 	{
-		// find the appropriate pre-allocated proxy
-		RefCountProxy< Object >* proxy = m_Proxies[ index ];
+	case MetaIds::StructureTranslator:
+		{
+			const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+			for ( const MetaStruct* current = structure; current != NULL && stageable; current = current->m_Base )
+			{
+				for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end && stageable; ++itr )
+				{
+					stageable = CanStage( itr->m_Translator );
+				}
+			}
+			break;
+		}
 
-		// associate the object with the proxy
-		proxy->SetObject( object );
+	case MetaIds::SequenceTranslator:
+		stageable = CanStage( static_cast< SequenceTranslator* >( translator )->GetItemTranslator() );
+		break;
 
-		// associate the proxy with the object
-		object->SetRefCountProxy( proxy );
+	case MetaIds::SetTranslator:
+	case MetaIds::AssociationTranslator:
+		stageable = !HasPointers( translator );
+		break;
+
+	default:
+		break;
 	}
 
-	return ObjectPtr( object );
+	m_Stageable[ translator ] = stageable;
+	return stageable;
+}
+
+bool ArchiveReader::HasPointers( Translator* translator )
+{
+	std::map< const Translator*, bool >::const_iterator found = m_Pointers.find( translator );
+	if ( found != m_Pointers.end() )
+	{
+		return found->second;
+	}
+
+	bool pointers = false;
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		pointers = true;
+		break;
+
+	case MetaIds::StructureTranslator:
+		{
+			const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+			for ( const MetaStruct* current = structure; current != NULL && !pointers; current = current->m_Base )
+			{
+				for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end && !pointers; ++itr )
+				{
+					pointers = HasPointers( itr->m_Translator );
+				}
+			}
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		pointers = HasPointers( static_cast< SequenceTranslator* >( translator )->GetItemTranslator() );
+		break;
+
+	case MetaIds::SetTranslator:
+		pointers = HasPointers( static_cast< SetTranslator* >( translator )->GetItemTranslator() );
+		break;
+
+	case MetaIds::AssociationTranslator:
+		{
+			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+			pointers = HasPointers( association->GetKeyTranslator() ) || HasPointers( association->GetValueTranslator() );
+			break;
+		}
+
+	default:
+		break;
+	}
+
+	m_Pointers[ translator ] = pointers;
+	return pointers;
+}
+
+void ArchiveReader::StageValue( Pointer current, Pointer staged, Translator* translator )
+{
+	if ( !HasPointers( translator ) )
+	{
+		translator->Copy( current, staged, 0x0 );
+		return;
+	}
+
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		{
+			// the same object, owned objects read over the staged pointer are merged in place
+			staged.As< ObjectPtr >() = current.As< ObjectPtr >();
+			break;
+		}
+
+	case MetaIds::StructureTranslator:
+		{
+			const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+			for ( const MetaStruct* base = structure; base != NULL; base = base->m_Base )
+			{
+				for ( DynamicArray< Field >::ConstIterator itr = base->m_Fields.Begin(), end = base->m_Fields.End(); itr != end; ++itr )
+				{
+					const Field* field = &*itr;
+					for ( uint32_t i=0; i<field->m_Count; ++i )
+					{
+						StageValue( Pointer ( field, current.m_Address, NULL, i ), Pointer ( field, staged.m_Address, NULL, i ), field->m_Translator );
+					}
+				}
+			}
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		{
+			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
+			Translator* itemTranslator = sequence->GetItemTranslator();
+			uint32_t length = static_cast< uint32_t >( sequence->GetLength( current ) );
+			sequence->SetLength( staged, length );
+			for ( uint32_t i=0; i<length; ++i )
+			{
+				StageValue( sequence->GetItem( current, i ), sequence->GetItem( staged, i ), itemTranslator );
+			}
+			break;
+		}
+
+	default:
+		HELIUM_BREAK(); // CanStage rejects the rest
+		break;
+	}
+}
+
+void ArchiveReader::MergeValue( Pointer staged, Pointer current, Translator* translator, const Field* field, Object* object, bool& changed )
+{
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		{
+			ObjectPtr& incoming ( staged.As< ObjectPtr >() );
+			ObjectPtr& existing ( current.As< ObjectPtr >() );
+
+			// forward references have no object until their fixup, they always go in so the fixup reaches the field
+			if ( incoming.Ptr() == existing.Ptr() && ( incoming.Ptr() || !incoming.ReferencesObject() ) )
+			{
+				return;
+			}
+
+			if ( !changed )
+			{
+				object->PreDeserialize( field );
+				changed = true;
+			}
+
+			existing = incoming;
+			break;
+		}
+
+	case MetaIds::StructureTranslator:
+		{
+			const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+			for ( const MetaStruct* base = structure; base != NULL; base = base->m_Base )
+			{
+				for ( DynamicArray< Field >::ConstIterator itr = base->m_Fields.Begin(), end = base->m_Fields.End(); itr != end; ++itr )
+				{
+					const Field* member = &*itr;
+					for ( uint32_t i=0; i<member->m_Count; ++i )
+					{
+						MergeValue( Pointer ( member, staged.m_Address, NULL, i ), Pointer ( member, current.m_Address, object, i ), member->m_Translator, field, object, changed );
+					}
+				}
+			}
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		{
+			// items are patched where they differ, the sequence is only resized when its length changed
+			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
+			Translator* itemTranslator = sequence->GetItemTranslator();
+			uint32_t length = static_cast< uint32_t >( sequence->GetLength( staged ) );
+			if ( sequence->GetLength( current ) != length )
+			{
+				if ( !changed )
+				{
+					object->PreDeserialize( field );
+					changed = true;
+				}
+
+				sequence->SetLength( current, length );
+			}
+
+			for ( uint32_t i=0; i<length; ++i )
+			{
+				MergeValue( sequence->GetItem( staged, i ), sequence->GetItem( current, i ), itemTranslator, field, object, changed );
+			}
+			break;
+		}
+
+	default:
+		{
+			// scalars, sets and associations (without pointers) are replaced whole when they differ
+			if ( translator->Equals( staged, current ) )
+			{
+				return;
+			}
+
+			if ( !changed )
+			{
+				object->PreDeserialize( field );
+				changed = true;
+			}
+
+			translator->Copy( staged, current, 0x0 );
+			break;
+		}
+	}
+}
+
+void ArchiveReader::ReadParallel( size_t count, ParallelFunction function )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Persist - Parallel Read" );
+
+	// every top-level object is allocated by now, so references between them resolve directly instead of through a proxy,
+	//  and the workers only ever share the (locked) resolve state below
+	m_Parallel = true;
+	ParallelFor( count, function, this );
+	m_Parallel = false;
+
+	ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
+	info.m_Progress = 100;
+	e_Status.Raise( info );
+	m_Abort |= info.m_Abort;
 }
 
 bool ArchiveReader::Resolve( const Name& identity, ObjectPtr& pointer, const MetaClass* pointerClass )
+{
+	if ( m_Parallel )
+	{
+		MutexScopeLock lock ( m_ResolveLock );
+		return ResolveIndex( identity, pointer, pointerClass );
+	}
+
+	return ResolveIndex( identity, pointer, pointerClass );
+}
+
+bool ArchiveReader::ResolveIndex( const Name& identity, ObjectPtr& pointer, const MetaClass* pointerClass )
 {
 	if ( !m_Resolver || !m_Resolver->Resolve( identity, pointer, pointerClass ) )
 	{
@@ -410,17 +1675,41 @@ bool ArchiveReader::Resolve( const Name& identity, ObjectPtr& pointer, const Met
 				*str);
 			return false;
 		}
+		else if ( index < m_Rejected.size() && m_Rejected[ index ] )
+		{
+			// the object was skipped by the class filter, so there is nothing to point at
+			pointer.Release();
+			return true;
+		}
 		else if ( index < m_Objects.GetSize() )
 		{
 			found = m_Objects.GetElement( index );
 		}
 
-		if ( found )
+		// when cloning shared objects, only the first reference gets the object itself
+		bool clone = false;
+		if ( m_Flags & ArchiveFlags::CloneShared )
+		{
+			if ( m_Referenced.size() < index+1 )
+			{
+				m_Referenced.resize( index+1, false );
+			}
+
+			clone = m_Referenced[ index ];
+			m_Referenced[ index ] = true;
+		}
+
+		// a parallel read may still be filling the object in, so copies wait for Resolve like forward references do
+		if ( found && !( clone && m_Parallel ) )
 		{
 			if ( !found->IsA( pointerClass ) )
 			{
 				Log::Warning( TXT( "Object of type '%s' is not valid for pointer type '%s'" ), pointer->GetMetaClass()->m_Name, pointerClass->m_Name );
 			}
+			else if ( clone )
+			{
+				pointer = found->Clone();
+			}
 			else
 			{
 				pointer = found;
@@ -436,11 +1725,20 @@ bool ArchiveReader::Resolve( const Name& identity, ObjectPtr& pointer, const Met
 
 			// ensure that we have allocated a proxy for this object
 			RefCountProxy< Reflect::Object >* proxy = m_Proxies[ index ];
-			if ( !proxy )
+			if ( !proxy || clone )
 			{
 				proxy = Object::RefCountSupportType::Allocate();
 				MemorySet( proxy, 0 , sizeof( *proxy ) );
-				m_Proxies[ index ] = proxy;
+
+				if ( clone )
+				{
+					// this proxy gets its own copy of the object once everything is read (see Resolve)
+					m_CloneFixups.Push( CloneFixup ( index, proxy ) );
+				}
+				else
+				{
+					m_Proxies[ index ] = proxy;
+				}
 			}
 
 			// release whatever we might already be pointing at and set the pointer to look at our pre-allocated proxy
@@ -460,12 +1758,56 @@ bool ArchiveReader::Resolve( const Name& identity, ObjectPtr& pointer, const Met
 
 void ArchiveReader::Resolve()
 {
+	for ( DynamicArray< CloneFixup >::ConstIterator itr = m_CloneFixups.Begin(), end = m_CloneFixups.End(); itr != end; ++itr )
+	{
+		Object* found = itr->m_Index < m_Objects.GetSize() ? m_Objects.GetElement( itr->m_Index ) : NULL;
+		if ( !found )
+		{
+			// rejected by the class filter (or missing), so the copy reads as null too, pinned like the shared proxy (see AcceptClass)
+			itr->m_Proxy->AddStrongRef();
+			continue;
+		}
+
+		// hook a copy up to the proxy, just like AllocateObject does for the shared one
+		ChargeMemory( ArchiveMemoryTypes::Objects, found->GetMetaClass()->m_Size );
+		Object* object = found->GetMetaClass()->m_Creator();
+		itr->m_Proxy->SetObject( object );
+		object->SetRefCountProxy( itr->m_Proxy );
+		found->CopyTo( object );
+	}
+	m_CloneFixups.Clear();
+
 	ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
 	info.m_Progress = 100;
 	e_Status.Raise( info );
 
 	// do any necessary object finalization here
 
+	// batched change notifications, once references point where they will
+	if ( !m_Changed.IsEmpty() )
+	{
+		if ( m_Flags & ArchiveFlags::NotifyObjects )
+		{
+			for ( DynamicArray< ObjectPtr >::ConstIterator itr = m_Changed.Begin(), end = m_Changed.End(); itr != end; ++itr )
+			{
+				(*itr)->RaiseChanged();
+			}
+		}
+
+		if ( m_Flags & ArchiveFlags::NotifyArchive )
+		{
+			ArchiveStatus changed( *this, ArchiveStates::ObjectsChanged );
+			changed.m_Progress = 100;
+			e_Status.Raise( changed );
+		}
+	}
+
+	if ( m_SchemaStats.m_RenamedClasses || m_SchemaStats.m_MigratedFields || m_SchemaStats.m_UnknownFields )
+	{
+		Log::Debug( TXT( "Read '%s' from an older schema: %u renamed classes, %u migrated and %u unknown field values\n" ),
+			m_Path.c_str(), m_SchemaStats.m_RenamedClasses, m_SchemaStats.m_MigratedFields, m_SchemaStats.m_UnknownFields );
+	}
+
 	info.m_State = ArchiveStates::Complete;
 	e_Status.Raise( info );
 }
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "Platform/Assert.h"
+#include "Platform/Locks.h"
 
 #include "Foundation/Event.h"
 #include "Foundation/FilePath.h"
 #include "Foundation/Log.h" 
 #include "Foundation/SmartPtr.h"
+#include "Foundation/Stream.h"
 
 #include "Reflect/MetaClass.h"
 #include "Reflect/Exceptions.h"
@@ -13,7 +15,14 @@
 #include "Reflect/Translator.h"
 
 #include "Persist/API.h"
+#include "Persist/ArchiveProfile.h"
+#include "Persist/CompressionDictionary.h"
 #include "Persist/Exceptions.h"
+#include "Persist/Parallel.h"
+#include "Persist/Schema.h"
+
+#include <map>
+#include <set>
 
 // enable verbose archive printing
 #define PERSIST_ARCHIVE_VERBOSE 0
@@ -28,8 +37,22 @@ namespace Helium
 		{
 			enum ArchiveFlag
 			{
-				Notify      = 1 << 0, // Notify objects of changes
-				StringCrc   = 1 << 1, // Using string CRC-32 values for meta-data instead of full strings (for brevity)
+				Notify        = 1 << 0, // Notify objects of changes
+				StringCrc     = 1 << 1, // Using string CRC-32 values for meta-data instead of full strings (for brevity)
+				Dedupe        = 1 << 2, // Write byte-identical owned objects once and reference that copy everywhere else (with an external identifier, only along with ShareDeclined)
+				CloneShared   = 1 << 3, // Give every reference after the first to an object its own copy when reading
+				CompressFast  = 1 << 4, // Write framed LZ4 blocks (compressed archives are detected when reading)
+				CompressSmall = 1 << 5, // Write framed zstd blocks
+				Checksum      = 1 << 6, // Write framed blocks with CRC-32C checksums (verified before anything is deserialized)
+				ParallelRead  = 1 << 7, // Deserialize top-level objects on worker threads (Json and Bson, their callbacks must tolerate that)
+				ParallelWrite = 1 << 8, // Serialize slices of top-level objects on worker threads (Json and Bson, output is identical to a serial write)
+				Pipeline      = 1 << 9, // Read uncompressed files through a background I/O thread, overlapping the disk with parsing and construction
+				Merge         = 1 << 10, // Read over the objects given to the reader, changing (and calling back for) only the fields and elements that differ
+				NotifyObjects = 1 << 11, // Collect change notifications while reading, raising one per changed object once references are resolved
+				NotifyArchive = 1 << 12, // Collect change notifications while reading, raising one ArchiveStates::ObjectsChanged status for the whole read
+				ShareDeclined = 1 << 13, // Share objects the external identifier declines by index within the archive, as when there is no identifier
+
+				CompressMask = CompressFast | CompressSmall,
 			};
 		}
 
@@ -70,6 +93,7 @@ namespace Helium
 				ArchiveComplete,
 				PostProcessing,
 				Complete,
+				ObjectsChanged, // see ArchiveReader::GetChangedObjects
 			};
 		}
 		typedef ArchiveStates::ArchiveState ArchiveState;
@@ -92,6 +116,56 @@ namespace Helium
 		};
 		typedef Helium::Signature< const ArchiveStatus& > ArchiveStatusSignature;
 
+		// what reading data written by an older build cost (see Schema)
+		struct SchemaStats
+		{
+			SchemaStats()
+				: m_RenamedClasses( 0 )
+				, m_MigratedFields( 0 )
+				, m_UnknownFields( 0 )
+			{
+			}
+
+			uint32_t m_RenamedClasses; // objects whose class was found by an old name
+			uint32_t m_MigratedFields; // values renamed, converted, or removed
+			uint32_t m_UnknownFields;  // values skipped for want of a field or migration
+		};
+
+		namespace ArchiveMemoryTypes
+		{
+			enum ArchiveMemoryType
+			{
+				Input,     // the encoded archive, read into memory
+				Document,  // parsed or built representations of it (json DOM, bson being built)
+				Temporary, // buffers of parallel slices and the like
+				Objects,   // created while reading (their class's size, not what they allocate themselves)
+				Count,
+			};
+		}
+		typedef ArchiveMemoryTypes::ArchiveMemoryType ArchiveMemoryType;
+
+		// what an archive allocated, and the most it held at once
+		struct ArchiveMemoryStats
+		{
+			ArchiveMemoryStats()
+				: m_Current( 0 )
+				, m_Peak( 0 )
+				, m_Total( 0 )
+			{
+				for ( int i=0; i<ArchiveMemoryTypes::Count; ++i )
+				{
+					m_Held[ i ] = 0;
+					m_Allocated[ i ] = 0;
+				}
+			}
+
+			uint64_t m_Current;
+			uint64_t m_Peak;
+			uint64_t m_Total;
+			uint64_t m_Held[ ArchiveMemoryTypes::Count ];
+			uint64_t m_Allocated[ ArchiveMemoryTypes::Count ];
+		};
+
 		//
 		// Base class for Readers and Writers
 		//
@@ -107,19 +181,44 @@ namespace Helium
 
 		public:
 			inline const Helium::FilePath& GetPath() const;
+			inline uint32_t                GetFlags() const;
 
 			virtual ArchiveType GetType() const = 0;
 			virtual ArchiveMode GetMode() const = 0;
 			virtual void        Open() = 0;
 			virtual void        Close() = 0;
 
+			// writers compress with the dictionary (implies zstd), readers use it for streams that reference its id
+			void                SetCompressionDictionary( CompressionDictionary* dictionary );
+
+			// going over the budget (in bytes, zero for none) throws a Persist::Exception, checked as memory is taken
+			//  the default applies to archives constructed (or reset) after it is set
+			static void         SetDefaultMemoryBudget( uint64_t bytes );
+			void                SetMemoryBudget( uint64_t bytes );
+			ArchiveMemoryStats  GetMemoryStats() const;
+
 			ArchiveStatusSignature::Event e_Status;
 
 		protected:
-			uint32_t           m_Progress; // in bytes
-			bool               m_Abort;
-			const uint8_t      m_Flags;
-			FilePath           m_Path;
+			// open the file at our path, layering compression as our flags (or the file contents) call for
+			Stream*                  OpenStream();
+
+			// forget the last use (path, progress, dictionary, memory accounting), for Reset
+			void                     ResetState();
+
+			// account for memory the archive takes (and gives back), Hold sets what is held of a type to bytes
+			void                     ChargeMemory( ArchiveMemoryType type, uint64_t bytes );
+			void                     ReleaseMemory( ArchiveMemoryType type, uint64_t bytes );
+			void                     HoldMemory( ArchiveMemoryType type, uint64_t bytes );
+
+			uint32_t                 m_Progress; // in bytes
+			bool                     m_Abort;
+			const uint32_t           m_Flags;
+			FilePath                 m_Path;
+			CompressionDictionaryPtr m_Dictionary;
+			uint64_t                 m_MemoryBudget;
+			ArchiveMemoryStats       m_Memory;
+			mutable Mutex            m_MemoryLock; // parallel reads create objects on worker threads
 		};
 
 		//
@@ -128,22 +227,96 @@ namespace Helium
 
 		class HELIUM_PERSIST_API ArchiveWriter : public Archive, public Reflect::ObjectIdentifier
 		{
+			template< class Policy > friend class SerializeEngine;
+
 		public:
-			static SmartPtr< ArchiveWriter > GetWriter( const FilePath& path, Reflect::ObjectIdentifier* identifier = NULL, ArchiveType archiveType = ArchiveTypes::Auto );
+			static SmartPtr< ArchiveWriter > GetWriter( const FilePath& path, Reflect::ObjectIdentifier* identifier = NULL, ArchiveType archiveType = ArchiveTypes::Auto, uint32_t flags = 0x0 );
+			static SmartPtr< ArchiveWriter > GetWriter( Stream* stream, ArchiveType archiveType, Reflect::ObjectIdentifier* identifier = NULL, uint32_t flags = 0x0 );
+			static void                      WriteToStream( const Reflect::ObjectPtr* objects, size_t count, Stream& stream, ArchiveType archiveType, Reflect::ObjectIdentifier* identifier = NULL, uint32_t flags = 0x0 );
 			static bool                      WriteToFile( const FilePath& path, const Reflect::ObjectPtr& object, Reflect::ObjectIdentifier* identifier = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
-			static bool                      WriteToFile( const FilePath& path, const Reflect::ObjectPtr* objects, size_t count, Reflect::ObjectIdentifier* identifier = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
+			static bool                      WriteToFile( const FilePath& path, const Reflect::ObjectPtr* objects, size_t count, Reflect::ObjectIdentifier* identifier = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL, uint32_t flags = 0x0 );
+			static bool                      WriteDeltaToFile( const FilePath& path, const Reflect::ObjectPtr* objects, const Reflect::ObjectPtr* baselines, size_t count, Reflect::ObjectIdentifier* identifier = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL, uint32_t flags = 0x0 );
 
 			ArchiveWriter( Reflect::ObjectIdentifier* identifier, uint32_t flags );
 			ArchiveWriter( const FilePath& path, Reflect::ObjectIdentifier* identifier, uint32_t flags );
 
 			virtual ArchiveMode GetMode() const HELIUM_OVERRIDE;
 
+			// baselines are parallel to the top-level objects, only fields that differ from them are written
+			void SetBaselines( const Reflect::ObjectPtr* baselines, size_t count );
+
+			// record the bytes and time each structure and field takes (NULL stops), writes are serial while profiling
+			void SetProfile( ArchiveProfile* profile );
+
+			// ready a writer that is done with its last write for another one to stream (which it doesn't own),
+			//  keeping the capacity its buffers have built up (see ArchivePool), NULL just lets go of everything
+			virtual void Reset( Stream* stream, Reflect::ObjectIdentifier* identifier = NULL );
+
+			// resumable writes, to spread a save over several frames: open, BeginSteps, then Step until it returns true
+			//  each step writes whole top-level objects until either budget is spent (zero means no limit), at least one
+			void BeginSteps( const Reflect::ObjectPtr* objects, size_t count );
+			bool Step( uint32_t budgetMicroseconds, uint32_t budgetBytes = 0 );
+
 		protected:
 			virtual void Write( const Reflect::ObjectPtr* objects, size_t count ) = 0;
+
+			// the serial write, one top-level object at a time so it can be spread over steps
+			virtual void    Begin() = 0;             // open the top-level array of m_Objects
+			virtual void    WriteNext( size_t index ) = 0;
+			virtual void    End() = 0;               // close it and flush
+			virtual int64_t GetPosition() const = 0; // bytes written so far
+
+			// around every structure and field the formats serialize, no-ops unless profiling
+			inline void  ProfileEnter( const Reflect::MetaStruct* structure );
+			inline void  ProfileEnter( const Reflect::Field* field );
+			inline void  ProfileLeave();
+
 			virtual bool Identify( const Reflect::ObjectPtr& object, Name* identity ) HELIUM_OVERRIDE;
+			void*        GetBaseline( size_t index, const Reflect::MetaClass* objectClass );
+			void*        GetBaseline( const Reflect::ObjectPtr& object, void* baseline );
+			bool         ShouldSerialize( const Reflect::Field* field, void* instance, Reflect::Object* object, void* baseline );
+
+			// hash the encoding of every owned object (bottom up) so identical ones can be shared by Identify
+			void         Deduplicate( const Reflect::ObjectPtr* objects, size_t count );
+			bool         IdentifyDuplicate( const Reflect::ObjectPtr& object, Name* identity );
+			size_t       HashDuplicate( const Reflect::ObjectPtr& object );
+			void         EncodeDuplicate( const Reflect::ObjectPtr& object, DynamicArray< uint8_t >& payload );
+
+			// give every shared object its index up front (in the order a serial write finds them), then encode slices
+			//  of the top-level objects into their own buffers on worker threads, for the format to stitch back together
+			void         WriteParallel( ParallelFunction function );
+			void         IdentifyInstance( void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object, void* baseline );
+			void         IdentifyTranslator( Reflect::Pointer pointer, Reflect::Translator* translator, Reflect::Object* object, void* baseline );
+
+			struct Duplicate
+			{
+				uint32_t                m_Hash;
+				DynamicArray< uint8_t > m_Payload;
+				Reflect::Object*        m_Canonical; // first object seen with this payload
+				uint32_t                m_Count;
+			};
+
+			struct Slice
+			{
+				size_t                  m_Begin;
+				size_t                  m_End;
+				DynamicArray< uint8_t > m_Buffer;
+			};
 
-			DynamicArray< Reflect::ObjectPtr > m_Objects;
-			Reflect::ObjectIdentifier*         m_Identifier;
+			DynamicArray< Reflect::ObjectPtr >         m_Objects;
+			DynamicArray< Reflect::ObjectPtr >         m_Baselines;
+			Reflect::ObjectIdentifier*                 m_Identifier;
+			bool                                       m_Deduplicating;
+			DynamicArray< Duplicate >                  m_Duplicates;
+			std::multimap< uint32_t, size_t >          m_DuplicateHashes;   // payload hash -> duplicate
+			std::map< const Reflect::Object*, size_t > m_DuplicateObjects; // owned object -> duplicate
+			std::set< const Reflect::Object* >         m_DuplicateVisited;  // shared objects already traversed
+			DynamicArray< Slice >                      m_Slices;
+			bool                                       m_Parallel;          // workers are encoding, m_Objects is complete
+			Mutex                                      m_IdentifyLock;
+			bool                                       m_Stepping;
+			size_t                                     m_Step;              // next top-level object to write
+			ArchiveProfile*                            m_Profile;
 		};
 
 		//
@@ -152,23 +325,86 @@ namespace Helium
 
 		class HELIUM_PERSIST_API ArchiveReader : public Archive, public Reflect::ObjectResolver
 		{
+			friend class ArchiveLoader;
+
 		public:
-			static SmartPtr< ArchiveReader > GetReader( const FilePath& path, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto );
+			// return false to skip objects of the given class (checked before allocation)
+			typedef bool (*ClassFilter)( const Reflect::MetaClass* type, void* userData );
+			static bool                      FilterByBaseClass( const Reflect::MetaClass* type, void* baseClass );
+
+			static SmartPtr< ArchiveReader > GetReader( const FilePath& path, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, uint32_t flags = 0x0 );
+			static SmartPtr< ArchiveReader > GetReader( Stream* stream, ArchiveType archiveType, Reflect::ObjectResolver* resolver = NULL, uint32_t flags = 0x0 );
+			static void                      ReadFromStream( Stream& stream, DynamicArray< Reflect::ObjectPtr >& objects, ArchiveType archiveType, Reflect::ObjectResolver* resolver = NULL, uint32_t flags = 0x0 );
 			static bool                      ReadFromFile( const FilePath& path, Reflect::ObjectPtr& object, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
 			static Reflect::ObjectPtr        ReadFromFile( const FilePath& path, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
 			static bool                      ReadFromFile( const FilePath& path, DynamicArray< Reflect::ObjectPtr >& objects, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
+			static bool                      ReadDeltaFromFile( const FilePath& path, const DynamicArray< Reflect::ObjectPtr >& baselines, DynamicArray< Reflect::ObjectPtr >& objects, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
+			static bool                      ReadFilteredFromFile( const FilePath& path, DynamicArray< Reflect::ObjectPtr >& objects, ClassFilter filter, void* filterData, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL );
 
 			ArchiveReader( Reflect::ObjectResolver* resolver, uint32_t flags );
 			ArchiveReader( const FilePath& path, Reflect::ObjectResolver* resolver, uint32_t flags );
 
 			virtual ArchiveMode GetMode() const HELIUM_OVERRIDE;
 
+			// rejected top-level objects are left NULL and are never constructed, references to them resolve to NULL
+			//  (earlier ones through a proxy that is never bound)
+			void               SetClassFilter( ClassFilter filter, void* userData = NULL );
+
+			// resumable reads, the counterpart of the writer's: open, BeginSteps (objects as Read takes them), then Step
+			//  until it returns true and hands the objects over, references are resolved by that last step
+			//  json documents are parsed in full by BeginSteps, only deserialization is spread over the steps
+			void               BeginSteps( const DynamicArray< Reflect::ObjectPtr >& objects = DynamicArray< Reflect::ObjectPtr >() );
+			bool               Step( DynamicArray< Reflect::ObjectPtr >& objects, uint32_t budgetMicroseconds, uint32_t budgetBytes = 0 );
+
+			const SchemaStats& GetSchemaStats() const;
+
+			// objects whose fields were read since the reader was opened or reset (only merged changes for merge reads),
+			//  in the order they were first changed, collected when NotifyObjects or NotifyArchive is set
+			const DynamicArray< Reflect::ObjectPtr >& GetChangedObjects() const;
+
+			// ready a reader that is done with its last read for another one from stream (which it doesn't own),
+			//  keeping the capacity its buffers have built up (see ArchivePool), NULL just lets go of everything
+			virtual void       Reset( Stream* stream, Reflect::ObjectResolver* resolver = NULL );
+
 		protected:
+			static bool        ReadFromArchive( ArchiveReader& archive, DynamicArray< Reflect::ObjectPtr >& objects, std::string* error );
 			virtual void       Read( DynamicArray< Reflect::ObjectPtr >& objects ) = 0;
+
+			// the serial read, one top-level object at a time so it can be spread over steps
+			virtual void       Begin() = 0;                    // parse what has to be, find the top-level array
+			virtual bool       ReadObject( size_t index ) = 0; // into m_Objects[ index ] (growing it), false past the last one
+			virtual void       End();
+			virtual int64_t    GetPosition() const = 0;        // bytes consumed so far
+			virtual int64_t    GetSize() const = 0;            // of the whole input
+			bool               AcceptClass( const Reflect::MetaClass* type, size_t index );
 			Reflect::ObjectPtr AllocateObject( const Reflect::MetaClass* type, size_t index );
+			void               ReadParallel( size_t count, ParallelFunction function );
+			void               ResetContainer( Reflect::ContainerTranslator* translator, Reflect::Pointer pointer );
+
+			// merge reads read a field over a staged copy of it, then patch what differs into the object,
+			//  calling back for the field only if anything did (nothing read over a staged copy is merged itself)
+			bool               CanMerge( const Reflect::Field* field );
+			void               BeginMerge( Reflect::Pointer current, Reflect::Pointer staged, Reflect::Translator* translator );
+			void               EndMerge( Reflect::Pointer staged, Reflect::Pointer current, const Reflect::Field* field, Reflect::Object* object );
+
+			// a field of object was read (or merged), raised right away for Notify or collected for the batched flags
+			void               Changed( Reflect::Object* object, const Reflect::Field* field );
+
+			// classes and fields by the CRC-32 of the name they were written with, NULL skips the field's value
+			const Reflect::MetaClass* FindClass( uint32_t crc );
+			const SchemaField*        FindField( const Reflect::MetaStruct* structure, uint32_t crc, const char* name );
 			bool               Resolve( const Name& identity, Reflect::ObjectPtr& pointer, const Reflect::MetaClass* pointerClass ) HELIUM_OVERRIDE;
 			void               Resolve();
 
+		private:
+			bool               ResolveIndex( const Name& identity, Reflect::ObjectPtr& pointer, const Reflect::MetaClass* pointerClass );
+			const SchemaField* MapField( const Reflect::MetaStruct* structure, uint32_t crc, const char* name );
+			bool               CanStage( Reflect::Translator* translator );
+			bool               HasPointers( Reflect::Translator* translator );
+			void               StageValue( Reflect::Pointer current, Reflect::Pointer staged, Reflect::Translator* translator );
+			void               MergeValue( Reflect::Pointer staged, Reflect::Pointer current, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object, bool& changed );
+
+		protected:
 			struct Fixup
 			{
 				Fixup( const Fixup& rhs )
@@ -185,10 +421,40 @@ namespace Helium
 				const Reflect::MetaClass* m_PointerClass;
 			};
 
+			struct CloneFixup
+			{
+				CloneFixup( size_t index, RefCountProxy< Reflect::Object >* proxy )
+					: m_Index( index )
+					, m_Proxy( proxy )
+				{}
+
+				size_t                            m_Index;
+				RefCountProxy< Reflect::Object >* m_Proxy;
+			};
+
 			std::vector< RefCountProxy< Reflect::Object >* >  m_Proxies;
 			DynamicArray< Fixup >                             m_Fixups;
+			DynamicArray< CloneFixup >                        m_CloneFixups;
+			std::vector< bool >                               m_Referenced;
 			DynamicArray< Reflect::ObjectPtr >                m_Objects;
 			Reflect::ObjectResolver*                          m_Resolver;
+			ClassFilter                                       m_ClassFilter;
+			void*                                             m_ClassFilterData;
+			std::vector< bool >                               m_Rejected;
+			bool                                              m_Parallel;    // workers are deserializing, Resolve must serialize
+			Mutex                                             m_ResolveLock;
+			bool                                              m_Stepping;
+			size_t                                            m_Step;        // next top-level object to read
+			std::map< const Reflect::MetaStruct*, const SchemaMap* > m_SchemaMaps;
+			std::set< std::pair< const Reflect::MetaStruct*, uint32_t > > m_UnknownFields; // already traced
+			SchemaStats                                       m_SchemaStats;
+			Mutex                                             m_SchemaLock;  // when parallel
+			uint32_t                                          m_Staging;     // fields being read over staged copies (merge reads)
+			std::map< const Reflect::Translator*, bool >      m_Stageable;   // whether values of a translator can be staged and merged
+			std::map< const Reflect::Translator*, bool >      m_Pointers;    // whether values of a translator can hold object pointers
+			DynamicArray< Reflect::ObjectPtr >                m_Changed;     // first changed first
+			std::set< const Reflect::Object* >                m_ChangedSet;
+			Mutex                                             m_ChangedLock; // when parallel
 		};
 	}
 }
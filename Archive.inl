@@ -2,3 +2,32 @@ const Helium::FilePath& Helium::Persist::Archive::GetPath() const
 {
 	return m_Path;
 }
+
+uint32_t Helium::Persist::Archive::GetFlags() const
+{
+	return m_Flags;
+}
+
+void Helium::Persist::ArchiveWriter::ProfileEnter( const Reflect::MetaStruct* structure )
+{
+	if ( m_Profile )
+	{
+		m_Profile->Enter( structure, GetPosition() );
+	}
+}
+
+void Helium::Persist::ArchiveWriter::ProfileEnter( const Reflect::Field* field )
+{
+	if ( m_Profile )
+	{
+		m_Profile->Enter( field, GetPosition() );
+	}
+}
+
+void Helium::Persist::ArchiveWriter::ProfileLeave()
+{
+	if ( m_Profile )
+	{
+		m_Profile->Leave( GetPosition() );
+	}
+}
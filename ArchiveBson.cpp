@@ -10,6 +10,7 @@
 #include "Reflect/Registry.h"
 #include "Reflect/TranslatorDeduction.h"
 
+#include <limits.h>
 #include <time.h>
 
 HELIUM_DEFINE_BASE_STRUCT( Helium::Persist::BsonDate );
@@ -110,16 +111,18 @@ void ArchiveWriterBson::WriteToStream( const ObjectPtr* objects, size_t count, S
 void ArchiveWriterBson::WriteToBson( const ObjectPtr& object, bson* b, const char* name, Reflect::ObjectIdentifier* identifier, uint32_t flags )
 {
 	ArchiveWriterBson archive ( NULL, identifier, flags );
-	archive.SerializeInstance( b, name, object, object->GetMetaClass(), object );
+	archive.SerializeInstance( b, name, object, object->GetMetaClass(), object, NULL );
 }
 
 ArchiveWriterBson::ArchiveWriterBson( const FilePath& path, ObjectIdentifier* identifier, uint32_t flags )
 	: ArchiveWriter( path, identifier, flags )
+	, m_Building( false )
 {
 }
 
 ArchiveWriterBson::ArchiveWriterBson( Stream *stream, ObjectIdentifier* identifier, uint32_t flags )
 	: ArchiveWriter( identifier, flags )
+	, m_Building( false )
 {
 	m_Stream.Reset( stream );
 	m_Stream.Orphan( true );
@@ -136,17 +139,29 @@ void ArchiveWriterBson::Open()
 	Log::Print(TXT("Opening file '%s'\n"), m_Path.c_str());
 #endif
 
-	FileStream* stream = new FileStream();
-	stream->Open( m_Path, FileStream::MODE_WRITE );
+	Stream* stream = OpenStream();
 	m_Stream.Reset( stream );
 }
 
 void ArchiveWriterBson::Close()
 {
 	HELIUM_ASSERT( m_Stream );
+
+	// steps that were given up on
+	Discard();
+
 	m_Stream->Close();
 }
 
+void ArchiveWriterBson::Reset( Stream* stream, ObjectIdentifier* identifier )
+{
+	Discard();
+	ArchiveWriter::Reset( stream, identifier );
+
+	m_Stream.Reset( stream );
+	m_Stream.Orphan( true );
+}
+
 void ArchiveWriterBson::Write( const ObjectPtr* objects, size_t count )
 {
 	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Bson Write" );
@@ -155,42 +170,137 @@ void ArchiveWriterBson::Write( const ObjectPtr* objects, size_t count )
 	ArchiveStatus info( *this, ArchiveStates::Starting );
 	e_Status.Raise( info );
 
+	if ( m_Flags & ArchiveFlags::Dedupe )
+	{
+		Deduplicate( objects, count );
+	}
+
 	// the master object
 	m_Objects.AddArray( objects, count );
 
-	bson b[1];
-	bson_init( b );
+	if ( ( m_Flags & ArchiveFlags::ParallelWrite ) && !m_Objects.IsEmpty() && !m_Profile )
+	{
+		WriteParallel( &ArchiveWriterBson::WriteSlice );
+		WriteSlices();
+
+		// notify completion of last object processed
+		info.m_State = ArchiveStates::ObjectProcessed;
+		info.m_Progress = 100;
+		e_Status.Raise( info );
+
+		m_Stream->Flush();
+
+		info.m_State = ArchiveStates::Complete;
+		e_Status.Raise( info );
+		return;
+	}
+
+	Begin();
 
 	try
 	{
-		HELIUM_VERIFY( BSON_OK == bson_append_start_array( b, "objects" ) );
-
 		// objects can get changed during this iteration (in Identify), so use indices
 		for ( size_t index = 0; index < m_Objects.GetSize(); ++index )
 		{
-			Object* object = m_Objects.GetElement( index );
-			const MetaClass* objectClass = object->GetMetaClass();
-
-			char num[16];
-			Helium::StringPrint( num, "%d", index );
-			HELIUM_VERIFY( BSON_OK == bson_append_start_object( b, num ) );
-			SerializeInstance( b, objectClass->m_Name, object, objectClass, object );
-			HELIUM_VERIFY( BSON_OK == bson_append_finish_object( b ) );
+			WriteNext( index );
 
 			info.m_State = ArchiveStates::ObjectProcessed;
 			info.m_Progress = (int)(((float)(index) / (float)m_Objects.GetSize()) * 100.0f);
 			e_Status.Raise( info );
 		}
 
-		HELIUM_VERIFY( BSON_OK == bson_append_finish_array( b ) );
+		End();
+	}
+	catch( ... )
+	{
+		Discard();
+		throw;
+	}
 
-		// notify completion of last object processed
-		info.m_State = ArchiveStates::ObjectProcessed;
-		info.m_Progress = 100;
-		e_Status.Raise( info );
+	// notify completion of last object processed
+	info.m_State = ArchiveStates::ObjectProcessed;
+	info.m_Progress = 100;
+	e_Status.Raise( info );
+
+	// notify completion
+	info.m_State = ArchiveStates::Complete;
+	e_Status.Raise( info );
+}
+
+void ArchiveWriterBson::Begin()
+{
+	bson_init( m_Bson );
+	m_Building = true;
+
+	HELIUM_VERIFY( BSON_OK == bson_append_start_array( m_Bson, "objects" ) );
+}
+
+void ArchiveWriterBson::WriteNext( size_t index )
+{
+	WriteObject( m_Bson, index );
+	HoldMemory( ArchiveMemoryTypes::Document, m_Bson->dataSize );
+}
+
+void ArchiveWriterBson::End()
+{
+	HELIUM_VERIFY( BSON_OK == bson_append_finish_array( m_Bson ) );
+	HELIUM_VERIFY( BSON_OK == bson_finish( m_Bson ) );
+	m_Stream->Write( bson_data( m_Bson ), bson_size( m_Bson ), 1 );
+
+	Discard();
+
+	// do cleanup
+	m_Stream->Flush();
+}
+
+int64_t ArchiveWriterBson::GetPosition() const
+{
+	// nothing reaches the stream before End, count what has been built
+	return m_Building ? m_Bson->cur - m_Bson->data : 0;
+}
+
+void ArchiveWriterBson::Discard()
+{
+	if ( m_Building )
+	{
+		bson_destroy( m_Bson );
+		m_Building = false;
+		HoldMemory( ArchiveMemoryTypes::Document, 0 );
+	}
+}
+
+void ArchiveWriterBson::WriteObject( bson* b, size_t index )
+{
+	Object* object = m_Objects.GetElement( index );
+	const MetaClass* objectClass = object->GetMetaClass();
+
+	char num[16];
+	Helium::StringPrint( num, "%d", index );
+	HELIUM_VERIFY( BSON_OK == bson_append_start_object( b, num ) );
+	SerializeInstance( b, objectClass->m_Name, object, objectClass, object, GetBaseline( index, objectClass ) );
+	HELIUM_VERIFY( BSON_OK == bson_append_finish_object( b ) );
+}
+
+void ArchiveWriterBson::WriteSlice( size_t index, void* userData )
+{
+	ArchiveWriterBson* archive = static_cast< ArchiveWriterBson* >( userData );
+	Slice& slice = archive->m_Slices[ index ];
+
+	bson b[1];
+	bson_init( b );
+
+	try
+	{
+		for ( size_t i = slice.m_Begin; i < slice.m_End; ++i )
+		{
+			archive->WriteObject( b, i );
+		}
 
 		HELIUM_VERIFY( BSON_OK == bson_finish( b ) );
-		m_Stream->Write( bson_data( b ), bson_size( b ), 1 );
+
+		// keep just the elements, the array they belong in is assembled by WriteSlices
+		const uint8_t* data = reinterpret_cast< const uint8_t* >( bson_data( b ) );
+		slice.m_Buffer.AddArray( data + sizeof( int32_t ), bson_size( b ) - sizeof( int32_t ) - 1 );
 	}
 	catch( ... )
 	{
@@ -199,16 +309,49 @@ void ArchiveWriterBson::Write( const ObjectPtr* objects, size_t count )
 	}
 
 	bson_destroy( b );
+}
 
-	// do cleanup
-	m_Stream->Flush();
+static void WriteInt32( Stream& stream, uint32_t value )
+{
+	// bson is little endian
+	uint8_t bytes[ 4 ] = { uint8_t( value ), uint8_t( value >> 8 ), uint8_t( value >> 16 ), uint8_t( value >> 24 ) };
+	stream.Write( bytes, sizeof( bytes ), 1 );
+}
 
-	// notify completion
-	info.m_State = ArchiveStates::Complete;
-	e_Status.Raise( info );
+void ArchiveWriterBson::WriteSlices()
+{
+	static const char name[] = "objects";
+
+	size_t elements = 0;
+	for ( DynamicArray< Slice >::ConstIterator itr = m_Slices.Begin(), end = m_Slices.End(); itr != end; ++itr )
+	{
+		elements += itr->m_Buffer.GetSize();
+	}
+
+	// the same document bson_append_start_array( b, "objects" ) builds around the elements
+	size_t arraySize = sizeof( int32_t ) + elements + 1;
+	size_t documentSize = sizeof( int32_t ) + 1 + sizeof( name ) + arraySize + 1;
+	if ( documentSize > INT_MAX )
+	{
+		throw Persist::Exception( "Bson error: %s", GetBsonErrorString( BSON_SIZE_OVERFLOW ) );
+	}
+
+	WriteInt32( *m_Stream, static_cast< uint32_t >( documentSize ) );
+	m_Stream->Write< uint8_t >( BSON_ARRAY );
+	m_Stream->Write( name, sizeof( name ), 1 );
+	WriteInt32( *m_Stream, static_cast< uint32_t >( arraySize ) );
+	for ( DynamicArray< Slice >::ConstIterator itr = m_Slices.Begin(), end = m_Slices.End(); itr != end; ++itr )
+	{
+		m_Stream->Write( itr->m_Buffer.GetData(), itr->m_Buffer.GetSize(), 1 );
+	}
+	m_Stream->Write< uint8_t >( 0 ); // array
+	m_Stream->Write< uint8_t >( 0 ); // document
+
+	m_Slices.Clear();
+	HoldMemory( ArchiveMemoryTypes::Temporary, 0 );
 }
 
-void ArchiveWriterBson::SerializeInstance( bson* b, const char* name, void* instance, const MetaStruct* structure, Object* object )
+void ArchiveWriterBson::SerializeInstance( bson* b, const char* name, void* instance, const MetaStruct* structure, Object* object, void* baseline )
 {
 #if PERSIST_ARCHIVE_VERBOSE
 	Log::Print( TXT( "Serializing %s\n" ), structure->m_Name );
@@ -231,13 +374,15 @@ void ArchiveWriterBson::SerializeInstance( bson* b, const char* name, void* inst
 		for ( ; itr != end; ++itr )
 		{
 			const Field* field = &*itr;
-			if ( field->ShouldSerialize( instance, object ) )
+			if ( ShouldSerialize( field, instance, object, baseline ) )
 			{
 				fields.Push( field );
 			}
 		}
 	}
 
+	ProfileEnter( structure );
+
 	if ( name )
 	{
 		HELIUM_VERIFY( BSON_OK == bson_append_start_object( b, name ) );
@@ -253,7 +398,9 @@ void ArchiveWriterBson::SerializeInstance( bson* b, const char* name, void* inst
 
 		object->PreSerialize( field );
 
-		SerializeField( b, instance, field, object );
+		ProfileEnter( field );
+		SerializeField( b, instance, field, object, baseline );
+		ProfileLeave();
 
 		object->PostSerialize( field );
 	}
@@ -264,9 +411,11 @@ void ArchiveWriterBson::SerializeInstance( bson* b, const char* name, void* inst
 	{
 		HELIUM_VERIFY( BSON_OK == bson_append_finish_object( b ) );
 	}
+
+	ProfileLeave();
 }
 
-void ArchiveWriterBson::SerializeField( bson* b, void* instance, const Field* field, Object* object )
+void ArchiveWriterBson::SerializeField( bson* b, void* instance, const Field* field, Object* object, void* baseline )
 {
 #if PERSIST_ARCHIVE_VERBOSE
 	Log::Print(TXT("Serializing field %s\n"), field->m_Name);
@@ -280,18 +429,20 @@ void ArchiveWriterBson::SerializeField( bson* b, void* instance, const Field* fi
 		{
 			char num[16];
 			Helium::StringPrint( num, "%d", i );
-			SerializeTranslator( b, num, Pointer ( field, instance, object, i ), field->m_Translator, field, object );
+			void* elementBaseline = baseline ? Pointer ( field, baseline, NULL, i ).m_Address : NULL;
+			SerializeTranslator( b, num, Pointer ( field, instance, object, i ), field->m_Translator, field, object, elementBaseline );
 		}
 
 		HELIUM_VERIFY( BSON_OK == bson_append_finish_array( b ) );
 	}
 	else
 	{
-		SerializeTranslator( b, field->m_Name, Pointer ( field, instance, object ), field->m_Translator, field, object );
+		void* fieldBaseline = baseline ? Pointer ( field, baseline, NULL ).m_Address : NULL;
+		SerializeTranslator( b, field->m_Name, Pointer ( field, instance, object ), field->m_Translator, field, object, fieldBaseline );
 	}
 }
 
-void ArchiveWriterBson::SerializeTranslator( bson* b, const char* name, Pointer pointer, Translator* translator, const Field* field, Object* object )
+void ArchiveWriterBson::SerializeTranslator( bson* b, const char* name, Pointer pointer, Translator* translator, const Field* field, Object* object, void* baseline )
 {
 	switch ( translator->GetMetaId() )
 	{
@@ -373,7 +524,7 @@ void ArchiveWriterBson::SerializeTranslator( bson* b, const char* name, Pointer
 			}
 			else
 			{
-				SerializeInstance( b, name, pointer.m_Address, structure->GetMetaStruct(), object );
+				SerializeInstance( b, name, pointer.m_Address, structure->GetMetaStruct(), object, baseline );
 			}
 			break;
 		}
@@ -393,7 +544,7 @@ void ArchiveWriterBson::SerializeTranslator( bson* b, const char* name, Pointer
 			{
 				char num[16];
 				Helium::StringPrint( num, "%d", index );
-				SerializeTranslator( b, num, *itr, itemTranslator, field, object );
+				SerializeTranslator( b, num, *itr, itemTranslator, field, object, NULL );
 			}
 
 			HELIUM_VERIFY( BSON_OK == bson_append_finish_array( b ) );
@@ -415,7 +566,7 @@ void ArchiveWriterBson::SerializeTranslator( bson* b, const char* name, Pointer
 			{
 				char num[16];
 				Helium::StringPrint( num, "%d", index );
-				SerializeTranslator( b, num, *itr, itemTranslator, field, object );
+				SerializeTranslator( b, num, *itr, itemTranslator, field, object, NULL );
 			}
 
 			HELIUM_VERIFY( BSON_OK == bson_append_finish_array( b ) );
@@ -439,7 +590,7 @@ void ArchiveWriterBson::SerializeTranslator( bson* b, const char* name, Pointer
 			{
 				String name;
 				keyTranslator->Print( *keyItr, name, m_Identifier );
-				SerializeTranslator( b, name.GetData(), *valueItr, valueTranslator, field, object );
+				SerializeTranslator( b, name.GetData(), *valueItr, valueTranslator, field, object, NULL );
 			}
 
 			HELIUM_VERIFY( BSON_OK == bson_append_finish_object( b ) );
@@ -479,6 +630,9 @@ ArchiveReaderBson::ArchiveReaderBson( const FilePath& path, ObjectResolver* reso
 	: ArchiveReader( path, resolver, flags )
 	, m_Stream( NULL )
 	, m_Size( 0 )
+	, m_Array( false )
+	, m_Incremental( false )
+	, m_Received( 0 )
 {
 
 }
@@ -487,6 +641,9 @@ ArchiveReaderBson::ArchiveReaderBson( Stream *stream, ObjectResolver* resolver,
 	: ArchiveReader( resolver, flags )
 	, m_Stream( NULL )
 	, m_Size( 0 )
+	, m_Array( false )
+	, m_Incremental( false )
+	, m_Received( 0 )
 {
 	m_Stream.Reset( stream );
 	m_Stream.Orphan( true );
@@ -503,8 +660,7 @@ void ArchiveReaderBson::Open()
 	Log::Print(TXT("Opening file '%s'\n"), m_Path.c_str());
 #endif
 
-	FileStream* stream = new FileStream();
-	stream->Open( m_Path, FileStream::MODE_READ );
+	Stream* stream = OpenStream();
 	m_Stream.Reset( stream );
 }
 
@@ -514,20 +670,35 @@ void ArchiveReaderBson::Close()
 	m_Stream->Close();
 }
 
+void ArchiveReaderBson::Reset( Stream* stream, ObjectResolver* resolver )
+{
+	ArchiveReader::Reset( stream, resolver );
+
+	// m_Bson only ever points into m_Buffer, there is nothing of its own to free
+	m_Buffer.Resize( 0 );
+	m_Size = 0;
+	m_Array = false;
+	m_Incremental = false;
+	m_Received = 0;
+	m_Bodies.Resize( 0 );
+
+	m_Stream.Reset( stream );
+	m_Stream.Orphan( true );
+}
+
 void ArchiveReaderBson::Read( DynamicArray< Reflect::ObjectPtr >& objects )
 {
 	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Bson Read" );
 
-	Start();
-
 	m_Objects = objects;
 
-	bson_iterator i[1];
-	bson_iterator_init( i, m_Bson );
+	Begin();
 
-	if ( HELIUM_VERIFY( bson_iterator_type( i ) == BSON_ARRAY ) )
+	// merge reads stage fields on the reader, so they are serial
+	if ( m_Array && ( m_Flags & ArchiveFlags::ParallelRead ) && !( m_Flags & ArchiveFlags::Merge ) )
 	{
-		bson_iterator_subiterator( i, m_Next );
+		// walking the array only skips over each element, allocate everything up front on this thread
+		//  (class filter and proxies included), then fill in the objects in parallel
 		for ( size_t i=0; bson_iterator_more( m_Next ); ++i )
 		{
 			if ( i+1 > m_Objects.GetSize() )
@@ -535,9 +706,18 @@ void ArchiveReaderBson::Read( DynamicArray< Reflect::ObjectPtr >& objects )
 				m_Objects.Push( NULL );
 			}
 
-			ObjectPtr& object( m_Objects[i] );
-			ReadNext( object, i );
+			Body& body = *m_Bodies.New();
+			body.m_Valid = Allocate( m_Next, m_Objects[i], i, body.m_Iterator );
+			bson_iterator_next( m_Next );
+		}
 
+		ReadParallel( m_Bodies.GetSize(), &ArchiveReaderBson::ReadParallelObject );
+		m_Bodies.Clear();
+	}
+	else
+	{
+		for ( size_t i=0; ReadObject( i ); ++i )
+		{
 			ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
 			info.m_Progress = (int)(((float)(m_Stream->Tell()) / (float)m_Size) * 100.0f);
 			e_Status.Raise( info );
@@ -553,18 +733,71 @@ void ArchiveReaderBson::Read( DynamicArray< Reflect::ObjectPtr >& objects )
 
 	objects = m_Objects;
 
+	End();
+}
+
+void ArchiveReaderBson::Begin()
+{
+	// objects are constructed as soon as their bytes arrive, unless they are all wanted at once for a parallel read
+	//  (stepped reads are always incremental, so each step only waits on the bytes it uses)
+	m_Incremental = ( ( m_Flags & ArchiveFlags::Pipeline ) || m_Stepping ) && ( !( m_Flags & ArchiveFlags::ParallelRead ) || ( m_Flags & ArchiveFlags::Merge ) );
+
+	Start();
+
+	bson_iterator i[1];
+	bson_iterator_init( i, m_Bson );
+
+	m_Array = HELIUM_VERIFY( bson_iterator_type( i ) == BSON_ARRAY );
+	if ( m_Array )
+	{
+		bson_iterator_subiterator( i, m_Next );
+	}
+}
+
+bool ArchiveReaderBson::ReadObject( size_t index )
+{
+	if ( !m_Array )
+	{
+		return false;
+	}
+
+	ReceiveElement( m_Next );
+	if ( !bson_iterator_more( m_Next ) )
+	{
+		return false;
+	}
+
+	if ( index+1 > m_Objects.GetSize() )
+	{
+		m_Objects.Push( NULL );
+	}
+
+	return ReadNext( m_Objects[ index ], index );
+}
+
+void ArchiveReaderBson::End()
+{
 	bson_destroy( m_Bson );
 }
 
+int64_t ArchiveReaderBson::GetPosition() const
+{
+	return m_Stream->Tell();
+}
+
+int64_t ArchiveReaderBson::GetSize() const
+{
+	return m_Size;
+}
+
 void ArchiveReaderBson::Start()
 {
 	ArchiveStatus info( *this, ArchiveStates::Starting );
 	e_Status.Raise( info );
 	m_Abort = false;
 
-	// determine the size of the input stream
-	m_Stream->Seek(0, SeekOrigins::End);
-	m_Size = m_Stream->Tell();
+	// determine the size of the input stream (without seeking, which would throw away what a read ahead stream prefetched)
+	m_Size = m_Stream->GetSize();
 	m_Stream->Seek(0, SeekOrigins::Begin);
 
 	// fail on an empty input stream
@@ -573,10 +806,22 @@ void ArchiveReaderBson::Start()
 		throw Persist::StreamException( TXT( "Input stream is empty (%s)" ), m_Path.c_str() );
 	}
 
-	// read entire contents
+	// read entire contents (or, when incremental, only up to the first object, see ReceiveElement)
+	HoldMemory( ArchiveMemoryTypes::Input, m_Size + 1 );
 	m_Buffer.Resize( static_cast< size_t >( m_Size + 1 ) );
-	m_Stream->Read( m_Buffer.GetData(),  static_cast< size_t >( m_Size ), 1 );
 	m_Buffer[ static_cast< size_t >( m_Size ) ] = '\0';
+	m_Received = 0;
+	if ( m_Incremental )
+	{
+		// document size, then type, name, and size of the objects array, then the type of its first element
+		Receive( sizeof( int32_t ) );
+		size_t array = ReceiveName( sizeof( int32_t ) + 1 );
+		Receive( array + sizeof( int32_t ) + 1 );
+	}
+	else
+	{
+		Receive( static_cast< size_t >( m_Size ) );
+	}
 
 	if ( !HELIUM_VERIFY( BSON_OK == bson_init_finished_data( m_Bson, reinterpret_cast< char* >( m_Buffer.GetData() ), false ) ) )
 	{
@@ -584,6 +829,70 @@ void ArchiveReaderBson::Start()
 	}
 }
 
+void ArchiveReaderBson::Receive( size_t end )
+{
+	end = Min( end, static_cast< size_t >( m_Size ) );
+	if ( end > m_Received )
+	{
+		// never less than a block at a time, the stream below is reading ahead anyway
+		size_t count = Min( Max< size_t >( end - m_Received, 64 * 1024 ), static_cast< size_t >( m_Size ) - m_Received );
+		if ( m_Stream->Read( m_Buffer.GetData() + m_Received, count, 1 ) != 1 )
+		{
+			throw Persist::StreamException( TXT( "Unexpected end of stream (%s)" ), m_Path.c_str() );
+		}
+		m_Received += count;
+	}
+}
+
+size_t ArchiveReaderBson::ReceiveName( size_t offset )
+{
+	for (;; ++offset )
+	{
+		Receive( offset + 1 );
+		if ( offset >= m_Received )
+		{
+			throw Persist::StreamException( TXT( "Unexpected end of stream (%s)" ), m_Path.c_str() );
+		}
+
+		if ( m_Buffer[ offset ] == '\0' )
+		{
+			return offset + 1;
+		}
+	}
+}
+
+void ArchiveReaderBson::ReceiveElement( bson_iterator* i )
+{
+	if ( !m_Incremental )
+	{
+		return;
+	}
+
+	size_t offset = i->cur - reinterpret_cast< const char* >( m_Buffer.GetData() );
+	Receive( offset + 1 );
+
+	uint8_t type = m_Buffer[ offset ];
+	if ( type == BSON_EOO )
+	{
+		return;
+	}
+
+	if ( type == BSON_OBJECT || type == BSON_ARRAY )
+	{
+		// the whole embedded document, and the type of the element after it
+		size_t value = ReceiveName( offset + 1 );
+		Receive( value + sizeof( int32_t ) );
+
+		const uint8_t* size = m_Buffer.GetData() + value;
+		Receive( value + ( size[ 0 ] | size[ 1 ] << 8 | size[ 2 ] << 16 | size[ 3 ] << 24 ) + 1 );
+	}
+	else
+	{
+		// not an object, let the iterator size it up with everything in hand
+		Receive( static_cast< size_t >( m_Size ) );
+	}
+}
+
 bool ArchiveReaderBson::ReadNext( Reflect::ObjectPtr& object, size_t index )
 {
 	if ( !bson_iterator_more( m_Next ) )
@@ -591,8 +900,20 @@ bool ArchiveReaderBson::ReadNext( Reflect::ObjectPtr& object, size_t index )
 		return false;
 	}
 
+	bson_iterator elem[1];
+	if ( Allocate( m_Next, object, index, elem ) && object.ReferencesObject() )
+	{
+		DeserializeInstance( elem, object, object->GetMetaClass(), object );
+	}
+
+	bson_iterator_next( m_Next );
+	return true;
+}
+
+bool ArchiveReaderBson::Allocate( bson_iterator* next, Reflect::ObjectPtr& object, size_t index, bson_iterator* body )
+{
 	bson_iterator i[1];
-	bson_iterator_subiterator( m_Next, i );
+	bson_iterator_subiterator( next, i );
 	if ( HELIUM_VERIFY( bson_iterator_type( i ) == BSON_OBJECT ) )
 	{
 		const char* key = bson_iterator_key( i );
@@ -606,24 +927,31 @@ bool ArchiveReaderBson::ReadNext( Reflect::ObjectPtr& object, size_t index )
 		const MetaClass* objectClass = NULL;
 		if ( objectClassCrc != 0 )
 		{
-			objectClass = Registry::GetInstance()->GetMetaClass( objectClassCrc );
+			objectClass = FindClass( objectClassCrc );
 		}
 
-		if ( !object && HELIUM_VERIFY( objectClass ) )
+		if ( !object && HELIUM_VERIFY( objectClass ) && AcceptClass( objectClass, index ) )
 		{
 			object = AllocateObject( objectClass, index );
 		}
 
-		if ( object.ReferencesObject() )
-		{
-			bson_iterator elem[1];
-			bson_iterator_subiterator( i, elem );
-			DeserializeInstance( elem, object, object->GetMetaClass(), object );
-		}
+		bson_iterator_subiterator( i, body );
+		return true;
 	}
 
-	bson_iterator_next( m_Next );
-	return true;
+	return false;
+}
+
+void ArchiveReaderBson::ReadParallelObject( size_t index, void* userData )
+{
+	ArchiveReaderBson* archive = static_cast< ArchiveReaderBson* >( userData );
+
+	Object* object = archive->m_Objects[ index ];
+	Body& body = archive->m_Bodies[ index ];
+	if ( body.m_Valid && object )
+	{
+		archive->DeserializeInstance( body.m_Iterator, object, object->GetMetaClass(), object );
+	}
 }
 
 void ArchiveReaderBson::DeserializeInstance( bson_iterator* i, void* instance, const MetaStruct* structure, Object* object )
@@ -631,7 +959,12 @@ void ArchiveReaderBson::DeserializeInstance( bson_iterator* i, void* instance, c
 #if PERSIST_ARCHIVE_VERBOSE
 	Log::Print(TXT("Deserializing %s\n"), structure->m_Name);
 #endif
-	object->PreDeserialize( NULL );
+	// staged copies aren't the object's yet, EndMerge calls back for what they change once they are merged
+	bool staged = m_Staging != 0;
+	if ( !staged )
+	{
+		object->PreDeserialize( NULL );
+	}
 
 	while( bson_iterator_next( i ) )
 	{
@@ -643,37 +976,48 @@ void ArchiveReaderBson::DeserializeInstance( bson_iterator* i, void* instance, c
 			fieldCrc = Helium::Crc32( key );
 		}
 
-		const Field* field = structure->FindFieldByName( fieldCrc );
-		if ( field )
+		const SchemaField* mapped = FindField( structure, fieldCrc, key );
+		if ( mapped )
 		{
-			object->PreDeserialize( field );
+			const Field* field = mapped->m_Field;
+			if ( !mapped->m_Converter && CanMerge( field ) )
+			{
+				Pointer current ( field, instance, object );
+				Variable staged ( field->m_Translator );
+				BeginMerge( current, staged, field->m_Translator );
+				DeserializeTranslator( i, staged, field->m_Translator, field, object );
+				EndMerge( staged, current, field, object );
+				continue;
+			}
 
-			DeserializeField( i, instance, field, object );
+			if ( !staged )
+			{
+				object->PreDeserialize( field );
+			}
 
-			object->PostDeserialize( field );
-		}
-		else
-		{
-			if ( key )
+			if ( mapped->m_Converter )
 			{
-				HELIUM_TRACE(
-					TraceLevels::Debug,
-					"ArchiveReaderBson::DeserializeInstance - Could not find field '%s' (CRC-32 = %" PRIu32 ")\n",
-					key,
-					fieldCrc);
+				Variable oldValue ( mapped->m_Translator );
+				DeserializeTranslator( i, oldValue, mapped->m_Translator, field, object );
+				mapped->m_Converter( oldValue, Pointer ( field, instance, object ), object );
 			}
 			else
 			{
-				HELIUM_TRACE(
-					TraceLevels::Debug,
-					"ArchiveReaderBson::DeserializeInstance - Could not find field with CRC-32 %" PRIu32 ")\n",
-					fieldCrc);
+				DeserializeField( i, instance, field, object );
+			}
+
+			if ( !staged )
+			{
+				object->PostDeserialize( field );
+				Changed( object, field );
 			}
-				
 		}
 	}
 
-	object->PostDeserialize( NULL );
+	if ( !staged )
+	{
+		object->PostDeserialize( NULL );
+	}
 }
 
 void ArchiveReaderBson::DeserializeField( bson_iterator* i, void* instance, const Field* field, Object* object )
@@ -904,7 +1248,8 @@ void ArchiveReaderBson::DeserializeTranslator( bson_iterator* i, Pointer pointer
 				if ( scalar->m_Type == ScalarTypes::String )
 				{
 					String str ( bson_iterator_string( i ) );
-					scalar->Parse( str, pointer, this, m_Flags | ArchiveFlags::Notify ? true : false );
+					// DeserializeInstance notifies for the whole field (see Changed), for every type of value
+					scalar->Parse( str, pointer, this, false );
 				}
 			}
 			break;
@@ -916,6 +1261,7 @@ void ArchiveReaderBson::DeserializeTranslator( bson_iterator* i, Pointer pointer
 			{
 				SetTranslator* set = static_cast< SetTranslator* >( translator );
 				Translator* itemTranslator = set->GetItemTranslator();
+				ResetContainer( set, pointer );
 
 				bson_iterator elem[1];
 				bson_iterator_subiterator( i, elem );
@@ -931,6 +1277,7 @@ void ArchiveReaderBson::DeserializeTranslator( bson_iterator* i, Pointer pointer
 			{
 				SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
 				Translator* itemTranslator = sequence->GetItemTranslator();
+				sequence->SetLength( pointer, 0 );
 
 				bson_iterator elem[1];
 				bson_iterator_subiterator( i, elem );
@@ -960,6 +1307,7 @@ void ArchiveReaderBson::DeserializeTranslator( bson_iterator* i, Pointer pointer
 				AssociationTranslator* assocation = static_cast< AssociationTranslator* >( translator );
 				ScalarTranslator* keyTranslator = assocation->GetKeyTranslator();
 				Translator* valueTranslator = assocation->GetValueTranslator();
+				ResetContainer( assocation, pointer );
 
 				bson_iterator elem[1];
 				bson_iterator_subiterator( i, elem );
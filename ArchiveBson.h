@@ -125,16 +125,27 @@ namespace Helium
 			virtual ArchiveType GetType() const HELIUM_OVERRIDE;
 			virtual void Open() HELIUM_OVERRIDE;
 			virtual void Close() HELIUM_OVERRIDE; 
+			virtual void Reset( Stream* stream, Reflect::ObjectIdentifier* identifier = NULL ) HELIUM_OVERRIDE;
 
 		protected:
 			virtual void Write( const Reflect::ObjectPtr* objects, size_t count );
+			virtual void Begin() HELIUM_OVERRIDE;
+			virtual void WriteNext( size_t index ) HELIUM_OVERRIDE;
+			virtual void End() HELIUM_OVERRIDE;
+			virtual int64_t GetPosition() const HELIUM_OVERRIDE;
 
 		private:
-			void SerializeInstance( bson* b, const char* name, void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object );
-			void SerializeField( bson* b, void* instance, const Reflect::Field* field, Reflect::Object* object );
-			void SerializeTranslator( bson* b, const char* name, Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			void Discard();
+			void WriteObject( bson* b, size_t index );
+			static void WriteSlice( size_t index, void* userData );
+			void WriteSlices();
+			void SerializeInstance( bson* b, const char* name, void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object, void* baseline );
+			void SerializeField( bson* b, void* instance, const Reflect::Field* field, Reflect::Object* object, void* baseline );
+			void SerializeTranslator( bson* b, const char* name, Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object, void* baseline );
 
 			AutoPtr< Stream >     m_Stream;
+			bson                  m_Bson[1];  // of the serial write, built in memory between Begin and End
+			bool                  m_Building;
 		};
 
 		class HELIUM_PERSIST_API ArchiveReaderBson : public ArchiveReader
@@ -150,13 +161,24 @@ namespace Helium
 			virtual ArchiveType GetType() const HELIUM_OVERRIDE;
 			virtual void Open() HELIUM_OVERRIDE;
 			virtual void Close() HELIUM_OVERRIDE; 
+			virtual void Reset( Stream* stream, Reflect::ObjectResolver* resolver = NULL ) HELIUM_OVERRIDE;
 
 		protected:
 			virtual void Read( DynamicArray< Reflect::ObjectPtr >& objects ) HELIUM_OVERRIDE;
+			virtual void Begin() HELIUM_OVERRIDE;
+			virtual bool ReadObject( size_t index ) HELIUM_OVERRIDE;
+			virtual void End() HELIUM_OVERRIDE;
+			virtual int64_t GetPosition() const HELIUM_OVERRIDE;
+			virtual int64_t GetSize() const HELIUM_OVERRIDE;
 
 		private:
 			void Start();
+			void Receive( size_t end );
+			size_t ReceiveName( size_t offset );
+			void ReceiveElement( bson_iterator* i ); // make sure the element at i has arrived (when incremental)
 			bool ReadNext( Reflect::ObjectPtr &object, size_t index );
+			bool Allocate( bson_iterator* next, Reflect::ObjectPtr& object, size_t index, bson_iterator* body );
+			static void ReadParallelObject( size_t index, void* userData );
 			void DeserializeInstance( bson_iterator* i, void* instance, const Reflect::MetaStruct* composite, Reflect::Object* object );
 			void DeserializeField( bson_iterator* i, void* instance, const Reflect::Field* field, Reflect::Object* object );
 			void DeserializeTranslator( bson_iterator* i, Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
@@ -166,6 +188,17 @@ namespace Helium
 			int64_t                 m_Size;
 			bson                    m_Bson[1];
 			bson_iterator           m_Next[1];
+			bool                    m_Array;       // the document has the objects array that m_Next walks
+			bool                    m_Incremental; // constructing objects as the stream delivers them
+			size_t                  m_Received;    // bytes of m_Buffer read so far
+
+			// of the top-level objects being read in parallel
+			struct Body
+			{
+				bson_iterator m_Iterator[1];
+				bool          m_Valid;
+			};
+			DynamicArray< Body >    m_Bodies;
 		};
 	}
 }
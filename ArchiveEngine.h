@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Reflect/MetaStruct.h"
+#include "Reflect/Object.h"
+#include "Reflect/Translator.h"
+
+#include "Persist/Archive.h"
+
+#include <complex>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		//
+		// Engine: the object, field and value traversal every writer shares, compiled against a format policy
+		//  so each value is emitted by an inline call into the policy instead of through the archive
+		//
+		// a policy is a class (usually local to the format's translation unit) with:
+		//
+		//  static const bool InlineObjects;         // objects that aren't identified are written in place, not by identity
+		//  void BeginMap( uint32_t length );        // of a structure's fields, an association's items, or an inline object (1)
+		//  void EndMap();
+		//  void BeginArray( uint32_t length );      // of a fixed size field, a sequence or a set
+		//  void EndArray();
+		//  void Key( const Reflect::Field* field ); // before each field's value
+		//  void Key( const char* className );       // before an inline object's fields
+		//  void Null();                             // null pointers, when objects are inline
+		//  void Write( T value );                   // for bool, every integer and float type, their complex types, and String
+		//
+
+		template< class Policy >
+		class SerializeEngine
+		{
+		public:
+			SerializeEngine( ArchiveWriter& archive, Policy& policy );
+
+			void SerializeInstance( void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object, void* baseline );
+			void SerializeField( void* instance, const Reflect::Field* field, Reflect::Object* object, void* baseline );
+			void SerializeTranslator( Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object, void* baseline );
+
+		private:
+			inline void SerializeScalar( Reflect::Pointer pointer, Reflect::ScalarTranslator* scalar );
+
+			// the items of a sequence or set, in a loop picked once for the item translator (scalars and structures
+			//  get their own, with nothing tested per item), anything else goes through SerializeTranslator item by item
+			void SerializeItems( const DynamicArray< Reflect::Pointer >& items, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			template< class T >
+			void SerializeScalars( const DynamicArray< Reflect::Pointer >& items );
+			void SerializeStrings( const DynamicArray< Reflect::Pointer >& items, Reflect::ScalarTranslator* scalar );
+
+			// a single key or value of an association, picked once per association
+			typedef void (SerializeEngine::*ItemFunction)( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			ItemFunction SelectItem( Reflect::Translator* translator );
+			template< class T >
+			void SerializeScalarItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			void SerializeStringItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			void SerializeStructureItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			void SerializeAnyItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+
+			// the scalar translator of values written as plain scalars, or NULL
+			static Reflect::ScalarTranslator* GetScalar( Reflect::Translator* translator );
+
+			ArchiveWriter& m_Archive;
+			Policy&        m_Policy;
+		};
+	}
+}
+
+#include "Persist/ArchiveEngine.inl"
@@ -0,0 +1,461 @@
+template< class Policy >
+Helium::Persist::SerializeEngine< Policy >::SerializeEngine( ArchiveWriter& archive, Policy& policy )
+	: m_Archive( archive )
+	, m_Policy( policy )
+{
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeInstance( void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object, void* baseline )
+{
+#if PERSIST_ARCHIVE_VERBOSE
+	Log::Print( TXT( "Serializing %s\n" ), structure->m_Name );
+#endif
+
+	// TODO: Declare a max depth for inheritance to save heap allocs -geoff
+	DynamicArray< const Reflect::MetaStruct* > bases;
+	for ( const Reflect::MetaStruct* current = structure; current != NULL; current = current->m_Base )
+	{
+		bases.Push( current );
+	}
+
+	// TODO: Declare a max count for fields to save heap allocs -geoff
+	DynamicArray< const Reflect::Field* > fields;
+	while ( !bases.IsEmpty() )
+	{
+		const Reflect::MetaStruct* current = bases.Pop();
+		DynamicArray< Reflect::Field >::ConstIterator itr = current->m_Fields.Begin();
+		DynamicArray< Reflect::Field >::ConstIterator end = current->m_Fields.End();
+		for ( ; itr != end; ++itr )
+		{
+			const Reflect::Field* field = &*itr;
+			if ( m_Archive.ShouldSerialize( field, instance, object, baseline ) )
+			{
+				fields.Push( field );
+			}
+		}
+	}
+
+	m_Archive.ProfileEnter( structure );
+	m_Policy.BeginMap( static_cast< uint32_t >( fields.GetSize() ) );
+	object->PreSerialize( NULL );
+
+	DynamicArray< const Reflect::Field* >::ConstIterator itr = fields.Begin();
+	DynamicArray< const Reflect::Field* >::ConstIterator end = fields.End();
+	for ( ; itr != end; ++itr )
+	{
+		const Reflect::Field* field = *itr;
+		object->PreSerialize( field );
+		m_Archive.ProfileEnter( field );
+		SerializeField( instance, field, object, baseline );
+		m_Archive.ProfileLeave();
+		object->PostSerialize( field );
+	}
+
+	object->PostSerialize( NULL );
+	m_Policy.EndMap();
+	m_Archive.ProfileLeave();
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeField( void* instance, const Reflect::Field* field, Reflect::Object* object, void* baseline )
+{
+#if PERSIST_ARCHIVE_VERBOSE
+	Log::Print(TXT("Serializing field %s\n"), field->m_Name);
+#endif
+
+	m_Policy.Key( field );
+
+	if ( field->m_Count > 1 )
+	{
+		m_Policy.BeginArray( field->m_Count );
+
+		for ( uint32_t i=0; i<field->m_Count; ++i )
+		{
+			void* elementBaseline = baseline ? Reflect::Pointer ( field, baseline, NULL, i ).m_Address : NULL;
+			SerializeTranslator( Reflect::Pointer ( field, instance, object, i ), field->m_Translator, field, object, elementBaseline );
+		}
+
+		m_Policy.EndArray();
+	}
+	else
+	{
+		void* fieldBaseline = baseline ? Reflect::Pointer ( field, baseline, NULL ).m_Address : NULL;
+		SerializeTranslator( Reflect::Pointer ( field, instance, object ), field->m_Translator, field, object, fieldBaseline );
+	}
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeTranslator( Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object, void* baseline )
+{
+	switch ( translator->GetMetaId() )
+	{
+	case Reflect::MetaIds::PointerTranslator:
+		{
+			// a constant of the policy, so formats without inline objects compile this away
+			if ( Policy::InlineObjects )
+			{
+				const Reflect::ObjectPtr& pointed ( pointer.As< Reflect::ObjectPtr >() );
+				if ( !pointed )
+				{
+					m_Policy.Null();
+					break;
+				}
+
+				if ( !m_Archive.Identify( pointed, NULL ) )
+				{
+					m_Policy.BeginMap( 1 );
+					m_Policy.Key( pointed->GetMetaClass()->m_Name );
+					SerializeInstance( pointed, pointed->GetMetaClass(), pointed, m_Archive.GetBaseline( pointed, baseline ) );
+					m_Policy.EndMap();
+					break;
+				}
+			}
+
+			// written by identity, like any other scalar
+			SerializeScalar( pointer, static_cast< Reflect::ScalarTranslator* >( translator ) );
+			break;
+		}
+
+	case Reflect::MetaIds::ScalarTranslator:
+	case Reflect::MetaIds::SimpleTranslator:
+	case Reflect::MetaIds::EnumerationTranslator:
+	case Reflect::MetaIds::TypeTranslator:
+		{
+			SerializeScalar( pointer, static_cast< Reflect::ScalarTranslator* >( translator ) );
+			break;
+		}
+
+	case Reflect::MetaIds::StructureTranslator:
+		{
+			Reflect::StructureTranslator* structure = static_cast< Reflect::StructureTranslator* >( translator );
+			SerializeInstance( pointer.m_Address, structure->GetMetaStruct(), object, baseline );
+			break;
+		}
+
+	case Reflect::MetaIds::SetTranslator:
+		{
+			Reflect::SetTranslator* set = static_cast< Reflect::SetTranslator* >( translator );
+
+			Reflect::Translator* itemTranslator = set->GetItemTranslator();
+			DynamicArray< Reflect::Pointer > items;
+			set->GetItems( pointer, items );
+
+			m_Policy.BeginArray( static_cast< uint32_t >( items.GetSize() ) );
+			SerializeItems( items, itemTranslator, field, object );
+			m_Policy.EndArray();
+			break;
+		}
+
+	case Reflect::MetaIds::SequenceTranslator:
+		{
+			Reflect::SequenceTranslator* sequence = static_cast< Reflect::SequenceTranslator* >( translator );
+
+			Reflect::Translator* itemTranslator = sequence->GetItemTranslator();
+			DynamicArray< Reflect::Pointer > items;
+			sequence->GetItems( pointer, items );
+
+			m_Policy.BeginArray( static_cast< uint32_t >( items.GetSize() ) );
+			SerializeItems( items, itemTranslator, field, object );
+			m_Policy.EndArray();
+			break;
+		}
+
+	case Reflect::MetaIds::AssociationTranslator:
+		{
+			Reflect::AssociationTranslator* association = static_cast< Reflect::AssociationTranslator* >( translator );
+
+			Reflect::Translator* keyTranslator = association->GetKeyTranslator();
+			Reflect::Translator* valueTranslator = association->GetValueTranslator();
+			DynamicArray< Reflect::Pointer > keys, values;
+			association->GetItems( pointer, keys, values );
+
+			ItemFunction keyFunction = SelectItem( keyTranslator );
+			ItemFunction valueFunction = SelectItem( valueTranslator );
+
+			m_Policy.BeginMap( static_cast< uint32_t >( keys.GetSize() ) );
+
+			for ( DynamicArray< Reflect::Pointer >::Iterator keyItr = keys.Begin(), valueItr = values.Begin(), keyEnd = keys.End(), valueEnd = values.End();
+				keyItr != keyEnd && valueItr != valueEnd;
+				++keyItr, ++valueItr )
+			{
+				(this->*keyFunction)( *keyItr, keyTranslator, field, object );
+				(this->*valueFunction)( *valueItr, valueTranslator, field, object );
+			}
+
+			m_Policy.EndMap();
+			break;
+		}
+
+	default:
+		// Unhandled reflection type in SerializeEngine::SerializeTranslator
+		HELIUM_BREAK();
+	}
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeScalar( Reflect::Pointer pointer, Reflect::ScalarTranslator* scalar )
+{
+	switch ( scalar->m_Type )
+	{
+	case Reflect::ScalarTypes::Boolean:
+		m_Policy.Write( pointer.As<bool>() );
+		break;
+
+	case Reflect::ScalarTypes::Unsigned8:
+		m_Policy.Write( pointer.As<uint8_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Unsigned16:
+		m_Policy.Write( pointer.As<uint16_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Unsigned32:
+		m_Policy.Write( pointer.As<uint32_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Unsigned64:
+		m_Policy.Write( pointer.As<uint64_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Signed8:
+		m_Policy.Write( pointer.As<int8_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Signed16:
+		m_Policy.Write( pointer.As<int16_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Signed32:
+		m_Policy.Write( pointer.As<int32_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Signed64:
+		m_Policy.Write( pointer.As<int64_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Float32:
+		m_Policy.Write( pointer.As<float32_t>() );
+		break;
+
+	case Reflect::ScalarTypes::Float64:
+		m_Policy.Write( pointer.As<float64_t>() );
+		break;
+
+	case Reflect::ScalarTypes::ComplexFloat32:
+		m_Policy.Write( pointer.As< std::complex<float32_t> >() );
+		break;
+
+	case Reflect::ScalarTypes::ComplexFloat64:
+		m_Policy.Write( pointer.As< std::complex<float64_t> >() );
+		break;
+
+	case Reflect::ScalarTypes::String:
+		{
+			String str;
+			scalar->Print( pointer, str, &m_Archive );
+			m_Policy.Write( str );
+			break;
+		}
+	}
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeItems( const DynamicArray< Reflect::Pointer >& items, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object )
+{
+	Reflect::ScalarTranslator* scalar = GetScalar( translator );
+	if ( scalar )
+	{
+		switch ( scalar->m_Type )
+		{
+		case Reflect::ScalarTypes::Boolean:
+			SerializeScalars< bool >( items );
+			return;
+
+		case Reflect::ScalarTypes::Unsigned8:
+			SerializeScalars< uint8_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Unsigned16:
+			SerializeScalars< uint16_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Unsigned32:
+			SerializeScalars< uint32_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Unsigned64:
+			SerializeScalars< uint64_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Signed8:
+			SerializeScalars< int8_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Signed16:
+			SerializeScalars< int16_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Signed32:
+			SerializeScalars< int32_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Signed64:
+			SerializeScalars< int64_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Float32:
+			SerializeScalars< float32_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::Float64:
+			SerializeScalars< float64_t >( items );
+			return;
+
+		case Reflect::ScalarTypes::String:
+			SerializeStrings( items, scalar );
+			return;
+
+		default:
+			break;
+		}
+	}
+	else if ( translator->GetMetaId() == Reflect::MetaIds::StructureTranslator )
+	{
+		const Reflect::MetaStruct* structure = static_cast< Reflect::StructureTranslator* >( translator )->GetMetaStruct();
+		for ( DynamicArray< Reflect::Pointer >::ConstIterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+		{
+			SerializeInstance( itr->m_Address, structure, object, NULL );
+		}
+		return;
+	}
+
+	for ( DynamicArray< Reflect::Pointer >::ConstIterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+	{
+		SerializeTranslator( *itr, translator, field, object, NULL );
+	}
+}
+
+template< class Policy >
+template< class T >
+void Helium::Persist::SerializeEngine< Policy >::SerializeScalars( const DynamicArray< Reflect::Pointer >& items )
+{
+	for ( DynamicArray< Reflect::Pointer >::ConstIterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+	{
+		m_Policy.Write( itr->As< T >() );
+	}
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeStrings( const DynamicArray< Reflect::Pointer >& items, Reflect::ScalarTranslator* scalar )
+{
+	for ( DynamicArray< Reflect::Pointer >::ConstIterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+	{
+		String str;
+		scalar->Print( *itr, str, &m_Archive );
+		m_Policy.Write( str );
+	}
+}
+
+template< class Policy >
+typename Helium::Persist::SerializeEngine< Policy >::ItemFunction Helium::Persist::SerializeEngine< Policy >::SelectItem( Reflect::Translator* translator )
+{
+	Reflect::ScalarTranslator* scalar = GetScalar( translator );
+	if ( scalar )
+	{
+		switch ( scalar->m_Type )
+		{
+		case Reflect::ScalarTypes::Boolean:
+			return &SerializeEngine::SerializeScalarItem< bool >;
+
+		case Reflect::ScalarTypes::Unsigned8:
+			return &SerializeEngine::SerializeScalarItem< uint8_t >;
+
+		case Reflect::ScalarTypes::Unsigned16:
+			return &SerializeEngine::SerializeScalarItem< uint16_t >;
+
+		case Reflect::ScalarTypes::Unsigned32:
+			return &SerializeEngine::SerializeScalarItem< uint32_t >;
+
+		case Reflect::ScalarTypes::Unsigned64:
+			return &SerializeEngine::SerializeScalarItem< uint64_t >;
+
+		case Reflect::ScalarTypes::Signed8:
+			return &SerializeEngine::SerializeScalarItem< int8_t >;
+
+		case Reflect::ScalarTypes::Signed16:
+			return &SerializeEngine::SerializeScalarItem< int16_t >;
+
+		case Reflect::ScalarTypes::Signed32:
+			return &SerializeEngine::SerializeScalarItem< int32_t >;
+
+		case Reflect::ScalarTypes::Signed64:
+			return &SerializeEngine::SerializeScalarItem< int64_t >;
+
+		case Reflect::ScalarTypes::Float32:
+			return &SerializeEngine::SerializeScalarItem< float32_t >;
+
+		case Reflect::ScalarTypes::Float64:
+			return &SerializeEngine::SerializeScalarItem< float64_t >;
+
+		case Reflect::ScalarTypes::String:
+			return &SerializeEngine::SerializeStringItem;
+
+		default:
+			break;
+		}
+	}
+	else if ( translator->GetMetaId() == Reflect::MetaIds::StructureTranslator )
+	{
+		return &SerializeEngine::SerializeStructureItem;
+	}
+
+	return &SerializeEngine::SerializeAnyItem;
+}
+
+template< class Policy >
+template< class T >
+void Helium::Persist::SerializeEngine< Policy >::SerializeScalarItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object )
+{
+	m_Policy.Write( item.As< T >() );
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeStringItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object )
+{
+	String str;
+	static_cast< Reflect::ScalarTranslator* >( translator )->Print( item, str, &m_Archive );
+	m_Policy.Write( str );
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeStructureItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object )
+{
+	SerializeInstance( item.m_Address, static_cast< Reflect::StructureTranslator* >( translator )->GetMetaStruct(), object, NULL );
+}
+
+template< class Policy >
+void Helium::Persist::SerializeEngine< Policy >::SerializeAnyItem( Reflect::Pointer item, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object )
+{
+	SerializeTranslator( item, translator, field, object, NULL );
+}
+
+template< class Policy >
+Helium::Reflect::ScalarTranslator* Helium::Persist::SerializeEngine< Policy >::GetScalar( Reflect::Translator* translator )
+{
+	switch ( translator->GetMetaId() )
+	{
+	case Reflect::MetaIds::PointerTranslator:
+		// inline objects depend on the object pointed at, not just its type
+		return Policy::InlineObjects ? NULL : static_cast< Reflect::ScalarTranslator* >( translator );
+
+	case Reflect::MetaIds::ScalarTranslator:
+	case Reflect::MetaIds::SimpleTranslator:
+	case Reflect::MetaIds::EnumerationTranslator:
+	case Reflect::MetaIds::TypeTranslator:
+		return static_cast< Reflect::ScalarTranslator* >( translator );
+
+	default:
+		return NULL;
+	}
+}
@@ -0,0 +1,345 @@
+#include "PersistPch.h"
+#include "Persist/ArchiveJournal.h"
+
+#include "Platform/Utility.h"
+
+#include "Foundation/Crc32.h"
+#include "Foundation/Log.h"
+
+#include "Reflect/Object.h"
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+static const uint32_t JournalMagic = 0x524a5048; // 'HPJR'
+static const uint32_t JournalHeaderSize = 16; // magic, id, class crc, size
+
+template< class T >
+static void AppendValue( DynamicArray< uint8_t >& buffer, const T& value )
+{
+	buffer.AddArray( reinterpret_cast< const uint8_t* >( &value ), sizeof( T ) );
+}
+
+static void BuildRecord( DynamicArray< uint8_t >& buffer, uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size )
+{
+	buffer.Resize( 0 );
+	buffer.Reserve( JournalHeaderSize + size + sizeof( uint32_t ) );
+	AppendValue( buffer, JournalMagic );
+	AppendValue( buffer, id );
+	AppendValue( buffer, classCrc );
+	AppendValue( buffer, static_cast< uint32_t >( size ) );
+	buffer.AddArray( data, size );
+
+	// the checksum covers the header too, so a torn or garbled id can't be replayed
+	AppendValue( buffer, Helium::Crc32( buffer.GetData(), buffer.GetSize() ) );
+}
+
+ArchiveJournal::CheckpointThread::CheckpointThread( ArchiveJournal& journal )
+	: m_Journal( journal )
+{
+}
+
+void ArchiveJournal::CheckpointThread::Run()
+{
+	while ( !m_Journal.m_Stop )
+	{
+		m_Journal.m_Wake.Wait( m_Journal.m_Interval );
+
+		try
+		{
+			m_Journal.Checkpoint();
+		}
+		catch ( Helium::Exception& ex )
+		{
+			// the records are still journaled (and pending), the next checkpoint retries them
+			Log::Error( TXT( "While checkpointing '%s': %s\n" ), m_Journal.m_Path.c_str(), ex.Get().c_str() );
+		}
+	}
+}
+
+ArchiveJournal::ArchiveJournal( ArchiveStore& store )
+	: m_Store( store )
+	, m_Path( store.GetPath().Get() + ".journal" )
+	, m_RewritePath( store.GetPath().Get() + ".journal.tmp" )
+	, m_Size( 0 )
+	, m_Threshold( 1 << 20 )
+	, m_Interval( 1000 )
+	, m_Wake( false, false )
+	, m_Stop( true )
+	, m_Thread( *this )
+{
+}
+
+ArchiveJournal::~ArchiveJournal()
+{
+	Close();
+}
+
+void ArchiveJournal::Open( uint32_t checkpointIntervalMilliseconds )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", m_Path.c_str() );
+	HELIUM_ASSERT( m_Stop );
+
+	m_Store.Load();
+
+	// the rewritten journal only ever holds records that are also in (or newer than) the journal it replaces
+	RecordMap records;
+	Replay( m_Path, records );
+	Replay( m_RewritePath, records );
+
+	if ( !records.empty() )
+	{
+		// allocate everything first so replayed records can reference each other regardless of their order
+		for ( RecordMap::const_iterator itr = records.begin(), end = records.end(); itr != end; ++itr )
+		{
+			m_Store.Reserve( itr->first, itr->second.m_ClassCrc );
+		}
+
+		for ( RecordMap::const_iterator itr = records.begin(), end = records.end(); itr != end; ++itr )
+		{
+			m_Store.Apply( itr->first, itr->second.m_ClassCrc, itr->second.m_Data.GetData(), itr->second.m_Data.GetSize() );
+		}
+
+		m_Store.Flush();
+	}
+
+	if ( m_RewritePath.Exists() )
+	{
+		m_RewritePath.Delete();
+	}
+
+	if ( !m_Stream.Open( m_Path, FileStream::MODE_WRITE ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open journal '%s' for writing" ), m_Path.c_str() );
+	}
+
+	m_Size = 0;
+	m_Interval = checkpointIntervalMilliseconds;
+	m_Stop = false;
+	m_Thread.Start( TXT( "ArchiveJournal" ) );
+}
+
+void ArchiveJournal::Close()
+{
+	if ( m_Stop )
+	{
+		return;
+	}
+
+	m_Stop = true;
+	m_Wake.Signal();
+	m_Thread.Join();
+
+	// a failure here leaves the journal for the next Open to replay
+	try
+	{
+		Checkpoint();
+	}
+	catch ( Helium::Exception& ex )
+	{
+		Log::Error( TXT( "While checkpointing '%s': %s\n" ), m_Path.c_str(), ex.Get().c_str() );
+	}
+
+	m_Stream.Close();
+}
+
+uint32_t ArchiveJournal::Record( const ObjectPtr& object )
+{
+	HELIUM_ASSERT( !m_Stop );
+
+	// encoding identifies references through the store's ids, and appending under the same lock
+	//  keeps two records of one object from being journaled in the opposite order they were encoded
+	MutexScopeLock lock ( m_StoreLock );
+	uint32_t id = m_Store.Add( object );
+
+	DynamicArray< uint8_t > data;
+	m_Store.Encode( object, data );
+	Append( id, Crc32( object->GetMetaClass()->m_Name ), data.GetData(), data.GetSize() );
+	return id;
+}
+
+void ArchiveJournal::Remove( const ObjectPtr& object )
+{
+	HELIUM_ASSERT( !m_Stop );
+
+	MutexScopeLock lock ( m_StoreLock );
+	uint32_t id = m_Store.GetId( object );
+	if ( id == Invalid< uint32_t >() )
+	{
+		return;
+	}
+
+	m_Store.Remove( object );
+	Append( id, 0, NULL, 0 );
+}
+
+void ArchiveJournal::Checkpoint()
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", m_Path.c_str() );
+
+	RecordMap records;
+	{
+		MutexScopeLock lock ( m_Lock );
+		records.swap( m_Pending );
+	}
+
+	if ( records.empty() )
+	{
+		return;
+	}
+
+	try
+	{
+		MutexScopeLock lock ( m_StoreLock );
+		for ( RecordMap::const_iterator itr = records.begin(), end = records.end(); itr != end; ++itr )
+		{
+			m_Store.Stage( itr->first, itr->second.m_ClassCrc, itr->second.m_Data.GetData(), itr->second.m_Data.GetSize() );
+		}
+
+		m_Store.Flush();
+	}
+	catch ( ... )
+	{
+		// put them back unless a newer record for the same id arrived meanwhile
+		MutexScopeLock lock ( m_Lock );
+		m_Pending.insert( records.begin(), records.end() );
+		throw;
+	}
+
+	MutexScopeLock lock ( m_Lock );
+	Rewrite();
+}
+
+void ArchiveJournal::SetCheckpointThreshold( uint64_t bytes )
+{
+	m_Threshold = bytes;
+}
+
+void ArchiveJournal::Append( uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size )
+{
+	DynamicArray< uint8_t > buffer;
+	BuildRecord( buffer, id, classCrc, data, size );
+
+	MutexScopeLock lock ( m_Lock );
+
+	m_Stream.Write( buffer.GetData(), buffer.GetSize(), 1 );
+	m_Stream.Flush();
+	m_Size += buffer.GetSize();
+
+	JournalRecord& pending = m_Pending[ id ];
+	pending.m_ClassCrc = classCrc;
+	pending.m_Data.Resize( 0 );
+	pending.m_Data.AddArray( data, size );
+
+	if ( m_Size >= m_Threshold )
+	{
+		m_Wake.Signal();
+	}
+}
+
+void ArchiveJournal::Replay( const FilePath& path, RecordMap& records )
+{
+	if ( !path.Exists() )
+	{
+		return;
+	}
+
+	FileStream stream;
+	if ( !stream.Open( path, FileStream::MODE_READ ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open journal '%s'" ), path.c_str() );
+	}
+
+	stream.Seek( 0, SeekOrigins::End );
+	uint64_t length = stream.Tell();
+	stream.Seek( 0, SeekOrigins::Begin );
+
+	uint64_t offset = 0;
+	uint32_t count = 0;
+	DynamicArray< uint8_t > buffer;
+	while ( offset + JournalHeaderSize + sizeof( uint32_t ) <= length )
+	{
+		uint32_t header[ 4 ];
+		if ( stream.Read( header, sizeof( header ), 1 ) != 1 || header[ 0 ] != JournalMagic )
+		{
+			break;
+		}
+
+		uint32_t size = header[ 3 ];
+		if ( offset + JournalHeaderSize + size + sizeof( uint32_t ) > length )
+		{
+			break;
+		}
+
+		buffer.Resize( JournalHeaderSize + size + sizeof( uint32_t ) );
+		MemoryCopy( buffer.GetData(), header, sizeof( header ) );
+		if ( stream.Read( buffer.GetData() + JournalHeaderSize, size + sizeof( uint32_t ), 1 ) != 1 )
+		{
+			break;
+		}
+
+		uint32_t checksum = 0;
+		MemoryCopy( &checksum, buffer.GetData() + JournalHeaderSize + size, sizeof( checksum ) );
+		if ( checksum != Helium::Crc32( buffer.GetData(), JournalHeaderSize + size ) )
+		{
+			break;
+		}
+
+		// later records for the same id supersede earlier ones
+		JournalRecord& record = records[ header[ 1 ] ];
+		record.m_ClassCrc = header[ 2 ];
+		record.m_Data.Resize( 0 );
+		record.m_Data.AddArray( buffer.GetData() + JournalHeaderSize, size );
+
+		offset += buffer.GetSize();
+		++count;
+	}
+
+	// everything past a torn or corrupt record was never acknowledged as durable
+	if ( offset < length )
+	{
+		HELIUM_TRACE(
+			TraceLevels::Warning,
+			"ArchiveJournal::Replay - Discarding %" PRIu64 " bytes after record %" PRIu32 " of '%s'\n",
+			length - offset,
+			count,
+			path.c_str());
+	}
+
+	stream.Close();
+}
+
+void ArchiveJournal::Rewrite()
+{
+	FileStream stream;
+	if ( !stream.Open( m_RewritePath, FileStream::MODE_WRITE ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open '%s' for writing" ), m_RewritePath.c_str() );
+	}
+
+	// only records that arrived during the checkpoint remain
+	uint64_t size = 0;
+	DynamicArray< uint8_t > buffer;
+	for ( RecordMap::const_iterator itr = m_Pending.begin(), end = m_Pending.end(); itr != end; ++itr )
+	{
+		BuildRecord( buffer, itr->first, itr->second.m_ClassCrc, itr->second.m_Data.GetData(), itr->second.m_Data.GetSize() );
+		stream.Write( buffer.GetData(), buffer.GetSize(), 1 );
+		size += buffer.GetSize();
+	}
+
+	stream.Flush();
+	stream.Close();
+
+	m_Stream.Close();
+	m_Path.Delete();
+	m_RewritePath.Move( m_Path );
+
+	if ( !m_Stream.Open( m_Path, FileStream::MODE_WRITE, false ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open journal '%s' for writing" ), m_Path.c_str() );
+	}
+
+	m_Stream.Seek( 0, SeekOrigins::End );
+	m_Size = size;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Platform/Condition.h"
+#include "Platform/Locks.h"
+#include "Platform/Thread.h"
+
+#include "Foundation/FileStream.h"
+
+#include "Persist/ArchiveStore.h"
+
+namespace Helium
+{
+	namespace Persist
+	{
+		//
+		// Journal: checksummed object records appended to a log next to an archive store,
+		//  replayed when opened and checkpointed into the store by a background thread
+		//
+
+		class HELIUM_PERSIST_API ArchiveJournal
+		{
+		public:
+			ArchiveJournal( ArchiveStore& store );
+			~ArchiveJournal();
+
+			inline ArchiveStore&   GetStore() const;
+			inline const FilePath& GetPath() const;
+
+			// load the store, replay and checkpoint what a previous session left in the journal, then start journaling
+			void     Open( uint32_t checkpointIntervalMilliseconds = 1000 );
+			void     Close();
+
+			// append the current state of a top-level object, adding it to the store as needed
+			uint32_t Record( const Reflect::ObjectPtr& object );
+			void     Remove( const Reflect::ObjectPtr& object );
+
+			// move the journaled records into the store and trim the journal down to what arrived meanwhile
+			void     Checkpoint();
+			void     SetCheckpointThreshold( uint64_t bytes );
+
+		private:
+			class CheckpointThread : public Thread
+			{
+			public:
+				CheckpointThread( ArchiveJournal& journal );
+				virtual void Run() HELIUM_OVERRIDE;
+
+			private:
+				ArchiveJournal& m_Journal;
+			};
+
+			struct JournalRecord
+			{
+				uint32_t                m_ClassCrc;
+				DynamicArray< uint8_t > m_Data;
+			};
+
+			typedef std::map< uint32_t, JournalRecord > RecordMap;
+
+			void     Append( uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size );
+			void     Replay( const FilePath& path, RecordMap& records );
+			void     Rewrite();
+
+			ArchiveStore&    m_Store;
+			FilePath         m_Path;
+			FilePath         m_RewritePath;
+			FileStream       m_Stream;
+			uint64_t         m_Size;            // bytes in the journal file
+			uint64_t         m_Threshold;       // journal size that triggers an early checkpoint
+			uint32_t         m_Interval;
+			RecordMap        m_Pending;         // latest record per id not yet checkpointed
+			Mutex            m_Lock;            // guards the journal file and pending records
+			Mutex            m_StoreLock;       // guards the store, taken before m_Lock so records are appended in the order they change it
+			Condition        m_Wake;
+			volatile bool    m_Stop;
+			CheckpointThread m_Thread;
+		};
+	}
+}
+
+#include "Persist/ArchiveJournal.inl"
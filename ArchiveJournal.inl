@@ -0,0 +1,9 @@
+Helium::Persist::ArchiveStore& Helium::Persist::ArchiveJournal::GetStore() const
+{
+	return m_Store;
+}
+
+const Helium::FilePath& Helium::Persist::ArchiveJournal::GetPath() const
+{
+	return m_Path;
+}
@@ -1,8 +1,10 @@
 #include "PersistPch.h"
 #include "Persist/ArchiveJson.h"
+#include "Persist/ArchiveEngine.h"
 
 #include "Foundation/Endian.h"
 #include "Foundation/FileStream.h"
+#include "Foundation/MemoryStream.h"
 #include "Foundation/Numeric.h"
 
 #include "Reflect/Object.h"
@@ -14,6 +16,89 @@ using namespace Helium;
 using namespace Helium::Reflect;
 using namespace Helium::Persist;
 
+// json for the serialize engine, objects are written in place unless they are identified
+class JsonPolicy
+{
+public:
+	static const bool InlineObjects = true;
+
+	JsonPolicy( RapidJsonWriter& writer )
+		: m_Writer( writer )
+	{
+	}
+
+	void BeginMap( uint32_t length )
+	{
+		m_Writer.StartObject();
+	}
+
+	void EndMap()
+	{
+		m_Writer.EndObject();
+	}
+
+	void BeginArray( uint32_t length )
+	{
+		m_Writer.StartArray();
+	}
+
+	void EndArray()
+	{
+		m_Writer.EndArray();
+	}
+
+	void Key( const Field* field )
+	{
+		m_Writer.String( field->m_Name );
+	}
+
+	void Key( const char* className )
+	{
+		m_Writer.String( className );
+	}
+
+	void Null()
+	{
+		// null pointers are written as zero
+		m_Writer.Uint( 0 );
+	}
+
+	void Write( bool value )      { m_Writer.Bool( value ); }
+	void Write( uint8_t value )   { m_Writer.Uint( value ); }
+	void Write( uint16_t value )  { m_Writer.Uint( value ); }
+	void Write( uint32_t value )  { m_Writer.Uint( value ); }
+	void Write( uint64_t value )  { m_Writer.Uint64( value ); }
+	void Write( int8_t value )    { m_Writer.Int( value ); }
+	void Write( int16_t value )   { m_Writer.Int( value ); }
+	void Write( int32_t value )   { m_Writer.Int( value ); }
+	void Write( int64_t value )   { m_Writer.Int64( value ); }
+	void Write( float32_t value ) { m_Writer.Double( value ); }
+	void Write( float64_t value ) { m_Writer.Double( value ); }
+
+	// HEN1 : TODO !! written as text until there is a reader for it
+	void Write( const std::complex< float32_t >& value )
+	{
+		char buff[256]={'\0'};
+		sprintf(buff, "%.9g + %.9g*I", (double)value.real(), (double)value.imag());
+		m_Writer.String( buff );
+	}
+
+	void Write( const std::complex< float64_t >& value )
+	{
+		char buff[256]={'\0'};
+		sprintf(buff, "%.9g + %.9g*I", (double)value.real(), (double)value.imag());
+		m_Writer.String( buff );
+	}
+
+	void Write( const String& value )
+	{
+		m_Writer.String( value.GetData() );
+	}
+
+private:
+	RapidJsonWriter& m_Writer;
+};
+
 void ArchiveWriterJson::WriteToStream( const ObjectPtr& object, Stream& stream, ObjectIdentifier* identifier, uint32_t flags )
 {
 	ArchiveWriterJson archive ( &stream, identifier, flags );
@@ -31,7 +116,7 @@ void ArchiveWriterJson::WriteToStream( const ObjectPtr* objects, size_t count, S
 void ArchiveWriterJson::WriteToJson( const ObjectPtr& object, RapidJsonWriter& writer, const char* name, Reflect::ObjectIdentifier* identifier, uint32_t flags )
 {
 	ArchiveWriterJson archive ( NULL, identifier, flags );
-	archive.SerializeInstance( writer, object, object->GetMetaClass(), object );
+	archive.SerializeInstance( writer, object, object->GetMetaClass(), object, NULL );
 }
 
 ArchiveWriterJson::ArchiveWriterJson( const FilePath& path, ObjectIdentifier* identifier, uint32_t flags )
@@ -58,8 +143,7 @@ void ArchiveWriterJson::Open()
 	Log::Print(TXT("Opening file '%s'\n"), m_Path.c_str());
 #endif
 
-	FileStream* stream = new FileStream();
-	stream->Open( m_Path, FileStream::MODE_WRITE );
+	Stream* stream = OpenStream();
 	m_Stream.Reset( stream );
 	m_Output.SetStream( stream );
 }
@@ -71,6 +155,16 @@ void ArchiveWriterJson::Close()
 	m_Output.SetStream( NULL );
 }
 
+void ArchiveWriterJson::Reset( Stream* stream, ObjectIdentifier* identifier )
+{
+	ArchiveWriter::Reset( stream, identifier );
+
+	m_Writer.Reset( NULL );
+	m_Stream.Reset( stream );
+	m_Stream.Orphan( true );
+	m_Output.SetStream( stream );
+}
+
 void ArchiveWriterJson::Write( const ObjectPtr* objects, size_t count )
 {
 	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Json Write" );
@@ -79,316 +173,136 @@ void ArchiveWriterJson::Write( const ObjectPtr* objects, size_t count )
 	ArchiveStatus info( *this, ArchiveStates::Starting );
 	e_Status.Raise( info );
 
+	if ( m_Flags & ArchiveFlags::Dedupe )
+	{
+		Deduplicate( objects, count );
+	}
+
 	// the master object
 	m_Objects.AddArray( objects, count );
 
-	RapidJsonWriter writer ( m_Output );
-	writer.SetIndent('\t', 1);
+	if ( ( m_Flags & ArchiveFlags::ParallelWrite ) && !m_Objects.IsEmpty() && !m_Profile )
+	{
+		WriteParallel( &ArchiveWriterJson::WriteSlice );
 
-	// begin top level array of objects
-	writer.StartArray();
+		// each slice is "[" + its objects + "\n]", exactly what the serial writer puts between the commas
+		m_Stream->Write( "[", 1, 1 );
+		for ( DynamicArray< Slice >::ConstIterator itr = m_Slices.Begin(), end = m_Slices.End(); itr != end; ++itr )
+		{
+			HELIUM_ASSERT( itr->m_Buffer.GetSize() > 3 );
+			if ( itr != m_Slices.Begin() )
+			{
+				m_Stream->Write( ",", 1, 1 );
+			}
+			m_Stream->Write( itr->m_Buffer.GetData() + 1, itr->m_Buffer.GetSize() - 3, 1 );
+		}
+		m_Stream->Write( "\n]", 2, 1 );
+		m_Stream->Flush();
 
-	// objects can get changed during this iteration (in Identify), so use indices
-	for ( size_t index = 0; index < m_Objects.GetSize(); ++index )
+		m_Slices.Clear();
+		HoldMemory( ArchiveMemoryTypes::Temporary, 0 );
+	}
+	else
 	{
-		Object* object = m_Objects.GetElement( index );
+		Begin();
 
-		if (object)
+		// objects can get changed during this iteration (in Identify), so use indices
+		for ( size_t index = 0; index < m_Objects.GetSize(); ++index )
 		{
-			const MetaClass* objectClass = object->GetMetaClass();
-
-			writer.StartObject();
-			writer.String( objectClass->m_Name );
-			SerializeInstance( writer, object, objectClass, object );
-			writer.EndObject();
+			WriteNext( index );
 
 			info.m_State = ArchiveStates::ObjectProcessed;
 			info.m_Progress = (int)(((float)(index) / (float)m_Objects.GetSize()) * 100.0f);
 			e_Status.Raise( info );
 		}
-		else
-		{
-			writer.StartObject();
-			writer.EndObject();
-		}
-	}
 
-	// end top level array
-	writer.EndArray();
+		End();
+	}
 
 	// notify completion of last object processed
 	info.m_State = ArchiveStates::ObjectProcessed;
 	info.m_Progress = 100;
 	e_Status.Raise( info );
 
-	// do cleanup
-	m_Stream->Flush();
-
 	// notify completion
 	info.m_State = ArchiveStates::Complete;
 	e_Status.Raise( info );
 }
 
-void ArchiveWriterJson::SerializeInstance( RapidJsonWriter& writer, void* instance, const MetaStruct* structure, Object* object )
+void ArchiveWriterJson::Begin()
 {
-#if PERSIST_ARCHIVE_VERBOSE
-	Log::Print( TXT( "Serializing %s\n" ), structure->m_Name );
-#endif
-
-	// TODO: Declare a max depth for inheritance to save heap allocs -geoff
-	DynamicArray< const MetaStruct* > bases;
-	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
-	{
-		bases.Push( current );
-	}
-
-	// TODO: Declare a max count for fields to save heap allocs -geoff
-	DynamicArray< const Field* > fields;
-	while ( !bases.IsEmpty() )
-	{
-		const MetaStruct* current = bases.Pop();
-		DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin();
-		DynamicArray< Field >::ConstIterator end = current->m_Fields.End();
-		for ( ; itr != end; ++itr )
-		{
-			const Field* field = &*itr;
-			if ( field->ShouldSerialize( instance, object ) )
-			{
-				fields.Push( field );
-			}
-		}
-	}
-
-	writer.StartObject();
-	object->PreSerialize( NULL );
+	m_Writer.Reset( new RapidJsonWriter( m_Output ) );
+	m_Writer->SetIndent('\t', 1);
 
-	DynamicArray< const Field* >::ConstIterator itr = fields.Begin();
-	DynamicArray< const Field* >::ConstIterator end = fields.End();
-	for ( ; itr != end; ++itr )
-	{
-		const Field* field = *itr;
-		object->PreSerialize( field );
-		SerializeField( writer, instance, field, object );
-		object->PostSerialize( field );
-	}
-
-	object->PostSerialize( NULL );
-	writer.EndObject();
+	// begin top level array of objects
+	m_Writer->StartArray();
 }
 
-void ArchiveWriterJson::SerializeField( RapidJsonWriter& writer, void* instance, const Field* field, Object* object )
+void ArchiveWriterJson::WriteNext( size_t index )
 {
-#if PERSIST_ARCHIVE_VERBOSE
-	Log::Print(TXT("Serializing field %s\n"), field->m_Name);
-#endif
-
-	// write the actual string
-	writer.String( field->m_Name );
+	WriteObject( *m_Writer, index );
+}
 
-	if ( field->m_Count > 1 )
-	{
-		writer.StartArray();
+void ArchiveWriterJson::End()
+{
+	// end top level array
+	m_Writer->EndArray();
+	m_Writer.Reset( NULL );
 
-		for ( uint32_t i=0; i<field->m_Count; ++i )
-		{
-			SerializeTranslator( writer, Pointer ( field, instance, object, i ), field->m_Translator, field, object );
-		}
+	m_Stream->Flush();
+}
 
-		writer.EndArray();
-	}
-	else
-	{
-		SerializeTranslator( writer, Pointer ( field, instance, object ), field->m_Translator, field, object );
-	}
+int64_t ArchiveWriterJson::GetPosition() const
+{
+	return m_Stream->Tell();
 }
 
-void ArchiveWriterJson::SerializeTranslator( RapidJsonWriter& writer, Pointer pointer, Translator* translator, const Field* field, Object* object )
+bool ArchiveWriterJson::WriteObject( RapidJsonWriter& writer, size_t index )
 {
-    char buff[256]={'\0'};
+	Object* object = m_Objects.GetElement( index );
 
-	switch ( translator->GetMetaId() )
+	if (object)
 	{
-	case MetaIds::PointerTranslator:
-		{
-			const ObjectPtr& pointed ( pointer.As< ObjectPtr >() );
-
-			if ( !pointed )
-			{
-				writer.Uint(0);
-				break;
-			}
-
-			if ( !Identify( pointed, NULL ) )
-			{
-				writer.StartObject();
-				writer.String( pointed->GetMetaClass()->m_Name );
-				SerializeInstance( writer, pointed, pointed->GetMetaClass(), pointed );
-				writer.EndObject();
-				break;
-			}
-
-			// fall through!!
-		}
-
-	case MetaIds::ScalarTranslator:
-	case MetaIds::SimpleTranslator:
-	case MetaIds::EnumerationTranslator:
-	case MetaIds::TypeTranslator:
-		{
-			ScalarTranslator* scalar = static_cast< ScalarTranslator* >( translator );
-			switch ( scalar->m_Type )
-			{
-			case ScalarTypes::Boolean:
-				writer.Bool( pointer.As<bool>() );
-				break;
-
-			case ScalarTypes::Unsigned8:
-				writer.Uint( pointer.As<uint8_t>() );
-				break;
-
-			case ScalarTypes::Unsigned16:
-				writer.Uint( pointer.As<uint16_t>() );
-				break;
-
-			case ScalarTypes::Unsigned32:
-				writer.Uint( pointer.As<uint32_t>() );
-				break;
-
-			case ScalarTypes::Unsigned64:
-				writer.Uint64( pointer.As<uint64_t>() );
-				break;
-
-			case ScalarTypes::Signed8:
-				writer.Int( pointer.As<int8_t>() );
-				break;
-
-			case ScalarTypes::Signed16:
-				writer.Int( pointer.As<int16_t>() );
-				break;
-
-			case ScalarTypes::Signed32:
-				writer.Int( pointer.As<int32_t>() );
-				break;
-
-			case ScalarTypes::Signed64:
-				writer.Int64( pointer.As<int64_t>() );
-				break;
-
-			case ScalarTypes::Float32:
-				writer.Double( pointer.As<float32_t>() );
-				break;
-
-			case ScalarTypes::Float64:
-				writer.Double( pointer.As<float64_t>() );
-				break;
-
-    // HEN1 : TODO !!
-            case ScalarTypes::ComplexFloat32 :
-                {
-                   const std::complex<float32_t>& cplx =pointer.As< std::complex<float32_t> >();
-                   // writer.Double( cplx.real() );
-                   // writer.Double( cplx.imag() );
-                   sprintf(buff, "%.9g + %.9g*I", (double)cplx.real(), (double)cplx.imag());
-                   writer.String( buff );
-                   break;
-                }
-
-             case ScalarTypes::ComplexFloat64 :
-                {
-                   const std::complex<float64_t>& cplx =pointer.As< std::complex<float64_t> >();
-                   // writer.Double( cplx.real() );
-                   // writer.Double( cplx.imag() );
-                   sprintf(buff, "%.9g + %.9g*I", (double)cplx.real(), (double)cplx.imag());
-                   writer.String( buff );
-                  break;
-                }
-
+		const MetaClass* objectClass = object->GetMetaClass();
 
+		writer.StartObject();
+		writer.String( objectClass->m_Name );
+		SerializeInstance( writer, object, objectClass, object, GetBaseline( index, objectClass ) );
+		writer.EndObject();
+		return true;
+	}
 
-			case ScalarTypes::String:
-				String str;
-				scalar->Print( pointer, str, this );
-				writer.String( str.GetData() );
-				break;
-			}
-			break;
-		}
-
-	case MetaIds::StructureTranslator:
-		{
-			StructureTranslator* structure = static_cast< StructureTranslator* >( translator );
-			SerializeInstance( writer, pointer.m_Address, structure->GetMetaStruct(), object );
-			break;
-		}
-
-	case MetaIds::SetTranslator:
-		{
-			SetTranslator* set = static_cast< SetTranslator* >( translator );
-
-			Translator* itemTranslator = set->GetItemTranslator();
-			DynamicArray< Pointer > items;
-			set->GetItems( pointer, items );
-
-			writer.StartArray();
-
-			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
-			{
-				SerializeTranslator( writer, *itr, itemTranslator, field, object );
-			}
-
-			writer.EndArray();
-
-			break;
-		}
-
-	case MetaIds::SequenceTranslator:
-		{
-			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
-
-			Translator* itemTranslator = sequence->GetItemTranslator();
-			DynamicArray< Pointer > items;
-			sequence->GetItems( pointer, items );
-
-			writer.StartArray();
-
-			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
-			{
-				SerializeTranslator( writer, *itr, itemTranslator, field, object );
-			}
-
-			writer.EndArray();
-
-			break;
-		}
-
-	case MetaIds::AssociationTranslator:
-		{
-			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
-
-			Translator* keyTranslator = association->GetKeyTranslator();
-			Translator* valueTranslator = association->GetValueTranslator();
-			DynamicArray< Pointer > keys, values;
-			association->GetItems( pointer, keys, values );
-
-			writer.StartObject();
+	writer.StartObject();
+	writer.EndObject();
+	return false;
+}
 
-			for ( DynamicArray< Pointer >::Iterator keyItr = keys.Begin(), valueItr = values.Begin(), keyEnd = keys.End(), valueEnd = values.End();
-				keyItr != keyEnd && valueItr != valueEnd;
-				++keyItr, ++valueItr )
-			{
-				SerializeTranslator( writer, *keyItr, keyTranslator, field, object );
-				SerializeTranslator( writer, *valueItr, valueTranslator, field, object );
-			}
+void ArchiveWriterJson::WriteSlice( size_t index, void* userData )
+{
+	ArchiveWriterJson* archive = static_cast< ArchiveWriterJson* >( userData );
+	Slice& slice = archive->m_Slices[ index ];
 
-			writer.EndObject();
+	DynamicMemoryStream stream ( &slice.m_Buffer );
+	RapidJsonOutputStream output;
+	output.SetStream( &stream );
 
-			break;
-		}
+	RapidJsonWriter writer ( output );
+	writer.SetIndent('\t', 1);
 
-	default:
-		// Unhandled reflection type in ArchiveWriterJson::SerializeTranslator
-		HELIUM_BREAK();
+	// an array of its own, so the objects are indented just like they are in the top level array
+	writer.StartArray();
+	for ( size_t i = slice.m_Begin; i < slice.m_End; ++i )
+	{
+		archive->WriteObject( writer, i );
 	}
+	writer.EndArray();
+}
+
+void ArchiveWriterJson::SerializeInstance( RapidJsonWriter& writer, void* instance, const MetaStruct* structure, Object* object, void* baseline )
+{
+	JsonPolicy policy ( writer );
+	SerializeEngine< JsonPolicy > engine ( *this, policy );
+	engine.SerializeInstance( instance, structure, object, baseline );
 }
 
 void ArchiveReaderJson::ReadFromStream( Stream& stream, ObjectPtr& object, ObjectResolver* resolver, uint32_t flags )
@@ -444,8 +358,7 @@ void ArchiveReaderJson::Open()
 	Log::Print(TXT("Opening file '%s'\n"), m_Path.c_str());
 #endif
 
-	FileStream* stream = new FileStream();
-	stream->Open( m_Path, FileStream::MODE_READ );
+	Stream* stream = OpenStream();
 	m_Stream.Reset( stream );
 }
 
@@ -455,23 +368,49 @@ void ArchiveReaderJson::Close()
 	m_Stream->Close();
 }
 
+void ArchiveReaderJson::Reset( Stream* stream, ObjectResolver* resolver )
+{
+	ArchiveReader::Reset( stream, resolver );
+
+	// the pool only ever grows while the document lives, start it over (the parse stack keeps its capacity)
+	m_Document.SetNull();
+	m_Document.GetAllocator().Clear();
+	m_Buffer.Resize( 0 );
+	m_Next = 0;
+	m_Bodies.Resize( 0 );
+	m_Size = 0;
+
+	m_Stream.Reset( stream );
+	m_Stream.Orphan( true );
+}
+
 void ArchiveReaderJson::Read( DynamicArray< ObjectPtr >& objects )
 {
 	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Json Read" );
 
-	Start();
-
 	m_Objects = objects;
 
-	if ( HELIUM_VERIFY( m_Document.IsArray() ) )
+	Begin();
+
+	// merge reads stage fields on the reader, so they are serial
+	if ( ( m_Flags & ArchiveFlags::ParallelRead ) && !( m_Flags & ArchiveFlags::Merge ) && m_Document.IsArray() )
 	{
 		uint32_t length = m_Document.Size();
-		m_Objects.Resize( length );
+
+		// allocate everything up front on this thread (class filter and proxies included), then fill in the objects in parallel
+		m_Bodies.Resize( length );
 		for ( uint32_t i=0; i<length; i++ )
 		{
-			ObjectPtr& object ( m_Objects[ i ] );
-			ReadNext( object, i );
+			m_Bodies[ i ] = Allocate( m_Document[ i ], m_Objects[ i ], i );
+		}
 
+		ReadParallel( length, &ArchiveReaderJson::ReadParallelObject );
+		m_Bodies.Clear();
+	}
+	else
+	{
+		for ( size_t i=0; ReadObject( i ); i++ )
+		{
 			ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
 			info.m_Progress = (int)(((float)(m_Stream->Tell()) / (float)m_Size) * 100.0f);
 			e_Status.Raise( info );
@@ -488,15 +427,41 @@ void ArchiveReaderJson::Read( DynamicArray< ObjectPtr >& objects )
 	objects = m_Objects;
 }
 
+void ArchiveReaderJson::Begin()
+{
+	Start();
+
+	m_Next = 0;
+	if ( HELIUM_VERIFY( m_Document.IsArray() ) )
+	{
+		m_Objects.Resize( m_Document.Size() );
+	}
+}
+
+bool ArchiveReaderJson::ReadObject( size_t index )
+{
+	// the serial loop asks for one past the last object to find the end
+	return m_Document.IsArray() && index < m_Objects.GetSize() && ReadNext( m_Objects[ index ], index );
+}
+
+int64_t ArchiveReaderJson::GetPosition() const
+{
+	return m_Stream->Tell();
+}
+
+int64_t ArchiveReaderJson::GetSize() const
+{
+	return m_Size;
+}
+
 void ArchiveReaderJson::Start()
 {
 	ArchiveStatus info( *this, ArchiveStates::Starting );
 	e_Status.Raise( info );
 	m_Abort = false;
 
-	// determine the size of the input stream
-	m_Stream->Seek(0, SeekOrigins::End);
-	m_Size = m_Stream->Tell();
+	// determine the size of the input stream (without seeking, which would throw away what a read ahead stream prefetched)
+	m_Size = m_Stream->GetSize();
 	m_Stream->Seek(0, SeekOrigins::Begin);
 
 	// fail on an empty input stream
@@ -505,11 +470,26 @@ void ArchiveReaderJson::Start()
 		throw Persist::StreamException( TXT( "Input stream is empty (%s)" ), m_Path.c_str() );
 	}
 
-	// read entire contents
-	m_Buffer.Resize( static_cast< size_t >( m_Size + 1 ) );
-	m_Stream->Read( m_Buffer.GetData(),  static_cast< size_t >( m_Size ), 1 );
-	m_Buffer[ static_cast< size_t >( m_Size ) ] = '\0';
-	if ( m_Document.ParseInsitu< 0 >( reinterpret_cast< char* >( m_Buffer.GetData() ) ).HasParseError() )
+	if ( m_Flags & ArchiveFlags::Pipeline )
+	{
+		// tokenize what has arrived while the rest is still being read (strings get copied instead of parsed in situ)
+		RapidJsonInputStream input ( *m_Stream );
+		m_Document.ParseStream< 0 >( input );
+	}
+	else
+	{
+		// read entire contents
+		HoldMemory( ArchiveMemoryTypes::Input, m_Size + 1 );
+		m_Buffer.Resize( static_cast< size_t >( m_Size + 1 ) );
+		m_Stream->Read( m_Buffer.GetData(),  static_cast< size_t >( m_Size ), 1 );
+		m_Buffer[ static_cast< size_t >( m_Size ) ] = '\0';
+		m_Document.ParseInsitu< 0 >( reinterpret_cast< char* >( m_Buffer.GetData() ) );
+	}
+
+	// strings are in the buffer when parsed in situ, the DOM's nodes (and copied strings) are in its pool
+	HoldMemory( ArchiveMemoryTypes::Document, m_Document.GetAllocator().Capacity() );
+
+	if ( m_Document.HasParseError() )
 	{
 		m_Stream->Seek( 0, SeekOrigins::Begin );
 		size_t lineCount = 1;
@@ -554,8 +534,18 @@ bool ArchiveReaderJson::ReadNext( Reflect::ObjectPtr& object, size_t index )
 		return false;
 	}
 
-	rapidjson::Value& value = m_Document[ m_Next ];
+	rapidjson::Value* body = Allocate( m_Document[ m_Next ], object, index );
+	if ( body && object.ReferencesObject() )
+	{
+		DeserializeInstance( *body, object, object->GetMetaClass(), object );
+	}
+
+	m_Next++;
+	return true;
+}
 
+rapidjson::Value* ArchiveReaderJson::Allocate( rapidjson::Value& value, Reflect::ObjectPtr& object, size_t index )
+{
 	if ( HELIUM_VERIFY( value.IsObject() ) )
 	{
 		rapidjson::Value::Member* member = value.MemberBegin();
@@ -573,31 +563,39 @@ bool ArchiveReaderJson::ReadNext( Reflect::ObjectPtr& object, size_t index )
 			const MetaClass* objectClass = NULL;
 			if ( objectClassCrc != 0 )
 			{
-				objectClass = Registry::GetInstance()->GetMetaClass( objectClassCrc );
+				objectClass = FindClass( objectClassCrc );
 				if ( !objectClass )
 				{
 					HELIUM_TRACE(
 						TraceLevels::Warning,
-						"ArchiveReaderJson::ReadNext - Could not find class '%s' (CRC-32 = %" PRIu32 ")\n",
+						"ArchiveReaderJson::Allocate - Could not find class '%s' (CRC-32 = %" PRIu32 ")\n",
 						*typeStr,
 						objectClassCrc);
 				}
 			}
 
-			if ( !object && HELIUM_VERIFY( objectClass ) )
+			if ( !object && HELIUM_VERIFY( objectClass ) && AcceptClass( objectClass, index ) )
 			{
 				object = AllocateObject( objectClass, index );
 			}
 
-			if ( object.ReferencesObject() )
-			{
-				DeserializeInstance( member->value, object, object->GetMetaClass(), object );
-			}
+			return &member->value;
 		}
 	}
 
-	m_Next++;
-	return true;
+	return NULL;
+}
+
+void ArchiveReaderJson::ReadParallelObject( size_t index, void* userData )
+{
+	ArchiveReaderJson* archive = static_cast< ArchiveReaderJson* >( userData );
+
+	Object* object = archive->m_Objects[ index ];
+	rapidjson::Value* body = archive->m_Bodies[ index ];
+	if ( body && object )
+	{
+		archive->DeserializeInstance( *body, object, object->GetMetaClass(), object );
+	}
 }
 
 void ArchiveReaderJson::DeserializeInstance( rapidjson::Value& value, void* instance, const MetaStruct* structure, Object* object )
@@ -606,7 +604,12 @@ void ArchiveReaderJson::DeserializeInstance( rapidjson::Value& value, void* inst
 	Log::Print(TXT("Deserializing %s\n"), structure->m_Name);
 #endif
 
-	object->PreDeserialize( NULL );
+	// staged copies aren't the object's yet, EndMerge calls back for what they change once they are merged
+	bool staged = m_Staging != 0;
+	if ( !staged )
+	{
+		object->PreDeserialize( NULL );
+	}
 
 	if ( HELIUM_VERIFY( value.IsObject() ) )
 	{
@@ -620,38 +623,49 @@ void ArchiveReaderJson::DeserializeInstance( rapidjson::Value& value, void* inst
 				fieldCrc = Helium::Crc32( fieldStr.GetData() );
 			}
 
-			const Field* field = structure->FindFieldByName( fieldCrc );
-			if ( field )
+			const SchemaField* mapped = FindField( structure, fieldCrc, itr->name.IsString() ? itr->name.GetString() : NULL );
+			if ( mapped )
 			{
-				object->PreDeserialize( field );
+				const Field* field = mapped->m_Field;
+				if ( !mapped->m_Converter && CanMerge( field ) )
+				{
+					Pointer current ( field, instance, object );
+					Variable staged ( field->m_Translator );
+					BeginMerge( current, staged, field->m_Translator );
+					DeserializeTranslator( itr->value, staged, field->m_Translator, field, object );
+					EndMerge( staged, current, field, object );
+					continue;
+				}
 
-				DeserializeField( itr->value, instance, field, object );
+				if ( !staged )
+				{
+					object->PreDeserialize( field );
+				}
 
-				object->PostDeserialize( field );
-			}
-			else
-			{
-				if ( itr->name.IsString() )
+				if ( mapped->m_Converter )
 				{
-					HELIUM_TRACE(
-						TraceLevels::Debug,
-						"ArchiveReaderJson::DeserializeInstance - Could not find field '%s' (CRC-32 = %" PRIu32 ")\n",
-						itr->name.GetString(),
-						fieldCrc);
+					Variable oldValue ( mapped->m_Translator );
+					DeserializeTranslator( itr->value, oldValue, mapped->m_Translator, field, object );
+					mapped->m_Converter( oldValue, Pointer ( field, instance, object ), object );
 				}
 				else
 				{
-					HELIUM_TRACE(
-						TraceLevels::Debug,
-						"ArchiveReaderJson::DeserializeInstance - Could not find field with CRC-32 %" PRIu32 ")\n",
-						fieldCrc);
+					DeserializeField( itr->value, instance, field, object );
 				}
 
+				if ( !staged )
+				{
+					object->PostDeserialize( field );
+					Changed( object, field );
+				}
 			}
 		}
 	}
 
-	object->PostDeserialize( NULL );
+	if ( !staged )
+	{
+		object->PostDeserialize( NULL );
+	}
 }
 
 void ArchiveReaderJson::DeserializeField( rapidjson::Value& value, void* instance, const Field* field, Object* object )
@@ -698,7 +712,12 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 	}
 	else if ( value.IsNumber() )
 	{
-		if ( translator->IsA(MetaIds::ScalarTranslator) )
+		if ( translator->GetMetaId() == MetaIds::PointerTranslator )
+		{
+			// null pointers are written as zero
+			pointer.As<ObjectPtr>().Release();
+		}
+		else if ( translator->IsA(MetaIds::ScalarTranslator) )
 		{
 			ScalarTranslator* scalar = static_cast< ScalarTranslator* >( translator );
 			bool clamp = true;
@@ -776,7 +795,8 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 			if ( scalar->m_Type == ScalarTypes::String )
 			{
 				String str ( value.GetString() );
-				scalar->Parse( str, pointer, this, m_Flags | ArchiveFlags::Notify ? true : false );
+				// DeserializeInstance notifies for the whole field (see Changed), for every type of value
+				scalar->Parse( str, pointer, this, false );
 			}
 		}
 	}
@@ -786,6 +806,7 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 		{
 			SetTranslator* set = static_cast< SetTranslator* >( translator );
 			Translator* itemTranslator = set->GetItemTranslator();
+			ResetContainer( set, pointer );
 			uint32_t length = value.Size();
 			for ( uint32_t i=0; i<length; ++i )
 			{
@@ -800,10 +821,13 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 			Translator* itemTranslator = sequence->GetItemTranslator();
 			uint32_t length = value.Size();
 			sequence->SetLength(pointer, length);
-			for ( uint32_t i=0; i<length; ++i )
+			if ( !DeserializeItems( value, pointer, sequence, field, object ) )
 			{
-				Pointer item = sequence->GetItem( pointer, i );
-				DeserializeTranslator( value[ i ], item, itemTranslator, field, object );
+				for ( uint32_t i=0; i<length; ++i )
+				{
+					Pointer item = sequence->GetItem( pointer, i );
+					DeserializeTranslator( value[ i ], item, itemTranslator, field, object );
+				}
 			}
 		}
 	}
@@ -827,17 +851,23 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 				const MetaClass* objectClass = NULL;
 				if ( objectClassCrc != 0 )
 				{
-					objectClass = Registry::GetInstance()->GetMetaClass( objectClassCrc );
+					objectClass = FindClass( objectClassCrc );
 				}
 
-				if ( !object && HELIUM_VERIFY( objectClass ) )
+				// replace existing objects of a different class (reading over a baseline or an old instance)
+				if ( HELIUM_VERIFY( objectClass ) && ( !object || object->GetMetaClass() != objectClass ) )
 				{
+					ChargeMemory( ArchiveMemoryTypes::Objects, objectClass->m_Size );
 					object = objectClass->m_Creator();
 				}
 
 				if ( object.ReferencesObject() )
 				{
+					// an owned object is the same one when staged, so it is merged like any other
+					uint32_t staging = m_Staging;
+					m_Staging = 0;
 					DeserializeInstance( member->value, object, object->GetMetaClass(), object );
+					m_Staging = staging;
 				}
 			}
 		}
@@ -851,6 +881,7 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 			AssociationTranslator* assocation = static_cast< AssociationTranslator* >( translator );
 			Translator* keyTranslator = assocation->GetKeyTranslator();
 			Translator* valueTranslator = assocation->GetValueTranslator();
+			ResetContainer( assocation, pointer );
 			for ( rapidjson::Value::MemberIterator itr = value.MemberBegin(), end = value.MemberEnd(); itr != end; ++itr )
 			{
 				Variable keyVariable ( keyTranslator );
@@ -862,3 +893,244 @@ void ArchiveReaderJson::DeserializeTranslator( rapidjson::Value& value, Pointer
 		}
 	}
 }
+
+// the scalar kernels' conversions, the same ones DeserializeTranslator makes, false if the value isn't of the kind
+static inline bool ReadScalar( rapidjson::Value& value, bool& scalar )
+{
+	if ( !value.IsBool() )
+	{
+		return false;
+	}
+
+	scalar = value.IsTrue();
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, uint8_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetUint(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, uint16_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetUint(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, uint32_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetUint(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, uint64_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetUint64(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, int8_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetInt(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, int16_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetInt(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, int32_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetInt(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, int64_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastInteger( value.GetInt64(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, float32_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastFloat( value.GetDouble(), scalar, clamp );
+	return true;
+}
+
+static inline bool ReadScalar( rapidjson::Value& value, float64_t& scalar )
+{
+	if ( !value.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	RangeCastFloat( value.GetDouble(), scalar, clamp );
+	return true;
+}
+
+template< class T >
+void ArchiveReaderJson::DeserializeScalars( rapidjson::Value& value, Pointer pointer, SequenceTranslator* sequence, const Field* field, Object* object )
+{
+	Translator* itemTranslator = sequence->GetItemTranslator();
+	uint32_t length = value.Size();
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		Pointer item = sequence->GetItem( pointer, i );
+		rapidjson::Value& element = value[ i ];
+		if ( !ReadScalar( element, item.As< T >() ) )
+		{
+			DeserializeTranslator( element, item, itemTranslator, field, object );
+		}
+	}
+}
+
+bool ArchiveReaderJson::DeserializeItems( rapidjson::Value& value, Pointer pointer, SequenceTranslator* sequence, const Field* field, Object* object )
+{
+	Translator* itemTranslator = sequence->GetItemTranslator();
+	uint32_t length = value.Size();
+
+	if ( itemTranslator->IsA( MetaIds::ScalarTranslator ) )
+	{
+		ScalarTranslator* scalar = static_cast< ScalarTranslator* >( itemTranslator );
+		switch ( scalar->m_Type )
+		{
+		case ScalarTypes::Boolean:
+			DeserializeScalars< bool >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned8:
+			DeserializeScalars< uint8_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned16:
+			DeserializeScalars< uint16_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned32:
+			DeserializeScalars< uint32_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned64:
+			DeserializeScalars< uint64_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Signed8:
+			DeserializeScalars< int8_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Signed16:
+			DeserializeScalars< int16_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Signed32:
+			DeserializeScalars< int32_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Signed64:
+			DeserializeScalars< int64_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Float32:
+			DeserializeScalars< float32_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::Float64:
+			DeserializeScalars< float64_t >( value, pointer, sequence, field, object );
+			return true;
+
+		case ScalarTypes::String:
+			for ( uint32_t i=0; i<length; ++i )
+			{
+				Pointer item = sequence->GetItem( pointer, i );
+				rapidjson::Value& element = value[ i ];
+				if ( element.IsString() )
+				{
+					String str ( element.GetString() );
+					scalar->Parse( str, item, this, false );
+				}
+				else
+				{
+					DeserializeTranslator( element, item, itemTranslator, field, object );
+				}
+			}
+			return true;
+
+		default:
+			return false;
+		}
+	}
+	else if ( itemTranslator->GetMetaId() == MetaIds::StructureTranslator )
+	{
+		const MetaStruct* structure = static_cast< StructureTranslator* >( itemTranslator )->GetMetaStruct();
+		for ( uint32_t i=0; i<length; ++i )
+		{
+			Pointer item = sequence->GetItem( pointer, i );
+			rapidjson::Value& element = value[ i ];
+			if ( element.IsObject() )
+			{
+				DeserializeInstance( element, item.m_Address, structure, object );
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
@@ -40,6 +40,32 @@ namespace Helium
 		};
 		typedef rapidjson::PrettyWriter< RapidJsonOutputStream > RapidJsonWriter;
 
+		// buffered reads for rapidjson's tokenizer, so parsing can start before the whole stream has arrived
+		class RapidJsonInputStream
+		{
+		public:
+			typedef char Ch;
+
+			inline RapidJsonInputStream( Stream& stream );
+			inline char Peek() const;
+			inline char Take();
+			inline size_t Tell() const;
+
+			// only used for in situ parsing, which needs the whole buffer anyway
+			inline char* PutBegin();
+			inline void Put( char c );
+			inline size_t PutEnd( char* begin );
+
+		private:
+			inline void Fill();
+
+			Stream&              m_Stream;
+			DynamicArray< char > m_Buffer;
+			size_t               m_Current;
+			size_t               m_End;
+			size_t               m_Count;  // characters taken so far
+		};
+
 		class HELIUM_PERSIST_API ArchiveWriterJson : public ArchiveWriter
 		{
 		public:
@@ -53,17 +79,23 @@ namespace Helium
 			virtual ArchiveType GetType() const HELIUM_OVERRIDE;
 			virtual void Open() HELIUM_OVERRIDE;
 			virtual void Close() HELIUM_OVERRIDE;
+			virtual void Reset( Stream* stream, Reflect::ObjectIdentifier* identifier = NULL ) HELIUM_OVERRIDE;
 
 		protected:
 			virtual void Write( const Reflect::ObjectPtr* objects, size_t count );
+			virtual void Begin() HELIUM_OVERRIDE;
+			virtual void WriteNext( size_t index ) HELIUM_OVERRIDE;
+			virtual void End() HELIUM_OVERRIDE;
+			virtual int64_t GetPosition() const HELIUM_OVERRIDE;
 
 		private:
-			void SerializeInstance( RapidJsonWriter& writer, void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object );
-			void SerializeField( RapidJsonWriter& writer, void* instance, const Reflect::Field* field, Reflect::Object* object );
-			void SerializeTranslator( RapidJsonWriter& writer, Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
+			bool WriteObject( RapidJsonWriter& writer, size_t index );
+			static void WriteSlice( size_t index, void* userData );
+			void SerializeInstance( RapidJsonWriter& writer, void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object, void* baseline );
 
-			AutoPtr< Stream >     m_Stream;
-			RapidJsonOutputStream m_Output;
+			AutoPtr< Stream >            m_Stream;
+			RapidJsonOutputStream        m_Output;
+			AutoPtr< RapidJsonWriter >   m_Writer; // of the serial write, between Begin and End
 		};
 
 		class HELIUM_PERSIST_API ArchiveReaderJson : public ArchiveReader
@@ -79,21 +111,35 @@ namespace Helium
 			virtual ArchiveType GetType() const HELIUM_OVERRIDE;
 			virtual void Open() HELIUM_OVERRIDE;
 			virtual void Close() HELIUM_OVERRIDE;
+			virtual void Reset( Stream* stream, Reflect::ObjectResolver* resolver = NULL ) HELIUM_OVERRIDE;
 
 		protected:
 			virtual void Read( DynamicArray< Reflect::ObjectPtr >& objects ) HELIUM_OVERRIDE;
+			virtual void Begin() HELIUM_OVERRIDE;
+			virtual bool ReadObject( size_t index ) HELIUM_OVERRIDE;
+			virtual int64_t GetPosition() const HELIUM_OVERRIDE;
+			virtual int64_t GetSize() const HELIUM_OVERRIDE;
 
 		private:
 			void Start();
 			bool ReadNext( Reflect::ObjectPtr &object, size_t index );
+			rapidjson::Value* Allocate( rapidjson::Value& value, Reflect::ObjectPtr& object, size_t index );
+			static void ReadParallelObject( size_t index, void* userData );
 			void DeserializeInstance( rapidjson::Value& value, void* instance, const Reflect::MetaStruct* composite, Reflect::Object* object );
 			void DeserializeField( rapidjson::Value& value, void* instance, const Reflect::Field* field, Reflect::Object* object );
 			void DeserializeTranslator( rapidjson::Value& value, Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
 
+			// a sequence's items in a loop picked once for its item translator (scalars and structures get their own),
+			//  items that were written as something else go through DeserializeTranslator, false leaves all of them to it
+			bool DeserializeItems( rapidjson::Value& value, Reflect::Pointer pointer, Reflect::SequenceTranslator* sequence, const Reflect::Field* field, Reflect::Object* object );
+			template< class T >
+			void DeserializeScalars( rapidjson::Value& value, Reflect::Pointer pointer, Reflect::SequenceTranslator* sequence, const Reflect::Field* field, Reflect::Object* object );
+
 			DynamicArray< uint8_t > m_Buffer;
 			AutoPtr< Stream >       m_Stream;
 			rapidjson::Document     m_Document;
 			rapidjson::SizeType     m_Next;
+			DynamicArray< rapidjson::Value* > m_Bodies; // of the top-level objects being read in parallel
 			int64_t                 m_Size;
 		};
 	}
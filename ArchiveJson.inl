@@ -17,3 +17,64 @@ void Helium::Persist::RapidJsonOutputStream::Flush()
 {
 	m_Stream->Flush();
 }
+
+Helium::Persist::RapidJsonInputStream::RapidJsonInputStream( Stream& stream )
+	: m_Stream( stream )
+	, m_Current( 0 )
+	, m_End( 0 )
+	, m_Count( 0 )
+{
+	m_Buffer.Resize( 64 * 1024 );
+	Fill();
+}
+
+char Helium::Persist::RapidJsonInputStream::Peek() const
+{
+	return m_Current < m_End ? m_Buffer[ m_Current ] : '\0';
+}
+
+char Helium::Persist::RapidJsonInputStream::Take()
+{
+	if ( m_Current >= m_End )
+	{
+		return '\0';
+	}
+
+	char c = m_Buffer[ m_Current++ ];
+	++m_Count;
+
+	if ( m_Current == m_End )
+	{
+		Fill();
+	}
+
+	return c;
+}
+
+size_t Helium::Persist::RapidJsonInputStream::Tell() const
+{
+	return m_Count;
+}
+
+char* Helium::Persist::RapidJsonInputStream::PutBegin()
+{
+	HELIUM_BREAK();
+	return NULL;
+}
+
+void Helium::Persist::RapidJsonInputStream::Put( char c )
+{
+	HELIUM_BREAK();
+}
+
+size_t Helium::Persist::RapidJsonInputStream::PutEnd( char* begin )
+{
+	HELIUM_BREAK();
+	return 0;
+}
+
+void Helium::Persist::RapidJsonInputStream::Fill()
+{
+	m_Current = 0;
+	m_End = m_Stream.Read( m_Buffer.GetData(), 1, m_Buffer.GetSize() );
+}
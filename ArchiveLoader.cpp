@@ -0,0 +1,336 @@
+#include "PersistPch.h"
+#include "Persist/ArchiveLoader.h"
+
+#include "Platform/Exception.h"
+
+#include "Persist/Parallel.h"
+
+#include <exception>
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+static const uint32_t WaitMilliseconds = 10; // waits are re-checked, this bounds a signal taken by another waiter
+
+ArchiveLoader::Worker::Worker( ArchiveLoader& loader )
+	: m_Loader( loader )
+{
+}
+
+void ArchiveLoader::Worker::Run()
+{
+	m_Loader.Work();
+}
+
+ArchiveLoader::Request::Request()
+	: m_Loader( NULL )
+	, m_Priority( 0 )
+	, m_Sequence( 0 )
+	, m_Resolver( NULL )
+	, m_ArchiveType( ArchiveTypes::Auto )
+	, m_Flags( 0 )
+	, m_State( LoadStates::Queued )
+	, m_Progress( 0 )
+	, m_Cancel( false )
+{
+}
+
+void ArchiveLoader::Request::OnStatus( const ArchiveStatus& status )
+{
+	MutexScopeLock lock ( m_Loader->m_Lock );
+
+	if ( status.m_State == ArchiveStates::ObjectProcessed )
+	{
+		m_Progress = status.m_Progress;
+	}
+
+	// the reader polls this after every object
+	status.m_Abort |= m_Cancel;
+}
+
+ArchiveLoader::ArchiveLoader( uint32_t workerCount )
+	: m_NextHandle( InvalidHandle + 1 )
+	, m_NextSequence( 0 )
+	, m_Stop( false )
+	, m_Queued( false, false )
+	, m_Finished( false, false )
+{
+	if ( !workerCount )
+	{
+		workerCount = Max< uint32_t >( GetParallelWorkerCount() - 1, 1 );
+	}
+
+	for ( uint32_t i=0; i<workerCount; ++i )
+	{
+		Worker* worker = new Worker( *this );
+		if ( !worker->Start( TXT( "Persist Loader" ) ) )
+		{
+			delete worker;
+			break;
+		}
+
+		m_Workers.Push( worker );
+	}
+
+	if ( m_Workers.IsEmpty() )
+	{
+		throw Persist::Exception( TXT( "Failed to start any archive loader threads" ) );
+	}
+}
+
+ArchiveLoader::~ArchiveLoader()
+{
+	{
+		MutexScopeLock lock ( m_Lock );
+		m_Stop = true;
+		for ( RequestMap::iterator itr = m_Requests.begin(), end = m_Requests.end(); itr != end; ++itr )
+		{
+			itr->second->m_Cancel = true;
+		}
+	}
+
+	for ( DynamicArray< Worker* >::Iterator itr = m_Workers.Begin(), end = m_Workers.End(); itr != end; ++itr )
+	{
+		m_Queued.Signal();
+		(*itr)->Join();
+		delete *itr;
+	}
+
+	for ( RequestMap::iterator itr = m_Requests.begin(), end = m_Requests.end(); itr != end; ++itr )
+	{
+		delete itr->second;
+	}
+}
+
+ArchiveLoader::Handle ArchiveLoader::Load( const FilePath& path, int32_t priority, ObjectResolver* resolver, ArchiveType archiveType, uint32_t flags )
+{
+	Request* request = new Request;
+	request->m_Loader = this;
+	request->m_Path = path;
+	request->m_Priority = priority;
+	request->m_Resolver = resolver;
+	request->m_ArchiveType = archiveType;
+	request->m_Flags = flags;
+
+	Handle handle = InvalidHandle;
+	{
+		MutexScopeLock lock ( m_Lock );
+		request->m_Sequence = m_NextSequence++;
+
+		handle = m_NextHandle++;
+		if ( m_NextHandle == InvalidHandle )
+		{
+			++m_NextHandle;
+		}
+
+		m_Requests[ handle ] = request;
+	}
+
+	m_Queued.Signal();
+	return handle;
+}
+
+void ArchiveLoader::SetPriority( Handle handle, int32_t priority )
+{
+	MutexScopeLock lock ( m_Lock );
+
+	// only matters until a worker picks the load up
+	RequestMap::iterator found = m_Requests.find( handle );
+	if ( found != m_Requests.end() )
+	{
+		found->second->m_Priority = priority;
+	}
+}
+
+void ArchiveLoader::Cancel( Handle handle )
+{
+	{
+		MutexScopeLock lock ( m_Lock );
+
+		RequestMap::iterator found = m_Requests.find( handle );
+		if ( found == m_Requests.end() )
+		{
+			return;
+		}
+
+		Request* request = found->second;
+		request->m_Cancel = true;
+
+		// queued loads never start, loading ones stop after the object in progress (see Request::OnStatus)
+		if ( request->m_State != LoadStates::Queued )
+		{
+			return;
+		}
+
+		request->m_State = LoadStates::Cancelled;
+	}
+
+	m_Finished.Signal();
+}
+
+LoadState ArchiveLoader::GetState( Handle handle ) const
+{
+	MutexScopeLock lock ( m_Lock );
+
+	RequestMap::const_iterator found = m_Requests.find( handle );
+	return found != m_Requests.end() ? found->second->m_State : LoadStates::Invalid;
+}
+
+int ArchiveLoader::GetProgress( Handle handle ) const
+{
+	MutexScopeLock lock ( m_Lock );
+
+	RequestMap::const_iterator found = m_Requests.find( handle );
+	return found != m_Requests.end() ? found->second->m_Progress : 0;
+}
+
+bool ArchiveLoader::Wait( Handle handle, uint32_t timeoutMilliseconds )
+{
+	for ( uint32_t waited = 0; ; waited += WaitMilliseconds )
+	{
+		if ( IsDone( handle ) )
+		{
+			return true;
+		}
+
+		if ( timeoutMilliseconds != WaitForever && waited >= timeoutMilliseconds )
+		{
+			return false;
+		}
+
+		m_Finished.Wait( WaitMilliseconds );
+	}
+}
+
+LoadState ArchiveLoader::Finish( Handle handle, DynamicArray< ObjectPtr >& objects, std::string* error )
+{
+	Wait( handle );
+
+	MutexScopeLock lock ( m_Lock );
+
+	RequestMap::iterator found = m_Requests.find( handle );
+	if ( found == m_Requests.end() )
+	{
+		return LoadStates::Invalid;
+	}
+
+	Request* request = found->second;
+	LoadState state = request->m_State;
+
+	objects = request->m_Objects;
+	if ( error )
+	{
+		*error = request->m_Error;
+	}
+
+	m_Requests.erase( found );
+	delete request;
+	return state;
+}
+
+bool ArchiveLoader::IsDone( Handle handle ) const
+{
+	LoadState state = GetState( handle );
+	return state != LoadStates::Queued && state != LoadStates::Loading;
+}
+
+void ArchiveLoader::Work()
+{
+	for (;;)
+	{
+		Request* request = NULL;
+		{
+			MutexScopeLock lock ( m_Lock );
+			if ( m_Stop )
+			{
+				return;
+			}
+
+			request = Next();
+			if ( request )
+			{
+				request->m_State = LoadStates::Loading;
+			}
+		}
+
+		if ( !request )
+		{
+			m_Queued.Wait( WaitMilliseconds );
+			continue;
+		}
+
+		Execute( *request );
+		m_Finished.Signal();
+
+		// there may be more queued than the one signal that woke us accounted for
+		m_Queued.Signal();
+	}
+}
+
+ArchiveLoader::Request* ArchiveLoader::Next()
+{
+	Request* next = NULL;
+	for ( RequestMap::iterator itr = m_Requests.begin(), end = m_Requests.end(); itr != end; ++itr )
+	{
+		Request* request = itr->second;
+		if ( request->m_State != LoadStates::Queued )
+		{
+			continue;
+		}
+
+		if ( !next || request->m_Priority > next->m_Priority || ( request->m_Priority == next->m_Priority && request->m_Sequence < next->m_Sequence ) )
+		{
+			next = request;
+		}
+	}
+
+	return next;
+}
+
+void ArchiveLoader::Execute( Request& request )
+{
+	DynamicArray< ObjectPtr > objects;
+	std::string error;
+	bool success = false;
+
+	try
+	{
+		SmartPtr< ArchiveReader > archive = ArchiveReader::GetReader( request.m_Path, request.m_Resolver, request.m_ArchiveType, request.m_Flags );
+		archive->e_Status.AddMethod( &request, &Request::OnStatus );
+		success = ArchiveReader::ReadFromArchive( *archive, objects, &error );
+		archive->e_Status.RemoveMethod( &request, &Request::OnStatus );
+	}
+	catch ( Helium::Exception& ex )
+	{
+		error = ex.Get();
+	}
+	catch ( std::exception& ex )
+	{
+		// bad_alloc from a large read, say, must fail this load rather than escape the worker thread
+		error = ex.what();
+	}
+	catch ( ... )
+	{
+		error = "Unknown exception";
+	}
+
+	MutexScopeLock lock ( m_Lock );
+
+	if ( request.m_Cancel )
+	{
+		// whatever was read before the cancellation is incomplete, don't hand it out
+		request.m_State = LoadStates::Cancelled;
+	}
+	else if ( success )
+	{
+		request.m_State = LoadStates::Complete;
+		request.m_Progress = 100;
+		request.m_Objects = objects;
+	}
+	else
+	{
+		request.m_State = LoadStates::Failed;
+		request.m_Error = error;
+	}
+}
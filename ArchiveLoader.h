@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Platform/Condition.h"
+#include "Platform/Locks.h"
+#include "Platform/Thread.h"
+
+#include "Persist/Archive.h"
+
+#include <map>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		namespace LoadStates
+		{
+			enum LoadState
+			{
+				Invalid,   // unknown (or already finished) handle
+				Queued,
+				Loading,
+				Complete,
+				Failed,
+				Cancelled,
+			};
+		}
+		typedef LoadStates::LoadState LoadState;
+
+		//
+		// Loader: reads archives on a pool of worker threads, always starting the most urgent queued load next,
+		//  loads are tracked by handle and can be reprioritized while queued or cancelled between objects
+		//
+
+		class HELIUM_PERSIST_API ArchiveLoader
+		{
+		public:
+			typedef uint32_t Handle;
+			static const Handle   InvalidHandle = 0;
+			static const uint32_t WaitForever = 0xffffffff;
+
+			// zero workers means one per core less the calling thread
+			ArchiveLoader( uint32_t workerCount = 0 );
+			~ArchiveLoader(); // cancels everything still outstanding
+
+			// higher priorities load first, equal ones in the order they were asked for
+			Handle    Load( const FilePath& path, int32_t priority = 0, Reflect::ObjectResolver* resolver = NULL, ArchiveType archiveType = ArchiveTypes::Auto, uint32_t flags = 0x0 );
+			void      SetPriority( Handle handle, int32_t priority );
+			void      Cancel( Handle handle );
+
+			LoadState GetState( Handle handle ) const;
+			int       GetProgress( Handle handle ) const; // percent
+
+			// true once the load is complete, failed, or cancelled
+			bool      Wait( Handle handle, uint32_t timeoutMilliseconds = WaitForever );
+
+			// wait for the load, hand over its objects (or error), and forget the handle
+			LoadState Finish( Handle handle, DynamicArray< Reflect::ObjectPtr >& objects, std::string* error = NULL );
+
+		private:
+			class Worker : public Thread
+			{
+			public:
+				Worker( ArchiveLoader& loader );
+				virtual void Run() HELIUM_OVERRIDE;
+
+			private:
+				ArchiveLoader& m_Loader;
+			};
+
+			struct Request
+			{
+				Request();
+				void OnStatus( const ArchiveStatus& status );
+
+				ArchiveLoader*                     m_Loader;
+				FilePath                           m_Path;
+				int32_t                            m_Priority;
+				uint32_t                           m_Sequence;
+				Reflect::ObjectResolver*           m_Resolver;
+				ArchiveType                        m_ArchiveType;
+				uint32_t                           m_Flags;
+				LoadState                          m_State;
+				int                                m_Progress;
+				bool                               m_Cancel;
+				DynamicArray< Reflect::ObjectPtr > m_Objects;
+				std::string                        m_Error;
+			};
+
+			typedef std::map< Handle, Request* > RequestMap;
+
+			void     Work();
+			Request* Next();
+			void     Execute( Request& request );
+			bool     IsDone( Handle handle ) const;
+
+			RequestMap                m_Requests;
+			Handle                    m_NextHandle;
+			uint32_t                  m_NextSequence;
+			bool                      m_Stop;
+			mutable Mutex             m_Lock;
+			Condition                 m_Queued;
+			Condition                 m_Finished;
+			DynamicArray< Worker* >   m_Workers;
+		};
+	}
+}
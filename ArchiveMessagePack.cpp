@@ -1,5 +1,6 @@
 #include "PersistPch.h"
 #include "Persist/ArchiveMessagePack.h"
+#include "Persist/ArchiveEngine.h"
 
 #include "Foundation/Endian.h"
 #include "Foundation/FileStream.h"
@@ -13,6 +14,102 @@ using namespace Helium;
 using namespace Helium::Reflect;
 using namespace Helium::Persist;
 
+// message pack for the serialize engine, fields are keyed by name or by the CRC-32 of it
+class MessagePackPolicy
+{
+public:
+	static const bool InlineObjects = false;
+
+	MessagePackPolicy( MessagePackWriter& writer, uint32_t flags )
+		: m_Writer( writer )
+		, m_Flags( flags )
+	{
+	}
+
+	void BeginMap( uint32_t length )
+	{
+		m_Writer.BeginMap( length );
+	}
+
+	void EndMap()
+	{
+		m_Writer.EndMap();
+	}
+
+	void BeginArray( uint32_t length )
+	{
+		m_Writer.BeginArray( length );
+	}
+
+	void EndArray()
+	{
+		m_Writer.EndArray();
+	}
+
+	void Key( const Field* field )
+	{
+		if ( m_Flags & ArchiveFlags::StringCrc )
+		{
+			// write the crc of the field name (used to associate a field when reading)
+			uint32_t fieldNameCrc = Crc32( field->m_Name );
+			m_Writer.Write( fieldNameCrc );
+		}
+		else
+		{
+			// write the actual string
+			m_Writer.Write( field->m_Name );
+		}
+	}
+
+	void Key( const char* className )
+	{
+		HELIUM_BREAK(); // objects are never inline
+	}
+
+	void Null()
+	{
+		HELIUM_BREAK();
+	}
+
+	void Write( bool value )      { m_Writer.Write( value ); }
+	void Write( uint8_t value )   { m_Writer.Write( value ); }
+	void Write( uint16_t value )  { m_Writer.Write( value ); }
+	void Write( uint32_t value )  { m_Writer.Write( value ); }
+	void Write( uint64_t value )  { m_Writer.Write( value ); }
+	void Write( int8_t value )    { m_Writer.Write( value ); }
+	void Write( int16_t value )   { m_Writer.Write( value ); }
+	void Write( int32_t value )   { m_Writer.Write( value ); }
+	void Write( int64_t value )   { m_Writer.Write( value ); }
+	void Write( float32_t value ) { m_Writer.Write( value ); }
+	void Write( float64_t value ) { m_Writer.Write( value ); }
+
+	// complex values are a [real, imaginary] array
+	void Write( const std::complex< float32_t >& value )
+	{
+		m_Writer.BeginArray( 2 );
+		m_Writer.Write( value.real() );
+		m_Writer.Write( value.imag() );
+		m_Writer.EndArray();
+	}
+
+	void Write( const std::complex< float64_t >& value )
+	{
+		m_Writer.BeginArray( 2 );
+		m_Writer.Write( value.real() );
+		m_Writer.Write( value.imag() );
+		m_Writer.EndArray();
+	}
+
+	void Write( const String& value )
+	{
+		m_Writer.Write( value.GetData() );
+	}
+
+private:
+	MessagePackWriter& m_Writer;
+	uint32_t           m_Flags;
+};
+
 void ArchiveWriterMessagePack::WriteToStream( const ObjectPtr& object, Stream& stream, ObjectIdentifier* identifier, uint32_t flags )
 {
 	ArchiveWriterMessagePack archive ( &stream, identifier, flags );
@@ -51,8 +148,7 @@ void ArchiveWriterMessagePack::Open()
 	Log::Print(TXT("Opening file '%s'\n"), m_Path.c_str());
 #endif
 
-	FileStream* stream = new FileStream();
-	stream->Open( m_Path, FileStream::MODE_WRITE );
+	Stream* stream = OpenStream();
 	m_Stream.Reset( stream );
 	m_Writer.SetStream( stream );
 }
@@ -63,6 +159,15 @@ void ArchiveWriterMessagePack::Close()
 	m_Stream->Close(); 
 }
 
+void ArchiveWriterMessagePack::Reset( Stream* stream, ObjectIdentifier* identifier )
+{
+	ArchiveWriter::Reset( stream, identifier );
+
+	m_Stream.Reset( stream );
+	m_Stream.Orphan( true );
+	m_Writer.SetStream( stream );
+}
+
 void ArchiveWriterMessagePack::Write( const Reflect::ObjectPtr* objects, size_t count )
 {
 	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - MessagePack Write" );
@@ -71,281 +176,80 @@ void ArchiveWriterMessagePack::Write( const Reflect::ObjectPtr* objects, size_t
 	ArchiveStatus info( *this, ArchiveStates::Starting );
 	e_Status.Raise( info );
 
+	if ( m_Flags & ArchiveFlags::Dedupe )
+	{
+		Deduplicate( objects, count );
+	}
+
 	// the master object
 	m_Objects.AddArray( objects, count );
 
-	// begin top level array of objects
-	m_Writer.BeginArray();
+	Begin();
 
 	// objects can get changed during this iteration (in Identify), so use indices
 	for ( size_t index = 0; index < m_Objects.GetSize(); ++index )
 	{
-		Object* object = m_Objects.GetElement( index );
-		const MetaClass* objectClass = object->GetMetaClass();
-
-		m_Writer.BeginMap( 1 );
-
-		if ( m_Flags & ArchiveFlags::StringCrc )
-		{
-			uint32_t typeCrc = Crc32( objectClass->m_Name );
-			m_Writer.Write( typeCrc );
-		}
-		else
-		{
-			m_Writer.Write( objectClass->m_Name );
-		}
-
-		SerializeInstance( object, objectClass, object );
-
-		m_Writer.EndMap();
+		WriteNext( index );
 
 		info.m_State = ArchiveStates::ObjectProcessed;
 		info.m_Progress = (int)(((float)(index) / (float)m_Objects.GetSize()) * 100.0f);
 		e_Status.Raise( info );
 	}
 
-	// end top level array
-	m_Writer.EndArray();
+	End();
 
 	// notify completion of last object processed
 	info.m_State = ArchiveStates::ObjectProcessed;
 	info.m_Progress = 100;
 	e_Status.Raise( info );
 
-	// do cleanup
-	m_Stream->Flush();
-
 	// notify completion
 	info.m_State = ArchiveStates::Complete;
 	e_Status.Raise( info );
 }
 
-void ArchiveWriterMessagePack::SerializeInstance( void* instance, const MetaStruct* structure, Object* object )
+void ArchiveWriterMessagePack::Begin()
 {
-#if PERSIST_ARCHIVE_VERBOSE
-	Log::Print( TXT( "Serializing %s\n" ), structure->m_Name );
-#endif
-
-	// TODO: Declare a max depth for inheritance to save heap allocs -geoff
-	DynamicArray< const MetaStruct* > bases;
-	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
-	{
-		bases.Push( current );
-	}
-
-	// TODO: "Declare a max count for fields to save heap allocs -geoff
-	DynamicArray< const Field* > fields;
-	while ( !bases.IsEmpty() )
-	{
-		const MetaStruct* current = bases.Pop();
-		DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin();
-		DynamicArray< Field >::ConstIterator end = current->m_Fields.End();
-		for ( ; itr != end; ++itr )
-		{
-			const Field* field = &*itr;
-			if ( field->ShouldSerialize( instance, object ) )
-			{
-				fields.Push( field );
-			}
-		}
-	}
-
-	m_Writer.BeginMap( static_cast< uint32_t >( fields.GetSize() ) );
-	object->PreSerialize( NULL );
-
-	DynamicArray< const Field* >::ConstIterator itr = fields.Begin();
-	DynamicArray< const Field* >::ConstIterator end = fields.End();
-	for ( ; itr != end; ++itr )
-	{
-		const Field* field = *itr;
-		object->PreSerialize( field );
-		SerializeField( instance, field, object );
-		object->PostSerialize( field );
-	}
-
-	object->PostSerialize( NULL );
-	m_Writer.EndMap();
+	// begin top level array of objects
+	m_Writer.BeginArray();
 }
 
-void ArchiveWriterMessagePack::SerializeField( void* instance, const Field* field, Object* object )
+void ArchiveWriterMessagePack::WriteNext( size_t index )
 {
-#if PERSIST_ARCHIVE_VERBOSE
-	Log::Print(TXT("Serializing field %s\n"), field->m_Name);
-#endif
+	Object* object = m_Objects.GetElement( index );
+	const MetaClass* objectClass = object->GetMetaClass();
+
+	m_Writer.BeginMap( 1 );
 
 	if ( m_Flags & ArchiveFlags::StringCrc )
 	{
-		// write the crc of the field name (used to associate a field when reading)
-		uint32_t fieldNameCrc = Crc32( field->m_Name );
-		m_Writer.Write( fieldNameCrc );
+		uint32_t typeCrc = Crc32( objectClass->m_Name );
+		m_Writer.Write( typeCrc );
 	}
 	else
 	{
-		// write the actual string
-		m_Writer.Write( field->m_Name );
+		m_Writer.Write( objectClass->m_Name );
 	}
 
-	if ( field->m_Count > 1 )
-	{
-		m_Writer.BeginArray( field->m_Count );
+	MessagePackPolicy policy ( m_Writer, m_Flags );
+	SerializeEngine< MessagePackPolicy > engine ( *this, policy );
+	engine.SerializeInstance( object, objectClass, object, GetBaseline( index, objectClass ) );
 
-		for ( uint32_t i=0; i<field->m_Count; ++i )
-		{
-			SerializeTranslator( Pointer ( field, instance, object, i ), field->m_Translator, field, object );
-		}
-
-		m_Writer.EndArray();
-	}
-	else
-	{
-		SerializeTranslator( Pointer ( field, instance, object ), field->m_Translator, field, object );
-	}
+	m_Writer.EndMap();
 }
 
-void ArchiveWriterMessagePack::SerializeTranslator( Pointer pointer, Translator* translator, const Field* field, Object* object )
+void ArchiveWriterMessagePack::End()
 {
-	switch ( translator->GetMetaId() )
-	{
-	case MetaIds::ScalarTranslator:
-	case MetaIds::SimpleTranslator:
-	case MetaIds::EnumerationTranslator:
-	case MetaIds::PointerTranslator:
-	case MetaIds::TypeTranslator:
-		{
-			ScalarTranslator* scalar = static_cast< ScalarTranslator* >( translator );
-			switch ( scalar->m_Type )
-			{
-			case ScalarTypes::Boolean:
-				m_Writer.Write( pointer.As<bool>() );
-				break;
-
-			case ScalarTypes::Unsigned8:
-				m_Writer.Write( pointer.As<uint8_t>() );
-				break;
-
-			case ScalarTypes::Unsigned16:
-				m_Writer.Write( pointer.As<uint16_t>() );
-				break;
-
-			case ScalarTypes::Unsigned32:
-				m_Writer.Write( pointer.As<uint32_t>() );
-				break;
-
-			case ScalarTypes::Unsigned64:
-				m_Writer.Write( pointer.As<uint64_t>() );
-				break;
-
-			case ScalarTypes::Signed8:
-				m_Writer.Write( pointer.As<int8_t>() );
-				break;
-
-			case ScalarTypes::Signed16:
-				m_Writer.Write( pointer.As<int16_t>() );
-				break;
-
-			case ScalarTypes::Signed32:
-				m_Writer.Write( pointer.As<int32_t>() );
-				break;
-
-			case ScalarTypes::Signed64:
-				m_Writer.Write( pointer.As<int64_t>() );
-				break;
-
-			case ScalarTypes::Float32:
-				m_Writer.Write( pointer.As<float32_t>() );
-				break;
-
-			case ScalarTypes::Float64:
-				m_Writer.Write( pointer.As<float64_t>() );
-				break;
-
-			case ScalarTypes::String:
-				String str;
-				scalar->Print( pointer, str, this );
-				m_Writer.Write( str.GetData() );
-				break;
-			}
-			break;
-		}
-
-	case MetaIds::StructureTranslator:
-		{
-			StructureTranslator* structure = static_cast< StructureTranslator* >( translator );
-			SerializeInstance( pointer.m_Address, structure->GetMetaStruct(), object );
-			break;
-		}
-
-	case MetaIds::SetTranslator:
-		{
-			SetTranslator* set = static_cast< SetTranslator* >( translator );
-
-			Translator* itemTranslator = set->GetItemTranslator();
-			DynamicArray< Pointer > items;
-			set->GetItems( pointer, items );
-
-			uint32_t length = static_cast< uint32_t >( items.GetSize() );
-			m_Writer.BeginArray( length );
-
-			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
-			{
-				SerializeTranslator( *itr, itemTranslator, field, object );
-			}
-
-			m_Writer.EndArray();
-
-			break;
-		}
-
-	case MetaIds::SequenceTranslator:
-		{
-			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
-
-			Translator* itemTranslator = sequence->GetItemTranslator();
-			DynamicArray< Pointer > items;
-			sequence->GetItems( pointer, items );
-
-			uint32_t length = static_cast< uint32_t >( items.GetSize() );
-			m_Writer.BeginArray( length );
-
-			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
-			{
-				SerializeTranslator( *itr, itemTranslator, field, object );
-			}
-
-			m_Writer.EndArray();
-
-			break;
-		}
-
-	case MetaIds::AssociationTranslator:
-		{
-			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
-
-			Translator* keyTranslator = association->GetKeyTranslator();
-			Translator* valueTranslator = association->GetValueTranslator();
-			DynamicArray< Pointer > keys, values;
-			association->GetItems( pointer, keys, values );
-
-			uint32_t length = static_cast< uint32_t >( keys.GetSize() );
-			m_Writer.BeginMap( length );
-
-			for ( DynamicArray< Pointer >::Iterator keyItr = keys.Begin(), valueItr = values.Begin(), keyEnd = keys.End(), valueEnd = values.End();
-				keyItr != keyEnd && valueItr != valueEnd;
-				++keyItr, ++valueItr )
-			{
-				SerializeTranslator( *keyItr, keyTranslator, field, object );
-				SerializeTranslator( *valueItr, valueTranslator, field, object );
-			}
-
-			m_Writer.EndMap();
+	// end top level array
+	m_Writer.EndArray();
 
-			break;
-		}
+	// do cleanup
+	m_Stream->Flush();
+}
 
-	default:
-		// Unhandled reflection type in ArchiveWriterMessagePack::SerializeTranslator
-		HELIUM_BREAK();
-	}
+int64_t ArchiveWriterMessagePack::GetPosition() const
+{
+	return m_Stream->Tell();
 }
 
 void ArchiveReaderMessagePack::ReadFromStream( Stream& stream, ObjectPtr& object, ObjectResolver* resolver, uint32_t flags )
@@ -369,6 +273,8 @@ ArchiveReaderMessagePack::ArchiveReaderMessagePack( const FilePath& path, Object
 	: ArchiveReader( path, resolver, flags )
 	, m_Stream( NULL )
 	, m_Size( 0 )
+	, m_Array( false )
+	, m_Length( 0 )
 {
 }
 
@@ -376,6 +282,8 @@ ArchiveReaderMessagePack::ArchiveReaderMessagePack( Stream *stream, ObjectResolv
 	: ArchiveReader( resolver, flags )
 	, m_Stream( NULL )
 	, m_Size( 0 )
+	, m_Array( false )
+	, m_Length( 0 )
 {
 	m_Stream.Reset( stream );
 	m_Stream.Orphan( true );
@@ -393,8 +301,7 @@ void ArchiveReaderMessagePack::Open()
 	Log::Print(TXT("Opening file '%s'\n"), m_Path.c_str());
 #endif
 
-	FileStream* stream = new FileStream();
-	stream->Open( m_Path, FileStream::MODE_READ );
+	Stream* stream = OpenStream();
 	m_Stream.Reset( stream );
 	m_Reader.SetStream( stream );
 }
@@ -405,43 +312,89 @@ void ArchiveReaderMessagePack::Close()
 	m_Stream->Close(); 
 }
 
+void ArchiveReaderMessagePack::Reset( Stream* stream, ObjectResolver* resolver )
+{
+	ArchiveReader::Reset( stream, resolver );
+
+	m_Size = 0;
+	m_Array = false;
+	m_Length = 0;
+
+	m_Stream.Reset( stream );
+	m_Stream.Orphan( true );
+	m_Reader.SetStream( stream );
+}
+
 void ArchiveReaderMessagePack::Read( DynamicArray< ObjectPtr >& objects )
 {
 	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - MessagePack Read" );
 
-	Start();
-
 	m_Objects = objects;
 
-	if ( HELIUM_VERIFY( m_Reader.IsArray() ) )
+	Begin();
+
+	for ( uint32_t i=0; ReadObject( i ); i++ )
 	{
-		uint32_t length = m_Reader.ReadArrayLength();
+		ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
+		info.m_Progress = (int)(((float)(m_Stream->Tell()) / (float)m_Size) * 100.0f);
+		e_Status.Raise( info );
+		m_Abort |= info.m_Abort;
+		if ( m_Abort )
+		{
+			break;
+		}
+	}
 
-		m_Objects.Resize( length );
+	End();
 
-		m_Reader.BeginArray( length );
+	Resolve();
 
-		for ( uint32_t i=0; i<length; i++ )
-		{
-			ObjectPtr& object( m_Objects[ i ] );
-			ReadNext( object, i );
-
-			ArchiveStatus info( *this, ArchiveStates::ObjectProcessed );
-			info.m_Progress = (int)(((float)(m_Stream->Tell()) / (float)m_Size) * 100.0f);
-			e_Status.Raise( info );
-			m_Abort |= info.m_Abort;
-			if ( m_Abort )
-			{
-				break;
-			}
-		}
+	objects = m_Objects;
+}
 
+void ArchiveReaderMessagePack::Begin()
+{
+	Start();
+
+	m_Array = HELIUM_VERIFY( m_Reader.IsArray() );
+	m_Length = 0;
+	if ( m_Array )
+	{
+		m_Length = m_Reader.ReadArrayLength();
+
+		m_Objects.Resize( m_Length );
+
+		m_Reader.BeginArray( m_Length );
+	}
+}
+
+bool ArchiveReaderMessagePack::ReadObject( size_t index )
+{
+	if ( index >= m_Length )
+	{
+		return false;
+	}
+
+	ReadNext( m_Objects[ index ], index );
+	return true;
+}
+
+void ArchiveReaderMessagePack::End()
+{
+	if ( m_Array )
+	{
 		m_Reader.EndArray();
 	}
+}
 
-	Resolve();
+int64_t ArchiveReaderMessagePack::GetPosition() const
+{
+	return m_Stream->Tell();
+}
 
-	objects = m_Objects;
+int64_t ArchiveReaderMessagePack::GetSize() const
+{
+	return m_Size;
 }
 
 void ArchiveReaderMessagePack::Start()
@@ -450,9 +403,8 @@ void ArchiveReaderMessagePack::Start()
 	e_Status.Raise( info );
 	m_Abort = false;
 
-	// determine the size of the input stream
-	m_Stream->Seek(0, SeekOrigins::End);
-	m_Size = m_Stream->Tell();
+	// determine the size of the input stream (without seeking, which would throw away what a read ahead stream prefetched)
+	m_Size = m_Stream->GetSize();
 	m_Stream->Seek(0, SeekOrigins::Begin);
 
 	// fail on an empty input stream
@@ -493,10 +445,10 @@ bool ArchiveReaderMessagePack::ReadNext( ObjectPtr& object, size_t index )
 		const MetaClass* objectClass = NULL;
 		if ( objectClassCrc != 0 )
 		{
-			objectClass = Registry::GetInstance()->GetMetaClass( objectClassCrc );
+			objectClass = FindClass( objectClassCrc );
 		}
 
-		if ( !object && HELIUM_VERIFY( objectClass ) )
+		if ( !object && HELIUM_VERIFY( objectClass ) && AcceptClass( objectClass, index ) )
 		{
 			object = AllocateObject( objectClass, index );
 		}
@@ -522,7 +474,12 @@ void ArchiveReaderMessagePack::DeserializeInstance( void* instance, const MetaSt
 	Log::Print(TXT("Deserializing %s\n"), structure->m_Name);
 #endif
 
-	object->PreDeserialize( NULL );
+	// staged copies aren't the object's yet, EndMerge calls back for what they change once they are merged
+	bool staged = m_Staging != 0;
+	if ( !staged )
+	{
+		object->PreDeserialize( NULL );
+	}
 
 	if ( HELIUM_VERIFY( m_Reader.IsMap() ) )
 	{
@@ -543,14 +500,41 @@ void ArchiveReaderMessagePack::DeserializeInstance( void* instance, const MetaSt
 				fieldCrc = Helium::Crc32( fieldStr.GetData() );
 			}
 
-			const Field* field = structure->FindFieldByName( fieldCrc );
-			if ( field )
+			const SchemaField* mapped = FindField( structure, fieldCrc, NULL );
+			if ( mapped )
 			{
-				object->PreDeserialize( field );
+				const Field* field = mapped->m_Field;
+				if ( !mapped->m_Converter && CanMerge( field ) )
+				{
+					Pointer current ( field, instance, object );
+					Variable staged ( field->m_Translator );
+					BeginMerge( current, staged, field->m_Translator );
+					DeserializeTranslator( staged, field->m_Translator, field, object );
+					EndMerge( staged, current, field, object );
+					continue;
+				}
 
-				DeserializeField( instance, field, object );
+				if ( !staged )
+				{
+					object->PreDeserialize( field );
+				}
 
-				object->PostDeserialize( field );
+				if ( mapped->m_Converter )
+				{
+					Variable oldValue ( mapped->m_Translator );
+					DeserializeTranslator( oldValue, mapped->m_Translator, field, object );
+					mapped->m_Converter( oldValue, Pointer ( field, instance, object ), object );
+				}
+				else
+				{
+					DeserializeField( instance, field, object );
+				}
+
+				if ( !staged )
+				{
+					object->PostDeserialize( field );
+					Changed( object, field );
+				}
 			}
 			else
 			{
@@ -565,7 +549,10 @@ void ArchiveReaderMessagePack::DeserializeInstance( void* instance, const MetaSt
 		m_Reader.Skip();
 	}
 
-	object->PostDeserialize( NULL );
+	if ( !staged )
+	{
+		object->PostDeserialize( NULL );
+	}
 }
 
 void ArchiveReaderMessagePack::DeserializeField( void* instance, const Field* field, Object* object )
@@ -692,7 +679,8 @@ void ArchiveReaderMessagePack::DeserializeTranslator( Pointer pointer, Translato
 			{
 				String str;
 				m_Reader.Read( str );
-				scalar->Parse( str, pointer, this, m_Flags | ArchiveFlags::Notify ? true : false );
+				// DeserializeInstance notifies for the whole field (see Changed), for every type of value
+				scalar->Parse( str, pointer, this, false );
 			}
 		}
 		else
@@ -702,10 +690,20 @@ void ArchiveReaderMessagePack::DeserializeTranslator( Pointer pointer, Translato
 	}
 	else if ( m_Reader.IsArray() )
 	{
-		if ( translator->GetMetaId() == MetaIds::SetTranslator )
+		ScalarTranslator* scalar = translator->IsA( MetaIds::ScalarTranslator ) ? static_cast< ScalarTranslator* >( translator ) : NULL;
+		if ( scalar && scalar->m_Type == ScalarTypes::ComplexFloat32 )
+		{
+			ReadComplex( pointer.As< std::complex< float32_t > >() );
+		}
+		else if ( scalar && scalar->m_Type == ScalarTypes::ComplexFloat64 )
+		{
+			ReadComplex( pointer.As< std::complex< float64_t > >() );
+		}
+		else if ( translator->GetMetaId() == MetaIds::SetTranslator )
 		{
 			SetTranslator* set = static_cast< SetTranslator* >( translator );
 			Translator* itemTranslator = set->GetItemTranslator();
+			ResetContainer( set, pointer );
 			uint32_t length = m_Reader.ReadArrayLength();
 			m_Reader.BeginArray( length );
 			for ( uint32_t i=0; i<length; ++i )
@@ -723,10 +721,13 @@ void ArchiveReaderMessagePack::DeserializeTranslator( Pointer pointer, Translato
 			uint32_t length = m_Reader.ReadArrayLength();
 			sequence->SetLength(pointer, length);
 			m_Reader.BeginArray( length );
-			for ( uint32_t i=0; i<length; ++i )
+			if ( !DeserializeItems( pointer, sequence, length, field, object ) )
 			{
-				Pointer item = sequence->GetItem( pointer, i );
-				DeserializeTranslator( item, itemTranslator, field, object );
+				for ( uint32_t i=0; i<length; ++i )
+				{
+					Pointer item = sequence->GetItem( pointer, i );
+					DeserializeTranslator( item, itemTranslator, field, object );
+				}
 			}
 			m_Reader.EndArray();
 		}
@@ -747,6 +748,7 @@ void ArchiveReaderMessagePack::DeserializeTranslator( Pointer pointer, Translato
 			AssociationTranslator* assocation = static_cast< AssociationTranslator* >( translator );
 			Translator* keyTranslator = assocation->GetKeyTranslator();
 			Translator* valueTranslator = assocation->GetValueTranslator();
+			ResetContainer( assocation, pointer );
 			uint32_t length = m_Reader.ReadMapLength();
 			m_Reader.BeginMap( length );
 			for ( uint32_t i=0; i<length; ++i )
@@ -769,3 +771,268 @@ void ArchiveReaderMessagePack::DeserializeTranslator( Pointer pointer, Translato
 		m_Reader.Skip(); // no implicit conversion, discard data
 	}
 }
+
+// the scalar kernels' reads, the same ones DeserializeTranslator makes, false if the next value isn't of the kind
+static inline bool ReadScalar( MessagePackReader& reader, bool& scalar )
+{
+	if ( !reader.IsBoolean() )
+	{
+		return false;
+	}
+
+	reader.Read( scalar, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, uint8_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, uint16_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, uint32_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, uint64_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, int8_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, int16_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, int32_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, int64_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, float32_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+static inline bool ReadScalar( MessagePackReader& reader, float64_t& scalar )
+{
+	if ( !reader.IsNumber() )
+	{
+		return false;
+	}
+
+	bool clamp = true;
+	reader.ReadNumber( scalar, clamp, NULL );
+	return true;
+}
+
+template< class T >
+void ArchiveReaderMessagePack::ReadComplex( std::complex< T >& value )
+{
+	uint32_t length = m_Reader.ReadArrayLength();
+	m_Reader.BeginArray( length );
+
+	T parts[ 2 ] = { value.real(), value.imag() };
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		if ( i < 2 && m_Reader.IsNumber() )
+		{
+			bool clamp = true;
+			m_Reader.ReadNumber( parts[ i ], clamp, NULL );
+		}
+		else
+		{
+			m_Reader.Skip(); // no implicit conversion, discard data
+		}
+	}
+
+	m_Reader.EndArray();
+	value = std::complex< T >( parts[ 0 ], parts[ 1 ] );
+}
+
+template< class T >
+void ArchiveReaderMessagePack::DeserializeScalars( Pointer pointer, SequenceTranslator* sequence, uint32_t length, const Field* field, Object* object )
+{
+	Translator* itemTranslator = sequence->GetItemTranslator();
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		Pointer item = sequence->GetItem( pointer, i );
+		if ( !ReadScalar( m_Reader, item.As< T >() ) )
+		{
+			DeserializeTranslator( item, itemTranslator, field, object );
+		}
+	}
+}
+
+bool ArchiveReaderMessagePack::DeserializeItems( Pointer pointer, SequenceTranslator* sequence, uint32_t length, const Field* field, Object* object )
+{
+	Translator* itemTranslator = sequence->GetItemTranslator();
+
+	if ( itemTranslator->IsA( MetaIds::ScalarTranslator ) )
+	{
+		ScalarTranslator* scalar = static_cast< ScalarTranslator* >( itemTranslator );
+		switch ( scalar->m_Type )
+		{
+		case ScalarTypes::Boolean:
+			DeserializeScalars< bool >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned8:
+			DeserializeScalars< uint8_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned16:
+			DeserializeScalars< uint16_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned32:
+			DeserializeScalars< uint32_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Unsigned64:
+			DeserializeScalars< uint64_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Signed8:
+			DeserializeScalars< int8_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Signed16:
+			DeserializeScalars< int16_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Signed32:
+			DeserializeScalars< int32_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Signed64:
+			DeserializeScalars< int64_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Float32:
+			DeserializeScalars< float32_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::Float64:
+			DeserializeScalars< float64_t >( pointer, sequence, length, field, object );
+			return true;
+
+		case ScalarTypes::String:
+			for ( uint32_t i=0; i<length; ++i )
+			{
+				Pointer item = sequence->GetItem( pointer, i );
+				if ( m_Reader.IsRaw() )
+				{
+					String str;
+					m_Reader.Read( str );
+					scalar->Parse( str, item, this, false );
+				}
+				else
+				{
+					DeserializeTranslator( item, itemTranslator, field, object );
+				}
+			}
+			return true;
+
+		default:
+			return false;
+		}
+	}
+	else if ( itemTranslator->GetMetaId() == MetaIds::StructureTranslator )
+	{
+		const MetaStruct* structure = static_cast< StructureTranslator* >( itemTranslator )->GetMetaStruct();
+		for ( uint32_t i=0; i<length; ++i )
+		{
+			Pointer item = sequence->GetItem( pointer, i );
+			if ( m_Reader.IsMap() )
+			{
+				DeserializeInstance( item.m_Address, structure, object );
+			}
+			else
+			{
+				m_Reader.Skip(); // no implicit conversion, discard data
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
@@ -7,6 +7,8 @@
 
 #include "Persist/Archive.h"
 
+#include <complex>
+
 namespace Helium
 {
 	namespace Persist
@@ -23,15 +25,16 @@ namespace Helium
 			virtual ArchiveType GetType() const HELIUM_OVERRIDE;
 			virtual void Open() HELIUM_OVERRIDE;
 			virtual void Close() HELIUM_OVERRIDE; 
+			virtual void Reset( Stream* stream, Reflect::ObjectIdentifier* identifier = NULL ) HELIUM_OVERRIDE;
 
 		protected:
 			virtual void Write( const Reflect::ObjectPtr* objects, size_t count );
+			virtual void Begin() HELIUM_OVERRIDE;
+			virtual void WriteNext( size_t index ) HELIUM_OVERRIDE;
+			virtual void End() HELIUM_OVERRIDE;
+			virtual int64_t GetPosition() const HELIUM_OVERRIDE;
 
 		private:
-			void SerializeInstance( void* instance, const Reflect::MetaStruct* structure, Reflect::Object* object );
-			void SerializeField( void* instance, const Reflect::Field* field, Reflect::Object* object );
-			void SerializeTranslator( Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
-
 			AutoPtr< Stream > m_Stream;
 			MessagePackWriter m_Writer;
 		};
@@ -48,9 +51,15 @@ namespace Helium
 			virtual ArchiveType GetType() const HELIUM_OVERRIDE;
 			virtual void Open() HELIUM_OVERRIDE;
 			virtual void Close() HELIUM_OVERRIDE; 
+			virtual void Reset( Stream* stream, Reflect::ObjectResolver* resolver = NULL ) HELIUM_OVERRIDE;
 
 		protected:
 			virtual void Read( DynamicArray< Reflect::ObjectPtr >& objects ) HELIUM_OVERRIDE;
+			virtual void Begin() HELIUM_OVERRIDE;
+			virtual bool ReadObject( size_t index ) HELIUM_OVERRIDE;
+			virtual void End() HELIUM_OVERRIDE;
+			virtual int64_t GetPosition() const HELIUM_OVERRIDE;
+			virtual int64_t GetSize() const HELIUM_OVERRIDE;
 
 		private:
 			void Start();
@@ -59,10 +68,22 @@ namespace Helium
 			void DeserializeField( void* instance, const Reflect::Field* field, Reflect::Object* object );
 			void DeserializeTranslator( Reflect::Pointer pointer, Reflect::Translator* translator, const Reflect::Field* field, Reflect::Object* object );
 
+			// a sequence's items in a loop picked once for its item translator (scalars and structures get their own),
+			//  items that were written as something else go through DeserializeTranslator, false leaves all of them to it
+			bool DeserializeItems( Reflect::Pointer pointer, Reflect::SequenceTranslator* sequence, uint32_t length, const Reflect::Field* field, Reflect::Object* object );
+			template< class T >
+			void DeserializeScalars( Reflect::Pointer pointer, Reflect::SequenceTranslator* sequence, uint32_t length, const Reflect::Field* field, Reflect::Object* object );
+
+			// a [real, imaginary] array
+			template< class T >
+			void ReadComplex( std::complex< T >& value );
+
 		private:
 			AutoPtr< Stream > m_Stream;
 			MessagePackReader m_Reader;
 			int64_t           m_Size;
+			bool              m_Array;  // the stream starts with the array of objects
+			uint32_t          m_Length; // of that array
 		};
 	}
 }
\ No newline at end of file
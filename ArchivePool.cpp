@@ -0,0 +1,106 @@
+#include "PersistPch.h"
+#include "Persist/ArchivePool.h"
+
+#include "Platform/Thread.h"
+
+#include <map>
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+// spares kept for each type and flags, enough for archives nested in the writing of another (like Dedupe's)
+static const size_t MaxSpares = 4;
+
+typedef std::pair< ArchiveType, uint32_t > PoolKey;
+
+struct Pool
+{
+	std::multimap< PoolKey, SmartPtr< ArchiveReader > > m_Readers;
+	std::multimap< PoolKey, SmartPtr< ArchiveWriter > > m_Writers;
+};
+
+static ThreadLocalPointer g_Pool;
+
+static Pool& GetPool()
+{
+	Pool* pool = static_cast< Pool* >( g_Pool.GetPointer() );
+	if ( !pool )
+	{
+		pool = new Pool;
+		g_Pool.SetPointer( pool );
+	}
+
+	return *pool;
+}
+
+SmartPtr< ArchiveReader > ArchivePool::GetReader( Stream* stream, ArchiveType archiveType, ObjectResolver* resolver, uint32_t flags )
+{
+	Pool& pool = GetPool();
+
+	std::multimap< PoolKey, SmartPtr< ArchiveReader > >::iterator found = pool.m_Readers.find( PoolKey ( archiveType, flags ) );
+	if ( found == pool.m_Readers.end() )
+	{
+		return ArchiveReader::GetReader( stream, archiveType, resolver, flags );
+	}
+
+	SmartPtr< ArchiveReader > reader = found->second;
+	pool.m_Readers.erase( found );
+	reader->Reset( stream, resolver );
+	return reader;
+}
+
+SmartPtr< ArchiveWriter > ArchivePool::GetWriter( Stream* stream, ArchiveType archiveType, ObjectIdentifier* identifier, uint32_t flags )
+{
+	Pool& pool = GetPool();
+
+	std::multimap< PoolKey, SmartPtr< ArchiveWriter > >::iterator found = pool.m_Writers.find( PoolKey ( archiveType, flags ) );
+	if ( found == pool.m_Writers.end() )
+	{
+		return ArchiveWriter::GetWriter( stream, archiveType, identifier, flags );
+	}
+
+	SmartPtr< ArchiveWriter > writer = found->second;
+	pool.m_Writers.erase( found );
+	writer->Reset( stream, identifier );
+	return writer;
+}
+
+void ArchivePool::Recycle( ArchiveReader* reader )
+{
+	HELIUM_ASSERT( reader );
+
+	// let go of the objects now, not when the reader is next used
+	reader->Reset( NULL );
+
+	Pool& pool = GetPool();
+	PoolKey key ( reader->GetType(), reader->GetFlags() );
+	if ( pool.m_Readers.count( key ) < MaxSpares )
+	{
+		pool.m_Readers.insert( std::make_pair( key, SmartPtr< ArchiveReader > ( reader ) ) );
+	}
+}
+
+void ArchivePool::Recycle( ArchiveWriter* writer )
+{
+	HELIUM_ASSERT( writer );
+
+	writer->Reset( NULL );
+
+	Pool& pool = GetPool();
+	PoolKey key ( writer->GetType(), writer->GetFlags() );
+	if ( pool.m_Writers.count( key ) < MaxSpares )
+	{
+		pool.m_Writers.insert( std::make_pair( key, SmartPtr< ArchiveWriter > ( writer ) ) );
+	}
+}
+
+void ArchivePool::Clear()
+{
+	Pool* pool = static_cast< Pool* >( g_Pool.GetPointer() );
+	if ( pool )
+	{
+		g_Pool.SetPointer( NULL );
+		delete pool;
+	}
+}
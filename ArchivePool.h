@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Foundation/SmartPtr.h"
+#include "Foundation/Stream.h"
+
+#include "Persist/Archive.h"
+
+namespace Helium
+{
+	namespace Persist
+	{
+		//
+		// Pool: spare readers and writers for each thread, reset onto the next stream instead of constructed for it,
+		//  so the buffers they grew (input, DOM, object and fixup arrays) are still there for the next small archive
+		//
+
+		class HELIUM_PERSIST_API ArchivePool
+		{
+		public:
+			// this thread's spare of the type and flags, reset onto stream (which it doesn't own), or a new one
+			static SmartPtr< ArchiveReader > GetReader( Stream* stream, ArchiveType archiveType, Reflect::ObjectResolver* resolver = NULL, uint32_t flags = 0x0 );
+			static SmartPtr< ArchiveWriter > GetWriter( Stream* stream, ArchiveType archiveType, Reflect::ObjectIdentifier* identifier = NULL, uint32_t flags = 0x0 );
+
+			// hand one back once it is closed (it lets go of its stream and objects then), on the thread it came from
+			//  the pool keeps a few of each type and flags, the rest are released
+			static void Recycle( ArchiveReader* reader );
+			static void Recycle( ArchiveWriter* writer );
+
+			// release this thread's spares, threads that used the pool should call this before they exit
+			static void Clear();
+		};
+	}
+}
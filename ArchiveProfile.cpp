@@ -0,0 +1,267 @@
+#include "PersistPch.h"
+#include "Persist/ArchiveProfile.h"
+
+#include "Platform/Timer.h"
+
+#include "Persist/ArchiveJson.h"
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+typedef DynamicArray< DynamicArray< uint32_t > > ChildArray;
+
+// the children of every node, and the top-level nodes at the end
+static void GetChildren( const DynamicArray< ArchiveProfileNode >& nodes, ChildArray& children )
+{
+	children.Resize( nodes.GetSize() + 1 );
+	for ( uint32_t i=0; i<nodes.GetSize(); ++i )
+	{
+		uint32_t parent = nodes[ i ].m_Parent;
+		children[ parent == Invalid< uint32_t >() ? nodes.GetSize() : parent ].Push( i );
+	}
+}
+
+static void WriteString( Stream& stream, const String& str )
+{
+	stream.Write( str.GetData(), str.GetSize(), 1 );
+}
+
+static void WriteTextNode( Stream& stream, const DynamicArray< ArchiveProfileNode >& nodes, const ChildArray& children, uint32_t index, uint32_t depth, uint64_t total )
+{
+	const ArchiveProfileNode& node = nodes[ index ];
+
+	for ( uint32_t i=0; i<depth; ++i )
+	{
+		stream.Write( "\t", 1, 1 );
+	}
+
+	String str;
+	str.Format(
+		"%s%s: %" PRIu32 " written, %" PRIu64 " bytes (%.1f%%), %.3f ms\n",
+		node.m_Field ? "." : "",
+		node.m_Name,
+		node.m_Count,
+		node.m_Bytes,
+		total ? 100.0 * node.m_Bytes / total : 0.0,
+		TimerTicksToMilliseconds( node.m_Ticks ) );
+	WriteString( stream, str );
+
+	const DynamicArray< uint32_t >& nested = children[ index ];
+	for ( DynamicArray< uint32_t >::ConstIterator itr = nested.Begin(), end = nested.End(); itr != end; ++itr )
+	{
+		WriteTextNode( stream, nodes, children, *itr, depth + 1, total );
+	}
+}
+
+static void WriteJsonNode( RapidJsonWriter& writer, const DynamicArray< ArchiveProfileNode >& nodes, const ChildArray& children, uint32_t index )
+{
+	const ArchiveProfileNode& node = nodes[ index ];
+
+	writer.StartObject();
+	writer.String( "name" );
+	writer.String( node.m_Name );
+	writer.String( "field" );
+	writer.Bool( node.m_Field );
+	writer.String( "count" );
+	writer.Uint( node.m_Count );
+	writer.String( "bytes" );
+	writer.Uint64( node.m_Bytes );
+	writer.String( "milliseconds" );
+	writer.Double( TimerTicksToMilliseconds( node.m_Ticks ) );
+
+	const DynamicArray< uint32_t >& nested = children[ index ];
+	if ( !nested.IsEmpty() )
+	{
+		writer.String( "children" );
+		writer.StartArray();
+		for ( DynamicArray< uint32_t >::ConstIterator itr = nested.Begin(), end = nested.End(); itr != end; ++itr )
+		{
+			WriteJsonNode( writer, nodes, children, *itr );
+		}
+		writer.EndArray();
+	}
+
+	writer.EndObject();
+}
+
+// returns where the event ends, its children are laid end to end from where it starts
+static double WriteTraceNode( RapidJsonWriter& writer, const DynamicArray< ArchiveProfileNode >& nodes, const ChildArray& children, uint32_t index, double start )
+{
+	const ArchiveProfileNode& node = nodes[ index ];
+	double duration = TimerTicksToMilliseconds( node.m_Ticks ) * 1000.0;
+
+	writer.StartObject();
+	writer.String( "name" );
+	writer.String( node.m_Name );
+	writer.String( "cat" );
+	writer.String( node.m_Field ? "field" : "structure" );
+	writer.String( "ph" );
+	writer.String( "X" );
+	writer.String( "ts" );
+	writer.Double( start );
+	writer.String( "dur" );
+	writer.Double( duration );
+	writer.String( "pid" );
+	writer.Uint( 0 );
+	writer.String( "tid" );
+	writer.Uint( 0 );
+	writer.String( "args" );
+	writer.StartObject();
+	writer.String( "count" );
+	writer.Uint( node.m_Count );
+	writer.String( "bytes" );
+	writer.Uint64( node.m_Bytes );
+	writer.EndObject();
+	writer.EndObject();
+
+	double child = start;
+	const DynamicArray< uint32_t >& nested = children[ index ];
+	for ( DynamicArray< uint32_t >::ConstIterator itr = nested.Begin(), end = nested.End(); itr != end; ++itr )
+	{
+		child = WriteTraceNode( writer, nodes, children, *itr, child );
+	}
+
+	return start + duration;
+}
+
+ArchiveProfile::ArchiveProfile()
+{
+}
+
+void ArchiveProfile::Clear()
+{
+	m_Nodes.Clear();
+	m_Children.clear();
+	m_Stack.Clear();
+}
+
+const DynamicArray< ArchiveProfileNode >& ArchiveProfile::GetNodes() const
+{
+	return m_Nodes;
+}
+
+void ArchiveProfile::WriteText( Stream& stream ) const
+{
+	ChildArray children;
+	GetChildren( m_Nodes, children );
+
+	const DynamicArray< uint32_t >& roots = children.GetLast();
+	uint64_t total = 0;
+	for ( DynamicArray< uint32_t >::ConstIterator itr = roots.Begin(), end = roots.End(); itr != end; ++itr )
+	{
+		total += m_Nodes[ *itr ].m_Bytes;
+	}
+
+	for ( DynamicArray< uint32_t >::ConstIterator itr = roots.Begin(), end = roots.End(); itr != end; ++itr )
+	{
+		WriteTextNode( stream, m_Nodes, children, *itr, 0, total );
+	}
+
+	stream.Flush();
+}
+
+void ArchiveProfile::WriteJson( Stream& stream ) const
+{
+	ChildArray children;
+	GetChildren( m_Nodes, children );
+
+	RapidJsonOutputStream output;
+	output.SetStream( &stream );
+	RapidJsonWriter writer ( output );
+	writer.SetIndent( '\t', 1 );
+
+	const DynamicArray< uint32_t >& roots = children.GetLast();
+	writer.StartArray();
+	for ( DynamicArray< uint32_t >::ConstIterator itr = roots.Begin(), end = roots.End(); itr != end; ++itr )
+	{
+		WriteJsonNode( writer, m_Nodes, children, *itr );
+	}
+	writer.EndArray();
+
+	stream.Flush();
+}
+
+void ArchiveProfile::WriteChromeTrace( Stream& stream ) const
+{
+	ChildArray children;
+	GetChildren( m_Nodes, children );
+
+	RapidJsonOutputStream output;
+	output.SetStream( &stream );
+	RapidJsonWriter writer ( output );
+	writer.SetIndent( '\t', 1 );
+
+	const DynamicArray< uint32_t >& roots = children.GetLast();
+	double start = 0.0;
+	writer.StartObject();
+	writer.String( "traceEvents" );
+	writer.StartArray();
+	for ( DynamicArray< uint32_t >::ConstIterator itr = roots.Begin(), end = roots.End(); itr != end; ++itr )
+	{
+		start = WriteTraceNode( writer, m_Nodes, children, *itr, start );
+	}
+	writer.EndArray();
+	writer.String( "displayTimeUnit" );
+	writer.String( "ms" );
+	writer.EndObject();
+
+	stream.Flush();
+}
+
+void ArchiveProfile::Enter( const MetaStruct* structure, int64_t position )
+{
+	Enter( structure, structure->m_Name, false, position );
+}
+
+void ArchiveProfile::Enter( const Field* field, int64_t position )
+{
+	Enter( field, field->m_Name, true, position );
+}
+
+void ArchiveProfile::Leave( int64_t position )
+{
+	HELIUM_ASSERT( !m_Stack.IsEmpty() );
+
+	const Frame& frame = m_Stack.GetLast();
+	ArchiveProfileNode& node = m_Nodes[ frame.m_Node ];
+	node.m_Count++;
+	node.m_Bytes += position - frame.m_Position;
+	node.m_Ticks += TimerGetClock() - frame.m_Start;
+	m_Stack.Pop();
+}
+
+void ArchiveProfile::Enter( const void* key, const char* name, bool field, int64_t position )
+{
+	uint32_t parent = m_Stack.IsEmpty() ? Invalid< uint32_t >() : m_Stack.GetLast().m_Node;
+
+	// the same structure or field nested somewhere else is another node, so bytes stay with their parents
+	std::pair< uint32_t, const void* > path ( parent, key );
+	std::map< std::pair< uint32_t, const void* >, uint32_t >::const_iterator found = m_Children.find( path );
+
+	uint32_t index;
+	if ( found != m_Children.end() )
+	{
+		index = found->second;
+	}
+	else
+	{
+		index = static_cast< uint32_t >( m_Nodes.GetSize() );
+		m_Children[ path ] = index;
+
+		ArchiveProfileNode node;
+		node.m_Name = name;
+		node.m_Field = field;
+		node.m_Parent = parent;
+		node.m_Count = 0;
+		node.m_Bytes = 0;
+		node.m_Ticks = 0;
+		m_Nodes.Push( node );
+	}
+
+	Frame frame;
+	frame.m_Node = index;
+	frame.m_Position = position;
+	frame.m_Start = TimerGetClock();
+	m_Stack.Push( frame );
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Foundation/DynamicArray.h"
+#include "Foundation/Stream.h"
+
+#include "Reflect/MetaClass.h"
+
+#include "Persist/API.h"
+
+#include <map>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		struct ArchiveProfileNode
+		{
+			const char* m_Name;   // of the structure or field
+			bool        m_Field;
+			uint32_t    m_Parent; // node index, invalid for top-level objects
+			uint32_t    m_Count;  // times written
+			uint64_t    m_Bytes;  // encoded, including what is nested in it (uncompressed)
+			uint64_t    m_Ticks;  // spent, including what is nested in it
+		};
+
+		//
+		// Profile: where a writer's bytes and time go, as a tree of structures and the fields in them,
+		//  anything nested in a field (structures, owned objects) is attributed to that field
+		//
+
+		class HELIUM_PERSIST_API ArchiveProfile
+		{
+		public:
+			ArchiveProfile();
+
+			// profiles accumulate over every write they are given to (ArchiveWriter::SetProfile)
+			void Clear();
+
+			// parents before their children
+			const DynamicArray< ArchiveProfileNode >& GetNodes() const;
+
+			// indented tree, JSON tree, or Chrome's trace event format (chrome://tracing, or any flamegraph viewer of it),
+			//  where the events are laid end to end with their accumulated durations rather than when they happened
+			void WriteText( Stream& stream ) const;
+			void WriteJson( Stream& stream ) const;
+			void WriteChromeTrace( Stream& stream ) const;
+
+			// writers call these around every structure and field, with their position in bytes
+			void Enter( const Reflect::MetaStruct* structure, int64_t position );
+			void Enter( const Reflect::Field* field, int64_t position );
+			void Leave( int64_t position );
+
+		private:
+			void Enter( const void* key, const char* name, bool field, int64_t position );
+
+			struct Frame
+			{
+				uint32_t m_Node;
+				int64_t  m_Position;
+				uint64_t m_Start;
+			};
+
+			DynamicArray< ArchiveProfileNode >                     m_Nodes;
+			std::map< std::pair< uint32_t, const void* >, uint32_t > m_Children; // parent, structure or field -> node
+			DynamicArray< Frame >                                  m_Stack;    // being written
+		};
+	}
+}
@@ -0,0 +1,162 @@
+#include "PersistPch.h"
+#include "Persist/ArchiveSnapshot.h"
+
+#include "Platform/Exception.h"
+
+#include <exception>
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+ArchiveSnapshot::SaveThread::SaveThread( ArchiveSnapshot& snapshot )
+	: m_Snapshot( snapshot )
+{
+}
+
+void ArchiveSnapshot::SaveThread::Run()
+{
+	m_Snapshot.Write();
+}
+
+ArchiveSnapshot::Capture::Capture( ArchiveSnapshot& snapshot, ObjectIdentifier* identifier )
+	: Cloner( identifier, 0x0 )
+	, m_Snapshot( snapshot )
+{
+}
+
+void ArchiveSnapshot::Capture::OnIdentified( const ObjectPtr& object, const Name& identity )
+{
+	// the writer only ever asks for its identity
+	m_Snapshot.m_Identities[ object.Ptr() ] = identity;
+}
+
+void ArchiveSnapshot::Capture::OnCloned( const ObjectPtr& object, const ObjectPtr& clone )
+{
+	// writers tell shared objects from owned ones by their reference count, the copy may have fewer holders than the original
+	if ( reinterpret_cast< RefCountProxy< Reflect::Object >* >( object.GetProxy() )->GetStrongRefCount() > 1 )
+	{
+		m_Snapshot.m_Pinned.Push( clone );
+	}
+}
+
+ArchiveSnapshot::ArchiveSnapshot( const ObjectPtr* objects, size_t count, ObjectIdentifier* identifier )
+	: m_HasIdentifier( identifier != NULL )
+	, m_ArchiveType( ArchiveTypes::Auto )
+	, m_Flags( 0 )
+	, m_Saving( false )
+	, m_Success( false )
+	, m_Thread( NULL )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Snapshot" );
+
+	// no callbacks, the writer runs the serialization ones on the copies
+	Capture capture ( *this, identifier );
+	m_Objects.Reserve( count );
+	for ( size_t i=0; i<count; ++i )
+	{
+		m_Objects.Push( capture.Clone( objects[ i ] ) );
+	}
+}
+
+ArchiveSnapshot::~ArchiveSnapshot()
+{
+	Finish();
+}
+
+void ArchiveSnapshot::Save( const FilePath& path, ArchiveType archiveType, uint32_t flags )
+{
+	HELIUM_ASSERT( !m_Thread );
+
+	m_Path = path;
+	m_ArchiveType = archiveType;
+	m_Flags = flags;
+	m_Saving = true;
+
+	m_Thread = new SaveThread( *this );
+	if ( !m_Thread->Start( TXT( "Persist Snapshot" ) ) )
+	{
+		delete m_Thread;
+		m_Thread = NULL;
+		m_Saving = false;
+		throw Persist::Exception( TXT( "Failed to start snapshot thread" ) );
+	}
+}
+
+bool ArchiveSnapshot::IsSaving() const
+{
+	MutexScopeLock lock ( m_Lock );
+	return m_Saving;
+}
+
+bool ArchiveSnapshot::Finish( std::string* error )
+{
+	if ( !m_Thread )
+	{
+		return m_Success;
+	}
+
+	m_Thread->Join();
+	delete m_Thread;
+	m_Thread = NULL;
+
+	if ( error )
+	{
+		*error = m_Error;
+	}
+
+	return m_Success;
+}
+
+const DynamicArray< ObjectPtr >& ArchiveSnapshot::GetObjects() const
+{
+	return m_Objects;
+}
+
+bool ArchiveSnapshot::Identify( const ObjectPtr& object, Name* identity )
+{
+	// only ever read once capturing is done, so the writer thread needs no lock for this
+	std::map< const Object*, Name >::const_iterator found = m_Identities.find( object.Ptr() );
+	if ( found == m_Identities.end() )
+	{
+		return false;
+	}
+
+	if ( identity )
+	{
+		*identity = found->second;
+	}
+
+	return true;
+}
+
+void ArchiveSnapshot::Write()
+{
+	std::string error;
+	bool success = false;
+
+	try
+	{
+		// the writer sees this as its identifier, so share what it declines the way the originals would have been
+		uint32_t flags = m_HasIdentifier ? m_Flags : m_Flags | ArchiveFlags::ShareDeclined;
+		success = ArchiveWriter::WriteToFile( m_Path, m_Objects.GetData(), m_Objects.GetSize(), this, m_ArchiveType, &error, flags );
+	}
+	catch ( Helium::Exception& ex )
+	{
+		error = ex.Get();
+	}
+	catch ( std::exception& ex )
+	{
+		// reported by Finish like any other failed save, rather than escaping the save thread
+		error = ex.what();
+	}
+	catch ( ... )
+	{
+		error = "Unknown exception";
+	}
+
+	MutexScopeLock lock ( m_Lock );
+	m_Success = success;
+	m_Error = error;
+	m_Saving = false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Platform/Locks.h"
+#include "Platform/Thread.h"
+
+#include "Persist/Archive.h"
+#include "Persist/Clone.h"
+
+#include <map>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		//
+		// Snapshot: a private deep copy of an object graph, taken on the calling thread without encoding anything,
+		//  that is then written to disk on a background thread while the originals carry on changing
+		//
+
+		class HELIUM_PERSIST_API ArchiveSnapshot : public Reflect::ObjectIdentifier
+		{
+		public:
+			// copies everything reachable from objects, keeping shared references shared
+			//  objects the identifier claims are referenced by the identity it gives them now, not copied
+			ArchiveSnapshot( const Reflect::ObjectPtr* objects, size_t count, Reflect::ObjectIdentifier* identifier = NULL );
+			~ArchiveSnapshot(); // waits for the save
+
+			// write the copy on a background thread, at most one save per snapshot
+			void        Save( const FilePath& path, ArchiveType archiveType = ArchiveTypes::Auto, uint32_t flags = 0x0 );
+			bool        IsSaving() const;
+
+			// wait for the save, false (with the error) if it failed
+			bool        Finish( std::string* error = NULL );
+
+			const DynamicArray< Reflect::ObjectPtr >& GetObjects() const;
+
+			// the identities captured for the objects the identifier claimed (the writer asks, on its thread)
+			virtual bool Identify( const Reflect::ObjectPtr& object, Name* identity ) HELIUM_OVERRIDE;
+
+		private:
+			class SaveThread : public Thread
+			{
+			public:
+				SaveThread( ArchiveSnapshot& snapshot );
+				virtual void Run() HELIUM_OVERRIDE;
+
+			private:
+				ArchiveSnapshot& m_Snapshot;
+			};
+
+			class Capture : public Cloner
+			{
+			public:
+				Capture( ArchiveSnapshot& snapshot, Reflect::ObjectIdentifier* identifier );
+
+			protected:
+				virtual void OnIdentified( const Reflect::ObjectPtr& object, const Name& identity ) HELIUM_OVERRIDE;
+				virtual void OnCloned( const Reflect::ObjectPtr& object, const Reflect::ObjectPtr& clone ) HELIUM_OVERRIDE;
+
+			private:
+				ArchiveSnapshot& m_Snapshot;
+			};
+
+			void Write();
+
+			DynamicArray< Reflect::ObjectPtr >                  m_Objects;
+			DynamicArray< Reflect::ObjectPtr >                  m_Pinned;     // copies of shared objects that would otherwise look owned
+			std::map< const Reflect::Object*, Name >            m_Identities; // of the objects the identifier claimed
+			bool                                                m_HasIdentifier; // whether the caller gave one (without, shared objects are written by index)
+
+			FilePath                                            m_Path;
+			ArchiveType                                         m_ArchiveType;
+			uint32_t                                            m_Flags;
+			bool                                                m_Saving;
+			bool                                                m_Success;
+			std::string                                         m_Error;
+			mutable Mutex                                       m_Lock;
+			SaveThread*                                         m_Thread;
+		};
+	}
+}
@@ -0,0 +1,602 @@
+#include "PersistPch.h"
+#include "Persist/ArchiveStore.h"
+
+#include "Platform/Process.h"
+
+#include "Foundation/Crc32.h"
+#include "Foundation/FileStream.h"
+#include "Foundation/Log.h"
+#include "Foundation/MemoryStream.h"
+
+#include "Reflect/Object.h"
+#include "Reflect/Registry.h"
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+static const uint32_t StoreMagic = 0x54535048; // 'HPST'
+static const uint32_t StoreVersion = 1;
+static const uint64_t StoreHeaderSize = 24; // magic, version, type, index count, index offset
+static const uint64_t StoreRecordSize = 20; // offset, size, class crc, checksum
+
+template< class T >
+static void WriteValue( Stream& stream, const T& value )
+{
+	stream.Write( &value, sizeof( T ), 1 );
+}
+
+template< class T >
+static void ReadValue( Stream& stream, T& value )
+{
+	if ( stream.Read( &value, sizeof( T ), 1 ) != 1 )
+	{
+		throw Persist::StreamException( TXT( "Unexpected end of archive store" ) );
+	}
+}
+
+ArchiveStore::ArchiveStore( const FilePath& path, ArchiveType archiveType, uint32_t flags )
+	: m_Path( path )
+	, m_Type( archiveType )
+	, m_Flags( flags )
+	, m_CompactionRatio( 0.5f )
+	, m_End( 0 )
+	, m_DeadBytes( 0 )
+{
+	HELIUM_ASSERT( !m_Path.empty() );
+	HELIUM_ASSERT( m_Type > ArchiveTypes::Auto && m_Type < ArchiveTypes::Count );
+}
+
+ArchiveStore::~ArchiveStore()
+{
+}
+
+void ArchiveStore::Load()
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", m_Path.c_str() );
+
+	m_Records.Clear();
+	m_Objects.Clear();
+	m_Dirty.clear();
+	m_Free.Clear();
+	m_Ids.clear();
+	m_Staged.clear();
+	m_End = 0;
+	m_DeadBytes = 0;
+
+	if ( !m_Path.Exists() )
+	{
+		return;
+	}
+
+	FileStream stream;
+	if ( !stream.Open( m_Path, FileStream::MODE_READ ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open archive store '%s'" ), m_Path.c_str() );
+	}
+
+	uint64_t indexOffset = 0;
+	uint32_t indexCount = 0;
+	ReadHeader( stream, indexOffset, indexCount );
+
+	stream.Seek( indexOffset, SeekOrigins::Begin );
+	m_Records.Resize( indexCount );
+	for ( uint32_t id=0; id<indexCount; ++id )
+	{
+		ArchiveStoreRecord& record = m_Records[ id ];
+		ReadValue( stream, record.m_Offset );
+		ReadValue( stream, record.m_Size );
+		ReadValue( stream, record.m_ClassCrc );
+		ReadValue( stream, record.m_Checksum );
+	}
+
+	// anything past the live index is an interrupted save and will get overwritten
+	m_End = indexOffset + GetIndexSize();
+	m_DeadBytes = m_End - GetLiveSize();
+
+	// allocate every object up front so records can reference each other regardless of their order
+	m_Objects.Resize( indexCount );
+	m_Dirty.resize( indexCount, false );
+	for ( uint32_t id=0; id<indexCount; ++id )
+	{
+		const ArchiveStoreRecord& record = m_Records[ id ];
+		if ( !record.m_ClassCrc )
+		{
+			m_Free.Push( id );
+			continue;
+		}
+
+		const MetaClass* objectClass = Registry::GetInstance()->GetMetaClass( record.m_ClassCrc );
+		if ( !objectClass )
+		{
+			// keep the record as is, compaction carries its bytes along
+			HELIUM_TRACE(
+				TraceLevels::Warning,
+				"ArchiveStore::Load - Could not find class with CRC-32 %" PRIu32 " for record %" PRIu32 "\n",
+				record.m_ClassCrc,
+				id);
+			continue;
+		}
+
+		m_Objects[ id ] = objectClass->m_Creator();
+		m_Ids[ m_Objects[ id ].Ptr() ] = id;
+	}
+
+	DynamicArray< uint8_t > buffer;
+	for ( uint32_t id=0; id<indexCount; ++id )
+	{
+		const ArchiveStoreRecord& record = m_Records[ id ];
+		if ( !m_Objects[ id ] )
+		{
+			continue;
+		}
+
+		buffer.Resize( record.m_Size );
+		stream.Seek( record.m_Offset, SeekOrigins::Begin );
+		if ( record.m_Size && stream.Read( buffer.GetData(), record.m_Size, 1 ) != 1 )
+		{
+			throw Persist::StreamException( TXT( "Record %u is truncated in archive store '%s'" ), id, m_Path.c_str() );
+		}
+
+		if ( Helium::Crc32( buffer.GetData(), buffer.GetSize() ) != record.m_Checksum )
+		{
+			throw Persist::Exception( TXT( "Record %u is corrupt in archive store '%s'" ), id, m_Path.c_str() );
+		}
+
+		Decode( buffer.GetData(), buffer.GetSize(), m_Objects[ id ] );
+	}
+
+	stream.Close();
+}
+
+uint32_t ArchiveStore::Add( const ObjectPtr& object )
+{
+	HELIUM_ASSERT( object );
+
+	uint32_t id = GetId( object );
+	if ( id != Invalid< uint32_t >() )
+	{
+		return id;
+	}
+
+	if ( !m_Free.IsEmpty() )
+	{
+		id = m_Free.Pop();
+	}
+	else
+	{
+		id = static_cast< uint32_t >( m_Objects.GetSize() );
+		m_Objects.Resize( id+1 );
+		m_Records.Resize( id+1 );
+		m_Dirty.resize( id+1, false );
+	}
+
+	m_Objects[ id ] = object;
+	m_Ids[ object.Ptr() ] = id;
+	m_Dirty[ id ] = true;
+	return id;
+}
+
+void ArchiveStore::Remove( const ObjectPtr& object )
+{
+	uint32_t id = GetId( object );
+	if ( id == Invalid< uint32_t >() )
+	{
+		return;
+	}
+
+	m_Ids.erase( object.Ptr() );
+	m_Objects[ id ].Release();
+	m_Dirty[ id ] = false;
+	m_Free.Push( id );
+
+	// an empty record frees the slot on disk
+	Stage( id, 0, NULL, 0 );
+}
+
+uint32_t ArchiveStore::GetId( const Object* object ) const
+{
+	IdMap::const_iterator found = m_Ids.find( object );
+	return found != m_Ids.end() ? found->second : Invalid< uint32_t >();
+}
+
+void ArchiveStore::MarkDirty( const ObjectPtr& object )
+{
+	uint32_t id = GetId( object );
+	if ( id == Invalid< uint32_t >() )
+	{
+		Add( object );
+	}
+	else
+	{
+		MarkDirty( id );
+	}
+}
+
+void ArchiveStore::MarkDirty( uint32_t id )
+{
+	HELIUM_ASSERT( id < m_Dirty.size() );
+	m_Dirty[ id ] = true;
+}
+
+void ArchiveStore::Save( bool detectChanges )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", m_Path.c_str() );
+
+	// encode everything before touching the file so a failing object can't leave a partial save
+	DynamicArray< uint8_t > data;
+	for ( uint32_t id=0; id<m_Objects.GetSize(); ++id )
+	{
+		const ObjectPtr& object = m_Objects[ id ];
+		if ( !object || ( !m_Dirty[ id ] && !detectChanges ) )
+		{
+			continue;
+		}
+
+		Encode( object, data );
+
+		// when detecting changes, records whose bytes didn't change are left alone
+		const ArchiveStoreRecord& record = m_Records[ id ];
+		if ( !m_Dirty[ id ] && record.m_Size == data.GetSize() && record.m_Checksum == Helium::Crc32( data.GetData(), data.GetSize() ) )
+		{
+			continue;
+		}
+
+		Stage( id, Crc32( object->GetMetaClass()->m_Name ), data.GetData(), data.GetSize() );
+	}
+
+	Flush();
+
+	m_Dirty.assign( m_Dirty.size(), false );
+}
+
+void ArchiveStore::Compact()
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "%s", m_Path.c_str() );
+
+	Flush();
+
+	if ( !m_Path.Exists() )
+	{
+		return;
+	}
+
+	// build a path to a unique file for this process
+	FilePath safetyPath( m_Path.Directory() + Helium::GetProcessString() );
+	safetyPath.ReplaceExtension( m_Path.Extension() );
+
+	DynamicArray< ArchiveStoreRecord > records ( m_Records );
+	uint64_t end = StoreHeaderSize;
+
+	try
+	{
+		FileStream source;
+		if ( !source.Open( m_Path, FileStream::MODE_READ ) )
+		{
+			throw Persist::StreamException( TXT( "Failed to open archive store '%s'" ), m_Path.c_str() );
+		}
+
+		FileStream destination;
+		if ( !destination.Open( safetyPath, FileStream::MODE_WRITE ) )
+		{
+			throw Persist::StreamException( TXT( "Failed to open '%s' for writing" ), safetyPath.c_str() );
+		}
+
+		WriteHeader( destination, 0, 0 );
+
+		// copy the raw records, this includes records of classes that aren't registered right now
+		DynamicArray< uint8_t > buffer;
+		for ( DynamicArray< ArchiveStoreRecord >::Iterator itr = records.Begin(), itrEnd = records.End(); itr != itrEnd; ++itr )
+		{
+			if ( !itr->m_Size )
+			{
+				itr->m_Offset = 0;
+				continue;
+			}
+
+			buffer.Resize( itr->m_Size );
+			source.Seek( itr->m_Offset, SeekOrigins::Begin );
+			if ( source.Read( buffer.GetData(), itr->m_Size, 1 ) != 1 )
+			{
+				throw Persist::StreamException( TXT( "Unexpected end of archive store '%s'" ), m_Path.c_str() );
+			}
+
+			destination.Write( buffer.GetData(), itr->m_Size, 1 );
+			itr->m_Offset = end;
+			end += itr->m_Size;
+		}
+
+		uint64_t indexOffset = end;
+		WriteIndex( destination, records );
+		end += GetIndexSize();
+
+		destination.Seek( 0, SeekOrigins::Begin );
+		WriteHeader( destination, indexOffset, static_cast< uint32_t >( records.GetSize() ) );
+		destination.Close();
+		source.Close();
+
+		m_Path.Delete();
+		safetyPath.Move( m_Path );
+	}
+	catch ( ... )
+	{
+		safetyPath.Delete();
+		throw;
+	}
+
+	m_Records = records;
+	m_End = end;
+	m_DeadBytes = 0;
+}
+
+void ArchiveStore::SetCompactionRatio( float32_t ratio )
+{
+	m_CompactionRatio = ratio;
+}
+
+void ArchiveStore::Encode( const ObjectPtr& object, DynamicArray< uint8_t >& data )
+{
+	data.Resize( 0 );
+	DynamicMemoryStream stream ( &data );
+	// objects that aren't records of their own are still shared within the record
+	ArchiveWriter::WriteToStream( &object, 1, stream, m_Type, this, m_Flags | ArchiveFlags::ShareDeclined );
+}
+
+void ArchiveStore::Decode( const uint8_t* data, size_t size, ObjectPtr& object )
+{
+	StaticMemoryStream stream ( const_cast< uint8_t* >( data ), size );
+
+	// reading into the existing object keeps references from other records intact
+	DynamicArray< ObjectPtr > objects;
+	objects.Push( object );
+	ArchiveReader::ReadFromStream( stream, objects, m_Type, this, m_Flags );
+
+	if ( !objects.IsEmpty() )
+	{
+		object = objects.GetFirst();
+	}
+}
+
+void ArchiveStore::Stage( uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size )
+{
+	StagedRecord& staged = m_Staged[ id ];
+	staged.m_ClassCrc = classCrc;
+	staged.m_Data.Resize( 0 );
+	staged.m_Data.AddArray( data, size );
+}
+
+void ArchiveStore::Reserve( uint32_t id, uint32_t classCrc )
+{
+	if ( id >= m_Objects.GetSize() )
+	{
+		for ( uint32_t freeId = static_cast< uint32_t >( m_Objects.GetSize() ); freeId < id; ++freeId )
+		{
+			m_Free.Push( freeId );
+		}
+
+		m_Objects.Resize( id+1 );
+		m_Records.Resize( id+1 );
+		m_Dirty.resize( id+1, false );
+	}
+	else
+	{
+		for ( size_t i=0; i<m_Free.GetSize(); ++i )
+		{
+			if ( m_Free[ i ] == id )
+			{
+				m_Free.RemoveSwap( i );
+				break;
+			}
+		}
+	}
+
+	ObjectPtr& object = m_Objects[ id ];
+	const MetaClass* objectClass = classCrc ? Registry::GetInstance()->GetMetaClass( classCrc ) : NULL;
+	if ( object && object->GetMetaClass() != objectClass )
+	{
+		m_Ids.erase( object.Ptr() );
+		object.Release();
+	}
+
+	if ( !object && objectClass )
+	{
+		object = objectClass->m_Creator();
+		m_Ids[ object.Ptr() ] = id;
+	}
+
+	if ( !classCrc )
+	{
+		m_Free.Push( id );
+	}
+}
+
+void ArchiveStore::Apply( uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size )
+{
+	Reserve( id, classCrc );
+
+	if ( m_Objects[ id ] )
+	{
+		Decode( data, size, m_Objects[ id ] );
+	}
+
+	Stage( id, classCrc, data, size );
+}
+
+void ArchiveStore::Flush()
+{
+	if ( m_Staged.empty() )
+	{
+		return;
+	}
+
+	bool exists = m_Path.Exists();
+	if ( !exists )
+	{
+		m_Path.MakePath();
+	}
+
+	FileStream stream;
+	if ( !stream.Open( m_Path, FileStream::MODE_READ | FileStream::MODE_WRITE, !exists ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open archive store '%s' for writing" ), m_Path.c_str() );
+	}
+
+	if ( !exists )
+	{
+		WriteHeader( stream, 0, 0 );
+		m_End = StoreHeaderSize;
+		m_DeadBytes = 0;
+	}
+	else if ( m_End < StoreHeaderSize )
+	{
+		throw Persist::Exception( TXT( "Archive store '%s' must be loaded before it is saved" ), m_Path.c_str() );
+	}
+	else
+	{
+		// the index we are about to supersede
+		m_DeadBytes += GetIndexSize();
+	}
+
+	// append past the live index, nothing the current header refers to gets overwritten
+	stream.Seek( m_End, SeekOrigins::Begin );
+	for ( StagedMap::const_iterator itr = m_Staged.begin(), end = m_Staged.end(); itr != end; ++itr )
+	{
+		uint32_t id = itr->first;
+		const StagedRecord& staged = itr->second;
+
+		if ( id >= m_Records.GetSize() )
+		{
+			m_Records.Resize( id+1 );
+		}
+
+		ArchiveStoreRecord& record = m_Records[ id ];
+		m_DeadBytes += record.m_Size;
+
+		record.m_ClassCrc = staged.m_ClassCrc;
+		record.m_Size = static_cast< uint32_t >( staged.m_Data.GetSize() );
+		record.m_Offset = record.m_Size ? m_End : 0;
+		record.m_Checksum = Helium::Crc32( staged.m_Data.GetData(), staged.m_Data.GetSize() );
+
+		if ( record.m_Size )
+		{
+			stream.Write( staged.m_Data.GetData(), record.m_Size, 1 );
+			m_End += record.m_Size;
+		}
+	}
+
+	uint64_t indexOffset = m_End;
+	WriteIndex( stream, m_Records );
+	m_End += GetIndexSize();
+	stream.Flush();
+
+	// publish the new index only once it is completely written
+	stream.Seek( 0, SeekOrigins::Begin );
+	WriteHeader( stream, indexOffset, static_cast< uint32_t >( m_Records.GetSize() ) );
+	stream.Flush();
+	stream.Close();
+
+	m_Staged.clear();
+
+	if ( m_DeadBytes > static_cast< uint64_t >( GetLiveSize() * m_CompactionRatio ) )
+	{
+		Compact();
+	}
+}
+
+bool ArchiveStore::Identify( const ObjectPtr& object, Name* identity )
+{
+	uint32_t id = GetId( object );
+	if ( id == Invalid< uint32_t >() )
+	{
+		return false;
+	}
+
+	if ( identity )
+	{
+		String str;
+		str.Format( "#%u", id );
+		identity->Set( str );
+	}
+
+	return true;
+}
+
+bool ArchiveStore::Resolve( const Name& identity, ObjectPtr& pointer, const MetaClass* pointerClass )
+{
+	String str ( identity.Get() );
+
+	uint32_t id = Invalid< uint32_t >();
+	if ( str.IsEmpty() || str[ 0 ] != '#' || !str.Parse( "#%u", &id ) || id >= m_Objects.GetSize() )
+	{
+		return false;
+	}
+
+	Object* found = m_Objects.GetElement( id );
+	if ( found && !found->IsA( pointerClass ) )
+	{
+		Log::Warning( TXT( "Object of type '%s' is not valid for pointer type '%s'" ), found->GetMetaClass()->m_Name, pointerClass->m_Name );
+		found = NULL;
+	}
+
+	pointer = found;
+	return true;
+}
+
+void ArchiveStore::ReadHeader( Stream& stream, uint64_t& indexOffset, uint32_t& indexCount )
+{
+	uint32_t magic = 0, version = 0, type = 0;
+	ReadValue( stream, magic );
+	ReadValue( stream, version );
+	ReadValue( stream, type );
+	ReadValue( stream, indexCount );
+	ReadValue( stream, indexOffset );
+
+	if ( magic != StoreMagic || version != StoreVersion )
+	{
+		throw Persist::StreamException( TXT( "'%s' is not an archive store (or is from an unsupported version)" ), m_Path.c_str() );
+	}
+
+	if ( type >= ArchiveTypes::Count )
+	{
+		throw Persist::StreamException( TXT( "Unknown archive type %u in archive store '%s'" ), type, m_Path.c_str() );
+	}
+
+	// the store decides the encoding of its records
+	m_Type = static_cast< ArchiveType >( type );
+}
+
+void ArchiveStore::WriteHeader( Stream& stream, uint64_t indexOffset, uint32_t indexCount )
+{
+	WriteValue( stream, StoreMagic );
+	WriteValue( stream, StoreVersion );
+	WriteValue( stream, static_cast< uint32_t >( m_Type ) );
+	WriteValue( stream, indexCount );
+	WriteValue( stream, indexOffset );
+}
+
+void ArchiveStore::WriteIndex( Stream& stream, const DynamicArray< ArchiveStoreRecord >& records )
+{
+	for ( DynamicArray< ArchiveStoreRecord >::ConstIterator itr = records.Begin(), end = records.End(); itr != end; ++itr )
+	{
+		WriteValue( stream, itr->m_Offset );
+		WriteValue( stream, itr->m_Size );
+		WriteValue( stream, itr->m_ClassCrc );
+		WriteValue( stream, itr->m_Checksum );
+	}
+}
+
+uint64_t ArchiveStore::GetIndexSize() const
+{
+	return m_Records.GetSize() * StoreRecordSize;
+}
+
+uint64_t ArchiveStore::GetLiveSize() const
+{
+	uint64_t size = StoreHeaderSize + GetIndexSize();
+	for ( DynamicArray< ArchiveStoreRecord >::ConstIterator itr = m_Records.Begin(), end = m_Records.End(); itr != end; ++itr )
+	{
+		size += itr->m_Size;
+	}
+
+	return size;
+}
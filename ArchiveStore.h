@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Foundation/DynamicArray.h"
+#include "Foundation/FilePath.h"
+#include "Foundation/Stream.h"
+
+#include "Persist/Archive.h"
+
+#include <map>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		//
+		// Store: a file of independently encoded top-level object records followed by an index of them,
+		//  saving appends the records of changed objects and a new index instead of regenerating the file
+		//
+
+		struct ArchiveStoreRecord
+		{
+			inline ArchiveStoreRecord();
+
+			uint64_t m_Offset;   // byte offset of the encoded record within the store
+			uint32_t m_Size;     // size of the encoded record in bytes
+			uint32_t m_ClassCrc; // class of the top-level object (zero for a free slot)
+			uint32_t m_Checksum; // Crc32 of the encoded record
+		};
+
+		class HELIUM_PERSIST_API ArchiveStore : public Reflect::ObjectIdentifier, public Reflect::ObjectResolver
+		{
+		public:
+			ArchiveStore( const FilePath& path, ArchiveType archiveType = ArchiveTypes::MessagePack, uint32_t flags = 0x0 );
+			~ArchiveStore();
+
+			inline const FilePath&                           GetPath() const;
+			inline ArchiveType                               GetType() const;
+			inline const DynamicArray< Reflect::ObjectPtr >& GetObjects() const;
+
+			// read all live records, a missing store file is an empty store
+			void     Load();
+
+			// top-level objects are addressed by a stable id (their slot in the store)
+			uint32_t Add( const Reflect::ObjectPtr& object );
+			void     Remove( const Reflect::ObjectPtr& object );
+			uint32_t GetId( const Reflect::Object* object ) const;
+			void     MarkDirty( const Reflect::ObjectPtr& object );
+			void     MarkDirty( uint32_t id );
+
+			// write dirty (or, when detecting changes, re-encoded and different) records
+			void     Save( bool detectChanges = false );
+			void     Compact();
+			void     SetCompactionRatio( float32_t ratio );
+
+			// encoded records, staged records are written by the next Flush (or Save)
+			void     Encode( const Reflect::ObjectPtr& object, DynamicArray< uint8_t >& data );
+			void     Decode( const uint8_t* data, size_t size, Reflect::ObjectPtr& object );
+			void     Stage( uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size );
+			void     Flush();
+
+			// make the slot hold an object of the given class (or nothing), then decode and stage a record into it
+			void     Reserve( uint32_t id, uint32_t classCrc );
+			void     Apply( uint32_t id, uint32_t classCrc, const uint8_t* data, size_t size );
+
+			virtual bool Identify( const Reflect::ObjectPtr& object, Name* identity ) HELIUM_OVERRIDE;
+			virtual bool Resolve( const Name& identity, Reflect::ObjectPtr& pointer, const Reflect::MetaClass* pointerClass ) HELIUM_OVERRIDE;
+
+		private:
+			void     ReadHeader( Stream& stream, uint64_t& indexOffset, uint32_t& indexCount );
+			void     WriteHeader( Stream& stream, uint64_t indexOffset, uint32_t indexCount );
+			void     WriteIndex( Stream& stream, const DynamicArray< ArchiveStoreRecord >& records );
+			uint64_t GetIndexSize() const;
+			uint64_t GetLiveSize() const;
+
+			struct StagedRecord
+			{
+				uint32_t                m_ClassCrc;
+				DynamicArray< uint8_t > m_Data;
+			};
+
+			typedef std::map< uint32_t, StagedRecord >           StagedMap;
+			typedef std::map< const Reflect::Object*, uint32_t > IdMap;
+
+			FilePath                           m_Path;
+			ArchiveType                        m_Type;
+			uint32_t                           m_Flags;
+			float32_t                          m_CompactionRatio;
+			uint64_t                           m_End;       // end of the live index, new data is appended here
+			uint64_t                           m_DeadBytes; // bytes of superseded records and indices
+			DynamicArray< ArchiveStoreRecord > m_Records;
+			DynamicArray< Reflect::ObjectPtr > m_Objects;
+			std::vector< bool >                m_Dirty;
+			DynamicArray< uint32_t >           m_Free;
+			IdMap                              m_Ids;
+			StagedMap                          m_Staged;
+		};
+	}
+}
+
+#include "Persist/ArchiveStore.inl"
@@ -0,0 +1,22 @@
+Helium::Persist::ArchiveStoreRecord::ArchiveStoreRecord()
+	: m_Offset( 0 )
+	, m_Size( 0 )
+	, m_ClassCrc( 0 )
+	, m_Checksum( 0 )
+{
+}
+
+const Helium::FilePath& Helium::Persist::ArchiveStore::GetPath() const
+{
+	return m_Path;
+}
+
+Helium::Persist::ArchiveType Helium::Persist::ArchiveStore::GetType() const
+{
+	return m_Type;
+}
+
+const Helium::DynamicArray< Helium::Reflect::ObjectPtr >& Helium::Persist::ArchiveStore::GetObjects() const
+{
+	return m_Objects;
+}
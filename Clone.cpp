@@ -0,0 +1,290 @@
+#include "PersistPch.h"
+#include "Persist/Clone.h"
+
+#include "Reflect/TranslatorDeduction.h"
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+Cloner::Cloner( ObjectIdentifier* identifier, uint32_t flags )
+	: m_Identifier( identifier )
+	, m_Flags( flags )
+{
+}
+
+Cloner::~Cloner()
+{
+}
+
+ObjectPtr Cloner::Clone( const ObjectPtr& object )
+{
+	ObjectPtr clone = Register( object );
+
+	// references are queued rather than recursed into (like writers do with shared objects),
+	//  so a long chain of them, a linked list say, can't run out of stack
+	while ( !m_Pending.IsEmpty() )
+	{
+		ClonePair pending = m_Pending.Pop();
+		CloneObject( pending.first, pending.second );
+	}
+
+	return clone;
+}
+
+ObjectPtr Cloner::Register( const ObjectPtr& object )
+{
+	if ( !object )
+	{
+		return NULL;
+	}
+
+	std::map< const Object*, ClonePair >::const_iterator found = m_Clones.find( object.Ptr() );
+	if ( found != m_Clones.end() )
+	{
+		return found->second.second;
+	}
+
+	const MetaClass* objectClass = object->GetMetaClass();
+	ObjectPtr clone = objectClass->m_Creator();
+
+	// before the map takes its references, so the original's count is still the caller's
+	OnCloned( object, clone );
+
+	// registered before the fields are copied, so cycles back to this object find it
+	m_Clones[ object.Ptr() ] = ClonePair ( object, clone );
+	m_Pending.Push( ClonePair ( object, clone ) );
+
+	return clone;
+}
+
+void Cloner::CloneObject( Object* object, Object* clone )
+{
+	bool callbacks = ( m_Flags & CloneFlags::Callbacks ) != 0;
+	if ( callbacks )
+	{
+		object->PreSerialize( NULL );
+		clone->PreDeserialize( NULL );
+	}
+
+	CloneInstance( object, clone, object->GetMetaClass(), object, clone, callbacks );
+
+	if ( callbacks )
+	{
+		object->PostSerialize( NULL );
+		clone->PostDeserialize( NULL );
+	}
+}
+
+void Cloner::OnIdentified( const ObjectPtr& object, const Name& identity )
+{
+}
+
+void Cloner::OnCloned( const ObjectPtr& object, const ObjectPtr& clone )
+{
+}
+
+void Cloner::CloneInstance( void* source, void* destination, const MetaStruct* structure, Object* sourceObject, Object* destinationObject, bool callbacks )
+{
+	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
+	{
+		for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end; ++itr )
+		{
+			// what a round trip through an archive would lose
+			const Field* field = &*itr;
+			if ( field->m_Flags & FieldFlags::Discard )
+			{
+				continue;
+			}
+
+			if ( callbacks )
+			{
+				sourceObject->PreSerialize( field );
+				destinationObject->PreDeserialize( field );
+			}
+
+			for ( uint32_t i=0; i<field->m_Count; ++i )
+			{
+				CloneTranslator( Pointer ( field, source, sourceObject, i ), Pointer ( field, destination, destinationObject, i ), field->m_Translator, sourceObject, destinationObject );
+			}
+
+			if ( callbacks )
+			{
+				sourceObject->PostSerialize( field );
+				destinationObject->PostDeserialize( field );
+			}
+		}
+	}
+}
+
+void Cloner::CloneTranslator( Pointer source, Pointer destination, Translator* translator, Object* sourceObject, Object* destinationObject )
+{
+	// plain data (including containers and structures of it) is copied in one go by its translator
+	if ( !HasReferences( translator ) )
+	{
+		translator->Copy( source, destination, 0x0 );
+		return;
+	}
+
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		{
+			const ObjectPtr& pointed ( source.As< ObjectPtr >() );
+
+			Name identity;
+			if ( pointed && m_Identifier && m_Identifier->Identify( pointed, &identity ) )
+			{
+				OnIdentified( pointed, identity );
+				destination.As< ObjectPtr >() = pointed;
+			}
+			else
+			{
+				destination.As< ObjectPtr >() = Register( pointed );
+			}
+			break;
+		}
+
+	case MetaIds::StructureTranslator:
+		{
+			StructureTranslator* structure = static_cast< StructureTranslator* >( translator );
+			CloneInstance( source.m_Address, destination.m_Address, structure->GetMetaStruct(), sourceObject, destinationObject, false );
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		{
+			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
+			Translator* itemTranslator = sequence->GetItemTranslator();
+			uint32_t length = static_cast< uint32_t >( sequence->GetLength( source ) );
+			sequence->SetLength( destination, length );
+			for ( uint32_t i=0; i<length; ++i )
+			{
+				CloneTranslator( sequence->GetItem( source, i ), sequence->GetItem( destination, i ), itemTranslator, sourceObject, destinationObject );
+			}
+			break;
+		}
+
+	case MetaIds::SetTranslator:
+		{
+			SetTranslator* set = static_cast< SetTranslator* >( translator );
+			Translator* itemTranslator = set->GetItemTranslator();
+			if ( set->GetLength( destination ) )
+			{
+				Variable empty ( set );
+				set->Copy( empty, destination, 0x0 );
+			}
+
+			DynamicArray< Pointer > items;
+			set->GetItems( source, items );
+			for ( DynamicArray< Pointer >::Iterator itr = items.Begin(), end = items.End(); itr != end; ++itr )
+			{
+				Variable item ( itemTranslator );
+				CloneTranslator( *itr, item, itemTranslator, sourceObject, destinationObject );
+				set->InsertItem( destination, item );
+			}
+			break;
+		}
+
+	case MetaIds::AssociationTranslator:
+		{
+			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+			Translator* keyTranslator = association->GetKeyTranslator();
+			Translator* valueTranslator = association->GetValueTranslator();
+			if ( association->GetLength( destination ) )
+			{
+				Variable empty ( association );
+				association->Copy( empty, destination, 0x0 );
+			}
+
+			DynamicArray< Pointer > keys, values;
+			association->GetItems( source, keys, values );
+			for ( DynamicArray< Pointer >::Iterator keyItr = keys.Begin(), valueItr = values.Begin(), keyEnd = keys.End(), valueEnd = values.End();
+				keyItr != keyEnd && valueItr != valueEnd;
+				++keyItr, ++valueItr )
+			{
+				Variable key ( keyTranslator );
+				Variable value ( valueTranslator );
+				CloneTranslator( *keyItr, key, keyTranslator, sourceObject, destinationObject );
+				CloneTranslator( *valueItr, value, valueTranslator, sourceObject, destinationObject );
+				association->SetItem( destination, key, value );
+			}
+			break;
+		}
+
+	default:
+		HELIUM_BREAK(); // scalars have no references
+		break;
+	}
+}
+
+bool Cloner::HasReferences( Translator* translator )
+{
+	std::map< const Translator*, bool >::const_iterator found = m_References.find( translator );
+	if ( found != m_References.end() )
+	{
+		return found->second;
+	}
+
+	bool references = false;
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		references = true;
+		break;
+
+	case MetaIds::StructureTranslator:
+		{
+			const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+			for ( const MetaStruct* current = structure; current != NULL && !references; current = current->m_Base )
+			{
+				for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end && !references; ++itr )
+				{
+					references = HasReferences( itr->m_Translator );
+				}
+			}
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		references = HasReferences( static_cast< SequenceTranslator* >( translator )->GetItemTranslator() );
+		break;
+
+	case MetaIds::SetTranslator:
+		references = HasReferences( static_cast< SetTranslator* >( translator )->GetItemTranslator() );
+		break;
+
+	case MetaIds::AssociationTranslator:
+		{
+			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+			references = HasReferences( association->GetKeyTranslator() ) || HasReferences( association->GetValueTranslator() );
+			break;
+		}
+
+	default:
+		break;
+	}
+
+	m_References[ translator ] = references;
+	return references;
+}
+
+ObjectPtr Persist::Clone( const ObjectPtr& object, ObjectIdentifier* identifier, uint32_t flags )
+{
+	Cloner cloner ( identifier, flags );
+	return cloner.Clone( object );
+}
+
+void Persist::Clone( const ObjectPtr* objects, size_t count, DynamicArray< ObjectPtr >& clones, ObjectIdentifier* identifier, uint32_t flags )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Clone" );
+
+	// one cloner for all of them, so references between the objects are kept
+	Cloner cloner ( identifier, flags );
+	clones.Clear();
+	clones.Reserve( count );
+	for ( size_t i=0; i<count; ++i )
+	{
+		clones.Push( cloner.Clone( objects[ i ] ) );
+	}
+}
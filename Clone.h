@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Foundation/DynamicArray.h"
+
+#include "Reflect/MetaClass.h"
+#include "Reflect/Object.h"
+#include "Reflect/Translator.h"
+
+#include "Persist/API.h"
+
+#include <map>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		namespace CloneFlags
+		{
+			enum CloneFlag
+			{
+				Callbacks = 1 << 0, // Run the serialization callbacks on the originals and the deserialization ones on the clones
+			};
+		}
+
+		//
+		// Cloner: deep copies objects field by field through their translators, without encoding anything,
+		//  references shared between originals are shared between their clones (cycles included)
+		//
+
+		class HELIUM_PERSIST_API Cloner
+		{
+		public:
+			// objects the identifier claims aren't copied, references to them are kept as they are
+			Cloner( Reflect::ObjectIdentifier* identifier = NULL, uint32_t flags = CloneFlags::Callbacks );
+			virtual ~Cloner();
+
+			// every original is cloned once per cloner, later calls reuse the clones of objects already seen
+			Reflect::ObjectPtr Clone( const Reflect::ObjectPtr& object );
+
+		protected:
+			virtual void       OnIdentified( const Reflect::ObjectPtr& object, const Name& identity );
+			virtual void       OnCloned( const Reflect::ObjectPtr& object, const Reflect::ObjectPtr& clone );
+
+		private:
+			typedef std::pair< Reflect::ObjectPtr, Reflect::ObjectPtr > ClonePair;
+
+			// the clone of an original, created (and queued for its fields to be copied) the first time it is seen
+			Reflect::ObjectPtr Register( const Reflect::ObjectPtr& object );
+			void               CloneObject( Reflect::Object* object, Reflect::Object* clone );
+			void               CloneInstance( void* source, void* destination, const Reflect::MetaStruct* structure, Reflect::Object* sourceObject, Reflect::Object* destinationObject, bool callbacks );
+			void               CloneTranslator( Reflect::Pointer source, Reflect::Pointer destination, Reflect::Translator* translator, Reflect::Object* sourceObject, Reflect::Object* destinationObject );
+			bool               HasReferences( Reflect::Translator* translator );
+
+			Reflect::ObjectIdentifier*                           m_Identifier;
+			const uint32_t                                       m_Flags;
+			std::map< const Reflect::Object*, ClonePair >        m_Clones;     // original -> (original, clone), both held so neither address can go stale
+			DynamicArray< ClonePair >                            m_Pending;    // registered, but their fields aren't copied yet
+			std::map< const Reflect::Translator*, bool >         m_References; // whether values of a translator can hold object pointers
+		};
+
+		// the equivalent of writing objects to an archive and reading them back
+		HELIUM_PERSIST_API Reflect::ObjectPtr Clone( const Reflect::ObjectPtr& object, Reflect::ObjectIdentifier* identifier = NULL, uint32_t flags = CloneFlags::Callbacks );
+		HELIUM_PERSIST_API void               Clone( const Reflect::ObjectPtr* objects, size_t count, DynamicArray< Reflect::ObjectPtr >& clones, Reflect::ObjectIdentifier* identifier = NULL, uint32_t flags = CloneFlags::Callbacks );
+	}
+}
@@ -0,0 +1,533 @@
+#include "PersistPch.h"
+#include "Persist/CompressedStream.h"
+
+#include "Platform/Utility.h"
+
+#include "Persist/Archive.h"
+#include "Persist/Crc32c.h"
+#include "Persist/Exceptions.h"
+#include "Persist/Parallel.h"
+
+#include "lz4/lib/lz4.h"
+#include "zstd/lib/zstd.h"
+
+using namespace Helium;
+using namespace Helium::Persist;
+
+static const uint32_t CompressedMagic = 0x5a435048; // 'HPCZ'
+static const uint8_t CompressedVersion = 3; // 2: dictionary id, 3: header flags (checksums)
+static const uint8_t UncheckedVersion = 2; // written without checksums, so readers from before them still can
+static const uint16_t CompressedChecksum = 1 << 0; // header flag: blocks carry a CRC-32C, and a trailer follows the last
+static const uint16_t CompressedFlags = CompressedChecksum; // every header flag this version knows
+static const size_t PendingBlocks = 16; // full blocks to collect before compressing them in parallel
+
+template< class T >
+static void WriteValue( Stream& stream, const T& value )
+{
+	stream.Write( &value, sizeof( T ), 1 );
+}
+
+template< class T >
+static void ReadValue( Stream& stream, T& value )
+{
+	if ( stream.Read( &value, sizeof( T ), 1 ) != 1 )
+	{
+		throw Persist::StreamException( TXT( "Unexpected end of compressed stream" ) );
+	}
+}
+
+CompressedStream::CompressedStream( Stream* stream, CompressionCodec codec, bool ownStream, uint32_t blockSize, CompressionDictionary* dictionary, bool checksum )
+	: m_Stream( stream )
+	, m_OwnStream( ownStream )
+	, m_Writing( true )
+	, m_Codec( codec )
+	, m_BlockSize( blockSize )
+	, m_Checksum( checksum )
+	, m_Dictionary( dictionary )
+	, m_Position( 0 )
+	, m_Written( 0 )
+	, m_StreamChecksum( 0 )
+{
+	HELIUM_ASSERT( m_Stream );
+	HELIUM_ASSERT( m_Codec >= CompressionCodecs::None && m_Codec < CompressionCodecs::Count );
+	HELIUM_ASSERT( m_BlockSize > 0 );
+	HELIUM_ASSERT( !m_Dictionary || m_Codec == CompressionCodecs::Zstd );
+
+	WriteValue( *m_Stream, CompressedMagic );
+	WriteValue( *m_Stream, m_Checksum ? CompressedVersion : UncheckedVersion );
+	WriteValue( *m_Stream, static_cast< uint8_t >( m_Codec ) );
+	WriteValue( *m_Stream, static_cast< uint16_t >( m_Checksum ? CompressedChecksum : 0 ) );
+	WriteValue( *m_Stream, m_BlockSize );
+	WriteValue( *m_Stream, m_Dictionary ? m_Dictionary->GetId() : static_cast< uint32_t >( 0 ) );
+}
+
+CompressedStream::CompressedStream( Stream* stream, bool ownStream, CompressionDictionary* dictionary )
+	: m_Stream( stream )
+	, m_OwnStream( ownStream )
+	, m_Writing( false )
+	, m_Codec( CompressionCodecs::None )
+	, m_BlockSize( 0 )
+	, m_Checksum( false )
+	, m_Dictionary( dictionary )
+	, m_Position( 0 )
+	, m_Written( 0 )
+	, m_StreamChecksum( 0 )
+{
+	HELIUM_ASSERT( m_Stream );
+
+	ReadBlocks();
+}
+
+CompressedStream::~CompressedStream()
+{
+	Close();
+}
+
+bool CompressedStream::IsCompressed( Stream& stream )
+{
+	int64_t position = stream.Tell();
+
+	uint32_t magic = 0;
+	size_t read = stream.Read( &magic, sizeof( magic ), 1 );
+	stream.Seek( position, SeekOrigins::Begin );
+
+	return read == 1 && magic == CompressedMagic;
+}
+
+CompressionCodec CompressedStream::GetCodec( uint32_t archiveFlags )
+{
+	if ( archiveFlags & ArchiveFlags::CompressSmall )
+	{
+		return CompressionCodecs::Zstd;
+	}
+
+	if ( archiveFlags & ArchiveFlags::CompressFast )
+	{
+		return CompressionCodecs::Lz4;
+	}
+
+	return CompressionCodecs::None;
+}
+
+bool CompressedStream::IsFramed( uint32_t archiveFlags )
+{
+	return ( archiveFlags & ( ArchiveFlags::CompressMask | ArchiveFlags::Checksum ) ) != 0;
+}
+
+void CompressedStream::Close()
+{
+	if ( !m_Stream )
+	{
+		return;
+	}
+
+	if ( m_Writing )
+	{
+		WriteBlocks( true );
+
+		// an empty block terminates the stream
+		WriteValue( *m_Stream, static_cast< uint32_t >( 0 ) );
+		WriteValue( *m_Stream, static_cast< uint32_t >( 0 ) );
+
+		// followed by the raw length and a checksum of every block's, so blocks can't go missing unnoticed
+		if ( m_Checksum )
+		{
+			uint64_t length = static_cast< uint64_t >( m_Written );
+			WriteValue( *m_Stream, length );
+			WriteValue( *m_Stream, Crc32c( &length, sizeof( length ), m_StreamChecksum ) );
+		}
+
+		m_Stream->Flush();
+	}
+
+	if ( m_OwnStream )
+	{
+		m_Stream->Close();
+		delete m_Stream;
+	}
+
+	m_Stream = NULL;
+	m_Buffer.Clear();
+}
+
+bool CompressedStream::IsOpen() const
+{
+	return m_Stream != NULL;
+}
+
+bool CompressedStream::CanRead() const
+{
+	return !m_Writing;
+}
+
+bool CompressedStream::CanWrite() const
+{
+	return m_Writing;
+}
+
+bool CompressedStream::CanSeek() const
+{
+	return !m_Writing;
+}
+
+size_t CompressedStream::Read( void* buffer, size_t size, size_t count )
+{
+	HELIUM_ASSERT( !m_Writing );
+
+	if ( !size )
+	{
+		return 0;
+	}
+
+	size_t available = ( m_Buffer.GetSize() - m_Position ) / size;
+	count = Min( count, available );
+
+	MemoryCopy( buffer, m_Buffer.GetData() + m_Position, size * count );
+	m_Position += size * count;
+	return count;
+}
+
+size_t CompressedStream::Write( const void* buffer, size_t size, size_t count )
+{
+	HELIUM_ASSERT( m_Writing );
+
+	m_Buffer.AddArray( static_cast< const uint8_t* >( buffer ), size * count );
+	m_Written += size * count;
+
+	if ( m_Buffer.GetSize() >= m_BlockSize * PendingBlocks )
+	{
+		WriteBlocks( false );
+	}
+
+	return count;
+}
+
+void CompressedStream::Flush()
+{
+	if ( m_Writing && m_Stream )
+	{
+		WriteBlocks( true );
+		m_Stream->Flush();
+	}
+}
+
+int64_t CompressedStream::Seek( int64_t offset, SeekOrigin origin )
+{
+	HELIUM_ASSERT( !m_Writing );
+
+	int64_t position = offset;
+	switch ( origin )
+	{
+	case SeekOrigins::Current:
+		position += static_cast< int64_t >( m_Position );
+		break;
+
+	case SeekOrigins::End:
+		position += static_cast< int64_t >( m_Buffer.GetSize() );
+		break;
+
+	default:
+		break;
+	}
+
+	m_Position = static_cast< size_t >( Clamp< int64_t >( position, 0, static_cast< int64_t >( m_Buffer.GetSize() ) ) );
+	return static_cast< int64_t >( m_Position );
+}
+
+int64_t CompressedStream::Tell() const
+{
+	return m_Writing ? m_Written : static_cast< int64_t >( m_Position );
+}
+
+int64_t CompressedStream::GetSize() const
+{
+	return m_Writing ? m_Written : static_cast< int64_t >( m_Buffer.GetSize() );
+}
+
+void CompressedStream::ReadBlocks()
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Persist - Decompress" );
+
+	uint32_t magic = 0;
+	uint8_t version = 0, codec = 0;
+	uint16_t flags = 0;
+	ReadValue( *m_Stream, magic );
+	ReadValue( *m_Stream, version );
+	ReadValue( *m_Stream, codec );
+	ReadValue( *m_Stream, flags );
+	ReadValue( *m_Stream, m_BlockSize );
+
+	if ( magic != CompressedMagic || version < 1 || version > CompressedVersion )
+	{
+		throw Persist::StreamException( TXT( "Stream is not compressed (or is from an unsupported version)" ) );
+	}
+
+	// earlier versions reserved the flags, and a flag we don't know changes the framing in ways we can't follow
+	if ( ( version < 3 && flags ) || ( flags & ~CompressedFlags ) )
+	{
+		throw Persist::StreamException( TXT( "Compressed stream has unsupported flags 0x%x" ), static_cast< uint32_t >( flags ) );
+	}
+
+	if ( codec >= CompressionCodecs::Count )
+	{
+		throw Persist::StreamException( TXT( "Unknown compression codec %u" ), codec );
+	}
+
+	m_Codec = static_cast< CompressionCodec >( codec );
+	m_Checksum = ( flags & CompressedChecksum ) != 0;
+
+	uint32_t dictionaryId = 0;
+	if ( version >= 2 )
+	{
+		ReadValue( *m_Stream, dictionaryId );
+	}
+
+	if ( !dictionaryId )
+	{
+		m_Dictionary = NULL;
+	}
+	else if ( !m_Dictionary || m_Dictionary->GetId() != dictionaryId )
+	{
+		m_Dictionary = CompressionDictionary::Find( dictionaryId );
+		if ( !m_Dictionary )
+		{
+			throw Persist::StreamException( TXT( "Compression dictionary %u is not registered" ), dictionaryId );
+		}
+	}
+
+	// reading the compressed payloads is sequential, decompressing them isn't
+	size_t total = 0;
+	for (;;)
+	{
+		uint32_t rawSize = 0, compressedSize = 0, checksum = 0;
+		ReadValue( *m_Stream, rawSize );
+		ReadValue( *m_Stream, compressedSize );
+
+		if ( !rawSize )
+		{
+			break;
+		}
+
+		if ( rawSize > m_BlockSize || compressedSize > rawSize || ( m_Codec == CompressionCodecs::None && compressedSize != rawSize ) )
+		{
+			throw Persist::StreamException( TXT( "Compressed block %u is malformed" ), static_cast< uint32_t >( m_Blocks.GetSize() ) );
+		}
+
+		if ( m_Checksum )
+		{
+			ReadValue( *m_Stream, checksum );
+			m_StreamChecksum = Crc32c( &checksum, sizeof( checksum ), m_StreamChecksum );
+		}
+
+		Block& block = *m_Blocks.New();
+		block.m_Offset = total;
+		block.m_RawSize = rawSize;
+		block.m_Checksum = checksum;
+		block.m_Compressed.Resize( compressedSize );
+		if ( compressedSize && m_Stream->Read( block.m_Compressed.GetData(), compressedSize, 1 ) != 1 )
+		{
+			throw Persist::StreamException( TXT( "Unexpected end of compressed stream" ) );
+		}
+
+		total += rawSize;
+	}
+
+	if ( m_Checksum )
+	{
+		uint64_t length = 0;
+		uint32_t checksum = 0;
+		ReadValue( *m_Stream, length );
+		ReadValue( *m_Stream, checksum );
+
+		if ( length != total || Crc32c( &length, sizeof( length ), m_StreamChecksum ) != checksum )
+		{
+			throw Persist::StreamException( TXT( "Compressed stream failed its checksum (blocks are missing or out of order)" ) );
+		}
+	}
+
+	m_Buffer.Resize( total );
+	ParallelFor( m_Blocks.GetSize(), &CompressedStream::DecompressBlock, this );
+	m_Blocks.Clear();
+}
+
+void CompressedStream::WriteBlocks( bool partial )
+{
+	size_t size = m_Buffer.GetSize();
+	size_t count = size / m_BlockSize;
+	if ( partial && size % m_BlockSize )
+	{
+		++count;
+	}
+
+	if ( !count )
+	{
+		return;
+	}
+
+	HELIUM_PERSIST_SCOPE_TIMER( "Persist - Compress" );
+
+	m_Blocks.Resize( count );
+	for ( size_t i=0; i<count; ++i )
+	{
+		Block& block = m_Blocks[ i ];
+		block.m_Offset = i * m_BlockSize;
+		block.m_RawSize = static_cast< uint32_t >( Min< size_t >( m_BlockSize, size - block.m_Offset ) );
+	}
+
+	ParallelFor( count, &CompressedStream::CompressBlock, this );
+
+	size_t consumed = 0;
+	for ( DynamicArray< Block >::ConstIterator itr = m_Blocks.Begin(), end = m_Blocks.End(); itr != end; ++itr )
+	{
+		WriteValue( *m_Stream, itr->m_RawSize );
+		WriteValue( *m_Stream, static_cast< uint32_t >( itr->m_Compressed.GetSize() ) );
+		if ( m_Checksum )
+		{
+			WriteValue( *m_Stream, itr->m_Checksum );
+			m_StreamChecksum = Crc32c( &itr->m_Checksum, sizeof( itr->m_Checksum ), m_StreamChecksum );
+		}
+		m_Stream->Write( itr->m_Compressed.GetData(), itr->m_Compressed.GetSize(), 1 );
+		consumed += itr->m_RawSize;
+	}
+
+	m_Buffer.Remove( 0, consumed );
+	m_Blocks.Clear();
+}
+
+void CompressedStream::CompressBlock( size_t index, void* userData )
+{
+	CompressedStream* stream = static_cast< CompressedStream* >( userData );
+	Block& block = stream->m_Blocks[ index ];
+	const uint8_t* raw = stream->m_Buffer.GetData() + block.m_Offset;
+
+	size_t size = block.m_RawSize;
+	switch ( stream->m_Codec )
+	{
+	case CompressionCodecs::None:
+		break;
+
+	case CompressionCodecs::Lz4:
+		{
+			int bound = LZ4_compressBound( static_cast< int >( block.m_RawSize ) );
+			block.m_Compressed.Resize( bound );
+			int result = LZ4_compress_default( reinterpret_cast< const char* >( raw ), reinterpret_cast< char* >( block.m_Compressed.GetData() ), static_cast< int >( block.m_RawSize ), bound );
+			if ( result <= 0 )
+			{
+				throw Persist::StreamException( TXT( "LZ4 failed to compress block %u" ), static_cast< uint32_t >( index ) );
+			}
+
+			size = static_cast< size_t >( result );
+			break;
+		}
+
+	case CompressionCodecs::Zstd:
+		{
+			size_t bound = ZSTD_compressBound( block.m_RawSize );
+			block.m_Compressed.Resize( bound );
+
+			size_t result = 0;
+			if ( stream->m_Dictionary )
+			{
+				ZSTD_CCtx* context = ZSTD_createCCtx();
+				result = ZSTD_compress_usingCDict( context, block.m_Compressed.GetData(), bound, raw, block.m_RawSize, stream->m_Dictionary->GetCompressionDictionary() );
+				ZSTD_freeCCtx( context );
+			}
+			else
+			{
+				result = ZSTD_compress( block.m_Compressed.GetData(), bound, raw, block.m_RawSize, ZstdLevel );
+			}
+
+			if ( ZSTD_isError( result ) )
+			{
+				throw Persist::StreamException( TXT( "Zstd failed to compress block %u: %s" ), static_cast< uint32_t >( index ), ZSTD_getErrorName( result ) );
+			}
+
+			size = result;
+			break;
+		}
+
+	default:
+		HELIUM_ASSERT( false );
+		break;
+	}
+
+	// incompressible blocks are stored as is (a compressed size equal to the raw size means stored)
+	if ( size >= block.m_RawSize )
+	{
+		block.m_Compressed.Resize( block.m_RawSize );
+		MemoryCopy( block.m_Compressed.GetData(), raw, block.m_RawSize );
+	}
+	else
+	{
+		block.m_Compressed.Resize( size );
+	}
+
+	if ( stream->m_Checksum )
+	{
+		block.m_Checksum = ChecksumBlock( block );
+	}
+}
+
+uint32_t CompressedStream::ChecksumBlock( const Block& block )
+{
+	// the sizes are covered too, they decide where the next block starts
+	uint32_t sizes[ 2 ] = { block.m_RawSize, static_cast< uint32_t >( block.m_Compressed.GetSize() ) };
+	return Crc32c( block.m_Compressed.GetData(), block.m_Compressed.GetSize(), Crc32c( sizes, sizeof( sizes ) ) );
+}
+
+void CompressedStream::DecompressBlock( size_t index, void* userData )
+{
+	CompressedStream* stream = static_cast< CompressedStream* >( userData );
+	const Block& block = stream->m_Blocks[ index ];
+	uint8_t* raw = stream->m_Buffer.GetData() + block.m_Offset;
+
+	// verified as it is decoded, so corrupt bytes never reach a decompressor or a format reader
+	if ( stream->m_Checksum && ChecksumBlock( block ) != block.m_Checksum )
+	{
+		throw Persist::StreamException( TXT( "Block %u failed its checksum" ), static_cast< uint32_t >( index ) );
+	}
+
+	if ( block.m_Compressed.GetSize() == block.m_RawSize )
+	{
+		MemoryCopy( raw, block.m_Compressed.GetData(), block.m_RawSize );
+		return;
+	}
+
+	bool succeeded = false;
+	switch ( stream->m_Codec )
+	{
+	case CompressionCodecs::Lz4:
+		{
+			int result = LZ4_decompress_safe( reinterpret_cast< const char* >( block.m_Compressed.GetData() ), reinterpret_cast< char* >( raw ), static_cast< int >( block.m_Compressed.GetSize() ), static_cast< int >( block.m_RawSize ) );
+			succeeded = result == static_cast< int >( block.m_RawSize );
+			break;
+		}
+
+	case CompressionCodecs::Zstd:
+		{
+			size_t result = 0;
+			if ( stream->m_Dictionary )
+			{
+				ZSTD_DCtx* context = ZSTD_createDCtx();
+				result = ZSTD_decompress_usingDDict( context, raw, block.m_RawSize, block.m_Compressed.GetData(), block.m_Compressed.GetSize(), stream->m_Dictionary->GetDecompressionDictionary() );
+				ZSTD_freeDCtx( context );
+			}
+			else
+			{
+				result = ZSTD_decompress( raw, block.m_RawSize, block.m_Compressed.GetData(), block.m_Compressed.GetSize() );
+			}
+
+			succeeded = !ZSTD_isError( result ) && result == block.m_RawSize;
+			break;
+		}
+
+	default:
+		HELIUM_ASSERT( false );
+		break;
+	}
+
+	if ( !succeeded )
+	{
+		throw Persist::StreamException( TXT( "Compressed block %u is corrupt" ), static_cast< uint32_t >( index ) );
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Foundation/DynamicArray.h"
+#include "Foundation/Stream.h"
+
+#include "Persist/API.h"
+#include "Persist/CompressionDictionary.h"
+
+namespace Helium
+{
+	namespace Persist
+	{
+		namespace CompressionCodecs
+		{
+			enum CompressionCodec
+			{
+				None, // stored, just framed (for checksums)
+				Lz4,  // fast
+				Zstd, // small
+				Count,
+			};
+		}
+		typedef CompressionCodecs::CompressionCodec CompressionCodec;
+
+		//
+		// Compressed stream: a stream stage that frames everything written through it into independently
+		//  compressed blocks, and decompresses all the blocks of such a stream (in parallel) when reading
+		//
+
+		class HELIUM_PERSIST_API CompressedStream : public Stream
+		{
+		public:
+			static const uint32_t DefaultBlockSize = 256 * 1024;
+			static const int      ZstdLevel = 9;
+
+			// write compressed blocks to stream, a dictionary (zstd only) is referenced by its id in the header,
+			//  checksummed blocks carry a CRC-32C of their sizes and stored bytes, and a trailer checks the blocks add up
+			CompressedStream( Stream* stream, CompressionCodec codec, bool ownStream = false, uint32_t blockSize = DefaultBlockSize, CompressionDictionary* dictionary = NULL, bool checksum = false );
+
+			// read a compressed stream (see IsCompressed), the whole thing is verified and decompressed up front,
+			//  a dictionary it references is looked up in the registry unless it is the one given
+			CompressedStream( Stream* stream, bool ownStream = false, CompressionDictionary* dictionary = NULL );
+
+			virtual ~CompressedStream();
+
+			// check for the magic bytes at the current position of a seekable stream without consuming them
+			static bool             IsCompressed( Stream& stream );
+
+			// the codec selected by compression flags in archive flags, and whether those flags call for framing at all
+			static CompressionCodec GetCodec( uint32_t archiveFlags );
+			static bool             IsFramed( uint32_t archiveFlags );
+
+			virtual void    Close() HELIUM_OVERRIDE;
+			virtual bool    IsOpen() const HELIUM_OVERRIDE;
+			virtual bool    CanRead() const HELIUM_OVERRIDE;
+			virtual bool    CanWrite() const HELIUM_OVERRIDE;
+			virtual bool    CanSeek() const HELIUM_OVERRIDE;
+			virtual size_t  Read( void* buffer, size_t size, size_t count ) HELIUM_OVERRIDE;
+			virtual size_t  Write( const void* buffer, size_t size, size_t count ) HELIUM_OVERRIDE;
+			virtual void    Flush() HELIUM_OVERRIDE;
+			virtual int64_t Seek( int64_t offset, SeekOrigin origin ) HELIUM_OVERRIDE;
+			virtual int64_t Tell() const HELIUM_OVERRIDE;
+			virtual int64_t GetSize() const HELIUM_OVERRIDE;
+
+		private:
+			struct Block
+			{
+				size_t                  m_Offset;  // of the raw data within m_Buffer
+				uint32_t                m_RawSize;
+				uint32_t                m_Checksum;
+				DynamicArray< uint8_t > m_Compressed;
+			};
+
+			void            ReadBlocks();
+			void            WriteBlocks( bool partial );
+			static void     CompressBlock( size_t index, void* userData );
+			static void     DecompressBlock( size_t index, void* userData );
+			static uint32_t ChecksumBlock( const Block& block );
+
+			Stream*                  m_Stream;
+			bool                     m_OwnStream;
+			bool                     m_Writing;
+			CompressionCodec         m_Codec;
+			uint32_t                 m_BlockSize;
+			bool                     m_Checksum;
+			CompressionDictionaryPtr m_Dictionary;
+			DynamicArray< uint8_t >  m_Buffer;   // raw data not yet compressed (writing), or all of it (reading)
+			size_t                   m_Position; // read position within m_Buffer
+			int64_t                  m_Written;  // raw bytes written so far
+			uint32_t                 m_StreamChecksum; // of the block checksums so far, for the trailer
+			DynamicArray< Block >    m_Blocks;
+		};
+	}
+}
@@ -0,0 +1,167 @@
+#include "PersistPch.h"
+#include "Persist/CompressionDictionary.h"
+
+#include "Platform/Locks.h"
+
+#include "Foundation/Crc32.h"
+#include "Foundation/FileStream.h"
+
+#include "Persist/CompressedStream.h"
+#include "Persist/Exceptions.h"
+
+#include "zstd/lib/zstd.h"
+#include "zstd/lib/zdict.h"
+
+#include <map>
+
+using namespace Helium;
+using namespace Helium::Persist;
+
+typedef std::map< uint32_t, CompressionDictionaryPtr > DictionaryMap;
+static DictionaryMap g_Dictionaries;
+static Mutex g_DictionaryLock;
+
+CompressionDictionary::CompressionDictionary( const void* data, size_t size )
+	: m_Id( ZDICT_getDictID( data, size ) )
+	, m_CompressionDictionary( NULL )
+	, m_DecompressionDictionary( NULL )
+{
+	HELIUM_ASSERT( data && size );
+
+	m_Data.AddArray( static_cast< const uint8_t* >( data ), size );
+
+	// raw content dictionaries carry no id of their own, zero means no dictionary in the stream header
+	if ( !m_Id )
+	{
+		m_Id = Helium::Crc32( m_Data.GetData(), m_Data.GetSize() );
+		m_Id = m_Id ? m_Id : 1;
+	}
+
+	// digested once, shared by all the threads (de)compressing blocks
+	m_CompressionDictionary = ZSTD_createCDict( m_Data.GetData(), m_Data.GetSize(), CompressedStream::ZstdLevel );
+	m_DecompressionDictionary = ZSTD_createDDict( m_Data.GetData(), m_Data.GetSize() );
+	if ( !m_CompressionDictionary || !m_DecompressionDictionary )
+	{
+		ZSTD_freeCDict( m_CompressionDictionary );
+		ZSTD_freeDDict( m_DecompressionDictionary );
+		throw Persist::Exception( TXT( "Failed to create compression dictionary %u" ), m_Id );
+	}
+}
+
+CompressionDictionary::~CompressionDictionary()
+{
+	ZSTD_freeCDict( m_CompressionDictionary );
+	ZSTD_freeDDict( m_DecompressionDictionary );
+}
+
+CompressionDictionaryPtr CompressionDictionary::Train( const DynamicArray< uint8_t >* samples, size_t count, size_t capacity )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Persist - Train Dictionary" );
+
+	// zdict wants the samples back to back
+	DynamicArray< uint8_t > buffer;
+	DynamicArray< size_t > sizes;
+	for ( size_t i=0; i<count; ++i )
+	{
+		buffer.AddArray( samples[ i ].GetData(), samples[ i ].GetSize() );
+		sizes.Push( samples[ i ].GetSize() );
+	}
+
+	DynamicArray< uint8_t > dictionary;
+	dictionary.Resize( capacity );
+	size_t result = ZDICT_trainFromBuffer( dictionary.GetData(), dictionary.GetSize(), buffer.GetData(), sizes.GetData(), static_cast< unsigned >( sizes.GetSize() ) );
+	if ( ZDICT_isError( result ) )
+	{
+		throw Persist::Exception( TXT( "Failed to train compression dictionary from %u samples: %s" ), static_cast< uint32_t >( count ), ZDICT_getErrorName( result ) );
+	}
+
+	return new CompressionDictionary( dictionary.GetData(), result );
+}
+
+CompressionDictionaryPtr CompressionDictionary::Train( const FilePath* paths, size_t count, size_t capacity )
+{
+	DynamicArray< DynamicArray< uint8_t > > samples;
+	samples.Resize( count );
+
+	for ( size_t i=0; i<count; ++i )
+	{
+		FileStream file;
+		if ( !file.Open( paths[ i ], FileStream::MODE_READ ) )
+		{
+			throw Persist::StreamException( TXT( "Failed to open '%s'" ), paths[ i ].c_str() );
+		}
+
+		// train on what the format writes, not on what a previous compression made of it
+		CompressedStream* compressed = CompressedStream::IsCompressed( file ) ? new CompressedStream( &file ) : NULL;
+		Stream& stream = compressed ? static_cast< Stream& >( *compressed ) : static_cast< Stream& >( file );
+
+		stream.Seek( 0, SeekOrigins::End );
+		samples[ i ].Resize( static_cast< size_t >( stream.Tell() ) );
+		stream.Seek( 0, SeekOrigins::Begin );
+		if ( !samples[ i ].IsEmpty() )
+		{
+			stream.Read( samples[ i ].GetData(), samples[ i ].GetSize(), 1 );
+		}
+
+		delete compressed;
+		file.Close();
+	}
+
+	return Train( samples.GetData(), samples.GetSize(), capacity );
+}
+
+CompressionDictionaryPtr CompressionDictionary::LoadFromFile( const FilePath& path )
+{
+	FileStream stream;
+	if ( !stream.Open( path, FileStream::MODE_READ ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open compression dictionary '%s'" ), path.c_str() );
+	}
+
+	DynamicArray< uint8_t > data;
+	data.Resize( static_cast< size_t >( stream.GetSize() ) );
+	if ( data.IsEmpty() || stream.Read( data.GetData(), data.GetSize(), 1 ) != 1 )
+	{
+		throw Persist::StreamException( TXT( "Failed to read compression dictionary '%s'" ), path.c_str() );
+	}
+
+	stream.Close();
+	return new CompressionDictionary( data.GetData(), data.GetSize() );
+}
+
+void CompressionDictionary::SaveToFile( const FilePath& path ) const
+{
+	path.MakePath();
+
+	FileStream stream;
+	if ( !stream.Open( path, FileStream::MODE_WRITE ) )
+	{
+		throw Persist::StreamException( TXT( "Failed to open '%s' for writing" ), path.c_str() );
+	}
+
+	stream.Write( m_Data.GetData(), m_Data.GetSize(), 1 );
+	stream.Close();
+}
+
+void CompressionDictionary::Register( CompressionDictionary* dictionary )
+{
+	HELIUM_ASSERT( dictionary );
+
+	MutexScopeLock lock ( g_DictionaryLock );
+	CompressionDictionaryPtr& registered = g_Dictionaries[ dictionary->GetId() ];
+	HELIUM_ASSERT( !registered || registered == dictionary );
+	registered = dictionary;
+}
+
+void CompressionDictionary::Unregister( uint32_t id )
+{
+	MutexScopeLock lock ( g_DictionaryLock );
+	g_Dictionaries.erase( id );
+}
+
+CompressionDictionaryPtr CompressionDictionary::Find( uint32_t id )
+{
+	MutexScopeLock lock ( g_DictionaryLock );
+	DictionaryMap::const_iterator found = g_Dictionaries.find( id );
+	return found != g_Dictionaries.end() ? found->second : CompressionDictionaryPtr();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Foundation/DynamicArray.h"
+#include "Foundation/FilePath.h"
+#include "Foundation/SmartPtr.h"
+
+#include "Persist/API.h"
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace Helium
+{
+	namespace Persist
+	{
+		class CompressionDictionary;
+		typedef Helium::SmartPtr< CompressionDictionary > CompressionDictionaryPtr;
+
+		//
+		// Dictionary: zstd dictionary trained from sample archives, small archives compressed with it
+		//  reference it by id so readers can find it in the registry
+		//
+
+		class HELIUM_PERSIST_API CompressionDictionary : public Helium::RefCountBase< CompressionDictionary >
+		{
+		protected:
+			friend class RefCountBase< CompressionDictionary >;
+
+			~CompressionDictionary();
+
+		public:
+			static const size_t DefaultCapacity = 112 * 1024;
+
+			CompressionDictionary( const void* data, size_t size );
+
+			// train from in-memory samples, or from archive files of a single format (compressed ones are decompressed first)
+			static CompressionDictionaryPtr Train( const DynamicArray< uint8_t >* samples, size_t count, size_t capacity = DefaultCapacity );
+			static CompressionDictionaryPtr Train( const FilePath* paths, size_t count, size_t capacity = DefaultCapacity );
+
+			static CompressionDictionaryPtr LoadFromFile( const FilePath& path );
+			void                            SaveToFile( const FilePath& path ) const;
+
+			// dictionaries readers can find by the id in a compressed stream header
+			static void                     Register( CompressionDictionary* dictionary );
+			static void                     Unregister( uint32_t id );
+			static CompressionDictionaryPtr Find( uint32_t id );
+
+			inline uint32_t                       GetId() const;
+			inline const DynamicArray< uint8_t >& GetData() const;
+			inline const ZSTD_CDict_s*            GetCompressionDictionary() const;
+			inline const ZSTD_DDict_s*            GetDecompressionDictionary() const;
+
+		private:
+			uint32_t                m_Id;
+			DynamicArray< uint8_t > m_Data;
+			ZSTD_CDict_s*           m_CompressionDictionary;
+			ZSTD_DDict_s*           m_DecompressionDictionary;
+		};
+	}
+}
+
+#include "Persist/CompressionDictionary.inl"
@@ -0,0 +1,19 @@
+uint32_t Helium::Persist::CompressionDictionary::GetId() const
+{
+	return m_Id;
+}
+
+const Helium::DynamicArray< uint8_t >& Helium::Persist::CompressionDictionary::GetData() const
+{
+	return m_Data;
+}
+
+const ZSTD_CDict_s* Helium::Persist::CompressionDictionary::GetCompressionDictionary() const
+{
+	return m_CompressionDictionary;
+}
+
+const ZSTD_DDict_s* Helium::Persist::CompressionDictionary::GetDecompressionDictionary() const
+{
+	return m_DecompressionDictionary;
+}
@@ -0,0 +1,141 @@
+#include "PersistPch.h"
+#include "Persist/Crc32c.h"
+
+#if HELIUM_CPU_X86
+# include <nmmintrin.h>
+# if HELIUM_CC_MSC
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+#endif
+
+#include <string.h>
+
+using namespace Helium;
+using namespace Helium::Persist;
+
+static const uint32_t Crc32cPolynomial = 0x82f63b78; // reflected
+
+struct Crc32cTable
+{
+	Crc32cTable()
+	{
+		// slicing by 8 tables
+		for ( uint32_t i=0; i<256; ++i )
+		{
+			uint32_t crc = i;
+			for ( uint32_t bit=0; bit<8; ++bit )
+			{
+				crc = ( crc & 1 ) ? ( crc >> 1 ) ^ Crc32cPolynomial : crc >> 1;
+			}
+			m_Table[ 0 ][ i ] = crc;
+		}
+
+		for ( uint32_t i=0; i<256; ++i )
+		{
+			for ( uint32_t slice=1; slice<8; ++slice )
+			{
+				uint32_t previous = m_Table[ slice-1 ][ i ];
+				m_Table[ slice ][ i ] = ( previous >> 8 ) ^ m_Table[ 0 ][ previous & 0xff ];
+			}
+		}
+
+#if HELIUM_CPU_X86
+# if HELIUM_CC_MSC
+		int info[ 4 ];
+		__cpuid( info, 1 );
+		m_Hardware = ( info[ 2 ] & ( 1 << 20 ) ) != 0;
+# else
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+		m_Hardware = __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && ( ecx & bit_SSE4_2 );
+# endif
+#else
+		m_Hardware = false;
+#endif
+	}
+
+	uint32_t m_Table[ 8 ][ 256 ];
+	bool     m_Hardware;
+};
+
+// built during static initialization, before any thread can ask for a checksum
+static const Crc32cTable g_Crc32c;
+
+static uint32_t Crc32cSoftware( const uint8_t* data, size_t size, uint32_t crc )
+{
+	const uint32_t (*table)[ 256 ] = g_Crc32c.m_Table;
+
+	while ( size >= 8 )
+	{
+		uint32_t low, high;
+		memcpy( &low, data, sizeof( low ) );
+		memcpy( &high, data + 4, sizeof( high ) );
+		low ^= crc;
+
+		crc = table[ 7 ][ low & 0xff ] ^ table[ 6 ][ ( low >> 8 ) & 0xff ] ^ table[ 5 ][ ( low >> 16 ) & 0xff ] ^ table[ 4 ][ low >> 24 ] ^
+		      table[ 3 ][ high & 0xff ] ^ table[ 2 ][ ( high >> 8 ) & 0xff ] ^ table[ 1 ][ ( high >> 16 ) & 0xff ] ^ table[ 0 ][ high >> 24 ];
+
+		data += 8;
+		size -= 8;
+	}
+
+	while ( size-- )
+	{
+		crc = table[ 0 ][ ( crc ^ *data++ ) & 0xff ] ^ ( crc >> 8 );
+	}
+
+	return crc;
+}
+
+#if HELIUM_CPU_X86
+# if HELIUM_CC_GCC || HELIUM_CC_CLANG
+__attribute__(( target( "sse4.2" ) ))
+# endif
+static uint32_t Crc32cHardware( const uint8_t* data, size_t size, uint32_t crc )
+{
+# if HELIUM_CPU_X86_64
+	uint64_t crc64 = crc;
+	while ( size >= 8 )
+	{
+		uint64_t value;
+		memcpy( &value, data, sizeof( value ) );
+		crc64 = _mm_crc32_u64( crc64, value );
+		data += 8;
+		size -= 8;
+	}
+	crc = static_cast< uint32_t >( crc64 );
+# endif
+
+	while ( size >= 4 )
+	{
+		uint32_t value;
+		memcpy( &value, data, sizeof( value ) );
+		crc = _mm_crc32_u32( crc, value );
+		data += 4;
+		size -= 4;
+	}
+
+	while ( size-- )
+	{
+		crc = _mm_crc32_u8( crc, *data++ );
+	}
+
+	return crc;
+}
+#endif
+
+uint32_t Persist::Crc32c( const void* data, size_t size, uint32_t crc )
+{
+	const uint8_t* bytes = static_cast< const uint8_t* >( data );
+	crc = ~crc;
+
+#if HELIUM_CPU_X86
+	if ( g_Crc32c.m_Hardware )
+	{
+		return ~Crc32cHardware( bytes, size, crc );
+	}
+#endif
+
+	return ~Crc32cSoftware( bytes, size, crc );
+}
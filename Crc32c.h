@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Persist/API.h"
+
+namespace Helium
+{
+	namespace Persist
+	{
+		// CRC-32C (Castagnoli), using the SSE4.2 crc32 instruction when the processor has it, pass a previous result to continue it
+		HELIUM_PERSIST_API uint32_t Crc32c( const void* data, size_t size, uint32_t crc = 0 );
+	}
+}
@@ -0,0 +1,149 @@
+#include "PersistPch.h"
+#include "Persist/Parallel.h"
+
+#include "Platform/Locks.h"
+#include "Platform/Thread.h"
+
+#include "Foundation/DynamicArray.h"
+
+#include "Persist/Exceptions.h"
+
+#include <exception>
+#include <string>
+
+#if HELIUM_OS_WIN
+# include <windows.h>
+#else
+# include <unistd.h>
+#endif
+
+using namespace Helium;
+using namespace Helium::Persist;
+
+struct ParallelJob
+{
+	ParallelJob( size_t count, ParallelFunction function, void* userData )
+		: m_Count( count )
+		, m_Next( 0 )
+		, m_Function( function )
+		, m_UserData( userData )
+		, m_Failed( false )
+	{
+	}
+
+	void Execute()
+	{
+		for (;;)
+		{
+			size_t index = 0;
+			{
+				MutexScopeLock lock ( m_Lock );
+				if ( m_Failed || m_Next >= m_Count )
+				{
+					return;
+				}
+				index = m_Next++;
+			}
+
+			try
+			{
+				m_Function( index, m_UserData );
+			}
+			catch ( Helium::Exception& ex )
+			{
+				Fail( ex.Get() );
+			}
+			catch ( std::exception& ex )
+			{
+				// bad_alloc from a block or document resize, say, must fail the job rather than escape the worker thread
+				Fail( ex.what() );
+			}
+			catch ( ... )
+			{
+				Fail( "Unknown exception" );
+			}
+		}
+	}
+
+	void Fail( const std::string& error )
+	{
+		MutexScopeLock lock ( m_Lock );
+		if ( !m_Failed )
+		{
+			m_Failed = true;
+			m_Error = error;
+		}
+	}
+
+	size_t           m_Count;
+	size_t           m_Next;
+	ParallelFunction m_Function;
+	void*            m_UserData;
+	Mutex            m_Lock;
+	bool             m_Failed;
+	std::string      m_Error;
+};
+
+class ParallelWorker : public Thread
+{
+public:
+	ParallelWorker( ParallelJob& job )
+		: m_Job( job )
+	{
+	}
+
+	virtual void Run() HELIUM_OVERRIDE
+	{
+		m_Job.Execute();
+	}
+
+private:
+	ParallelJob& m_Job;
+};
+
+uint32_t Persist::GetParallelWorkerCount()
+{
+#if HELIUM_OS_WIN
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	uint32_t count = static_cast< uint32_t >( info.dwNumberOfProcessors );
+#else
+	long processors = sysconf( _SC_NPROCESSORS_ONLN );
+	uint32_t count = processors > 0 ? static_cast< uint32_t >( processors ) : 1;
+#endif
+
+	return count ? count : 1;
+}
+
+void Persist::ParallelFor( size_t count, ParallelFunction function, void* userData )
+{
+	ParallelJob job ( count, function, userData );
+
+	// the calling thread does its share, so small jobs never start a thread
+	size_t workerCount = Min< size_t >( GetParallelWorkerCount(), count );
+	DynamicArray< ParallelWorker* > workers;
+	for ( size_t i=1; i<workerCount; ++i )
+	{
+		ParallelWorker* worker = new ParallelWorker( job );
+		if ( !worker->Start( TXT( "Persist Worker" ) ) )
+		{
+			delete worker;
+			break;
+		}
+
+		workers.Push( worker );
+	}
+
+	job.Execute();
+
+	for ( DynamicArray< ParallelWorker* >::Iterator itr = workers.Begin(), end = workers.End(); itr != end; ++itr )
+	{
+		(*itr)->Join();
+		delete *itr;
+	}
+
+	if ( job.m_Failed )
+	{
+		throw Persist::Exception( "%s", job.m_Error.c_str() );
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Persist/API.h"
+
+namespace Helium
+{
+	namespace Persist
+	{
+		typedef void (*ParallelFunction)( size_t index, void* userData );
+
+		// the number of threads (including the calling one) ParallelFor spreads work over
+		HELIUM_PERSIST_API uint32_t GetParallelWorkerCount();
+
+		// call function for every index in [0, count) across worker threads, returns once all calls are done
+		//  (a Helium::Exception thrown by any call is rethrown on the calling thread as a Persist::Exception)
+		HELIUM_PERSIST_API void ParallelFor( size_t count, ParallelFunction function, void* userData );
+	}
+}
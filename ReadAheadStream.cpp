@@ -0,0 +1,326 @@
+#include "PersistPch.h"
+#include "Persist/ReadAheadStream.h"
+
+#include "Platform/Exception.h"
+#include "Platform/Utility.h"
+
+#include "Persist/Exceptions.h"
+
+#include <exception>
+
+using namespace Helium;
+using namespace Helium::Persist;
+
+static const uint32_t WaitMilliseconds = 100; // waits are re-checked anyway, this just bounds a missed signal
+
+ReadAheadStream::ReadThread::ReadThread( ReadAheadStream& stream )
+	: m_Stream( stream )
+{
+}
+
+void ReadAheadStream::ReadThread::Run()
+{
+	m_Stream.Fill();
+}
+
+ReadAheadStream::ReadAheadStream( Stream* stream, bool ownStream, uint32_t blockSize, uint32_t blockCount )
+	: m_Stream( stream )
+	, m_OwnStream( ownStream )
+	, m_Size( 0 )
+	, m_Position( 0 )
+	, m_Head( 0 )
+	, m_Tail( 0 )
+	, m_Filled( 0 )
+	, m_Offset( 0 )
+	, m_Done( false )
+	, m_Stop( false )
+	, m_FilledSignal( false, false )
+	, m_DrainedSignal( false, false )
+	, m_Thread( NULL )
+{
+	HELIUM_ASSERT( m_Stream && m_Stream->CanRead() );
+	HELIUM_ASSERT( blockSize > 0 && blockCount > 1 );
+
+	m_Blocks.Resize( blockCount );
+	for ( DynamicArray< Block >::Iterator itr = m_Blocks.Begin(), end = m_Blocks.End(); itr != end; ++itr )
+	{
+		itr->m_Data.Resize( blockSize );
+		itr->m_Size = 0;
+	}
+
+	m_Size = m_Stream->GetSize();
+	Start( m_Stream->Tell() );
+}
+
+ReadAheadStream::~ReadAheadStream()
+{
+	Close();
+}
+
+void ReadAheadStream::Close()
+{
+	if ( !m_Stream )
+	{
+		return;
+	}
+
+	Stop();
+
+	if ( m_OwnStream )
+	{
+		m_Stream->Close();
+		delete m_Stream;
+	}
+
+	m_Stream = NULL;
+	m_Blocks.Clear();
+}
+
+bool ReadAheadStream::IsOpen() const
+{
+	return m_Stream != NULL;
+}
+
+bool ReadAheadStream::CanRead() const
+{
+	return true;
+}
+
+bool ReadAheadStream::CanWrite() const
+{
+	return false;
+}
+
+bool ReadAheadStream::CanSeek() const
+{
+	return m_Stream && m_Stream->CanSeek();
+}
+
+size_t ReadAheadStream::Read( void* buffer, size_t size, size_t count )
+{
+	if ( !size )
+	{
+		return 0;
+	}
+
+	return Consume( static_cast< uint8_t* >( buffer ), size * count ) / size;
+}
+
+size_t ReadAheadStream::Write( const void* buffer, size_t size, size_t count )
+{
+	// read only
+	HELIUM_BREAK();
+	return 0;
+}
+
+void ReadAheadStream::Flush()
+{
+}
+
+int64_t ReadAheadStream::Seek( int64_t offset, SeekOrigin origin )
+{
+	int64_t position = offset;
+	switch ( origin )
+	{
+	case SeekOrigins::Current:
+		position += m_Position;
+		break;
+
+	case SeekOrigins::End:
+		position += m_Size;
+		break;
+
+	default:
+		break;
+	}
+
+	position = Clamp< int64_t >( position, 0, m_Size );
+	if ( position == m_Position )
+	{
+		return m_Position;
+	}
+
+	// short hops forward (skipping a header, say) are served from what is already buffered
+	int64_t buffered = static_cast< int64_t >( m_Blocks[ 0 ].m_Data.GetSize() );
+	if ( position > m_Position && position - m_Position <= buffered )
+	{
+		Consume( NULL, static_cast< size_t >( position - m_Position ) );
+		return m_Position;
+	}
+
+	Stop();
+	Start( position );
+	return m_Position;
+}
+
+int64_t ReadAheadStream::Tell() const
+{
+	return m_Position;
+}
+
+int64_t ReadAheadStream::GetSize() const
+{
+	return m_Size;
+}
+
+void ReadAheadStream::Start( int64_t position )
+{
+	HELIUM_ASSERT( !m_Thread );
+
+	m_Position = position != m_Stream->Tell() ? m_Stream->Seek( position, SeekOrigins::Begin ) : position;
+	m_Head = m_Tail = m_Filled = m_Offset = 0;
+	m_Done = false;
+	m_Stop = false;
+	m_Error.clear();
+
+	m_Thread = new ReadThread( *this );
+	if ( !m_Thread->Start( TXT( "Persist Read Ahead" ) ) )
+	{
+		delete m_Thread;
+		m_Thread = NULL;
+		throw Persist::StreamException( TXT( "Failed to start read ahead thread" ) );
+	}
+}
+
+void ReadAheadStream::Stop()
+{
+	if ( !m_Thread )
+	{
+		return;
+	}
+
+	{
+		MutexScopeLock lock ( m_Lock );
+		m_Stop = true;
+	}
+
+	m_DrainedSignal.Signal();
+	m_Thread->Join();
+	delete m_Thread;
+	m_Thread = NULL;
+}
+
+void ReadAheadStream::Fill()
+{
+	for (;;)
+	{
+		// wait for the reader to free up a block
+		Block* block = NULL;
+		while ( !block )
+		{
+			{
+				MutexScopeLock lock ( m_Lock );
+				if ( m_Stop )
+				{
+					return;
+				}
+
+				if ( m_Filled < m_Blocks.GetSize() )
+				{
+					block = &m_Blocks[ m_Tail ];
+					break;
+				}
+			}
+
+			m_DrainedSignal.Wait( WaitMilliseconds );
+		}
+
+		// the reader never touches a block that isn't filled yet, so this needs no lock
+		size_t read = 0;
+		std::string error;
+		try
+		{
+			read = m_Stream->Read( block->m_Data.GetData(), 1, block->m_Data.GetSize() );
+		}
+		catch ( Helium::Exception& ex )
+		{
+			error = ex.Get();
+		}
+		catch ( std::exception& ex )
+		{
+			// handed to the reader like any other failure, rather than escaping the I/O thread
+			error = ex.what();
+		}
+		catch ( ... )
+		{
+			error = "Unknown exception";
+		}
+
+		bool done = false;
+		{
+			MutexScopeLock lock ( m_Lock );
+			block->m_Size = read;
+			if ( read )
+			{
+				m_Tail = ( m_Tail + 1 ) % m_Blocks.GetSize();
+				++m_Filled;
+			}
+
+			done = m_Done = !error.empty() || read < block->m_Data.GetSize();
+			m_Error = error;
+		}
+
+		m_FilledSignal.Signal();
+		if ( done )
+		{
+			return;
+		}
+	}
+}
+
+size_t ReadAheadStream::Consume( uint8_t* buffer, size_t bytes )
+{
+	size_t consumed = 0;
+	while ( consumed < bytes )
+	{
+		// wait for the I/O thread to deliver the next block
+		Block* block = NULL;
+		while ( !block )
+		{
+			{
+				MutexScopeLock lock ( m_Lock );
+				if ( m_Filled )
+				{
+					block = &m_Blocks[ m_Head ];
+					break;
+				}
+
+				if ( m_Done )
+				{
+					if ( !m_Error.empty() )
+					{
+						throw Persist::StreamException( TXT( "Read ahead failed: %s" ), m_Error.c_str() );
+					}
+
+					return consumed;
+				}
+			}
+
+			m_FilledSignal.Wait( WaitMilliseconds );
+		}
+
+		size_t count = Min( block->m_Size - m_Offset, bytes - consumed );
+		if ( buffer )
+		{
+			MemoryCopy( buffer + consumed, block->m_Data.GetData() + m_Offset, count );
+		}
+
+		m_Offset += count;
+		m_Position += count;
+		consumed += count;
+
+		if ( m_Offset == block->m_Size )
+		{
+			{
+				MutexScopeLock lock ( m_Lock );
+				m_Head = ( m_Head + 1 ) % m_Blocks.GetSize();
+				--m_Filled;
+				m_Offset = 0;
+			}
+
+			m_DrainedSignal.Signal();
+		}
+	}
+
+	return consumed;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Platform/Condition.h"
+#include "Platform/Locks.h"
+#include "Platform/Thread.h"
+
+#include "Foundation/DynamicArray.h"
+#include "Foundation/Stream.h"
+
+#include "Persist/API.h"
+
+#include <string>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		//
+		// Read ahead stream: a read only stream stage with an I/O thread that keeps a ring of blocks filled
+		//  from the stream below, so the disk keeps working while the reader parses what already arrived
+		//
+
+		class HELIUM_PERSIST_API ReadAheadStream : public Stream
+		{
+		public:
+			static const uint32_t DefaultBlockSize = 1024 * 1024;
+			static const uint32_t DefaultBlockCount = 4;
+
+			// the I/O thread starts reading right away, from the current position of stream
+			ReadAheadStream( Stream* stream, bool ownStream = false, uint32_t blockSize = DefaultBlockSize, uint32_t blockCount = DefaultBlockCount );
+			virtual ~ReadAheadStream();
+
+			virtual void    Close() HELIUM_OVERRIDE;
+			virtual bool    IsOpen() const HELIUM_OVERRIDE;
+			virtual bool    CanRead() const HELIUM_OVERRIDE;
+			virtual bool    CanWrite() const HELIUM_OVERRIDE;
+			virtual bool    CanSeek() const HELIUM_OVERRIDE;
+			virtual size_t  Read( void* buffer, size_t size, size_t count ) HELIUM_OVERRIDE;
+			virtual size_t  Write( const void* buffer, size_t size, size_t count ) HELIUM_OVERRIDE;
+			virtual void    Flush() HELIUM_OVERRIDE;
+			virtual int64_t Seek( int64_t offset, SeekOrigin origin ) HELIUM_OVERRIDE; // restarts reading ahead from there
+			virtual int64_t Tell() const HELIUM_OVERRIDE;
+			virtual int64_t GetSize() const HELIUM_OVERRIDE;
+
+		private:
+			class ReadThread : public Thread
+			{
+			public:
+				ReadThread( ReadAheadStream& stream );
+				virtual void Run() HELIUM_OVERRIDE;
+
+			private:
+				ReadAheadStream& m_Stream;
+			};
+
+			struct Block
+			{
+				DynamicArray< uint8_t > m_Data;
+				size_t                  m_Size;
+			};
+
+			void   Start( int64_t position );
+			void   Stop();
+			void   Fill();
+			size_t Consume( uint8_t* buffer, size_t bytes ); // a NULL buffer skips
+
+			Stream*               m_Stream;
+			bool                  m_OwnStream;
+			int64_t               m_Size;
+			int64_t               m_Position;  // of the reader
+			DynamicArray< Block > m_Blocks;    // the ring
+			size_t                m_Head;      // next block to read from
+			size_t                m_Tail;      // next block to fill
+			size_t                m_Filled;    // blocks between head and tail
+			size_t                m_Offset;    // read position within the head block
+			bool                  m_Done;      // the I/O thread hit the end of the stream (or an error)
+			bool                  m_Stop;
+			std::string           m_Error;
+			Mutex                 m_Lock;
+			Condition             m_FilledSignal;
+			Condition             m_DrainedSignal;
+			ReadThread*           m_Thread;
+		};
+	}
+}
@@ -0,0 +1,216 @@
+#include "PersistPch.h"
+#include "Persist/Schema.h"
+
+#include "Platform/Locks.h"
+
+#include "Foundation/Crc32.h"
+
+#include "Reflect/Registry.h"
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+struct Migration
+{
+	uint32_t    m_OldCrc;
+	uint32_t    m_NewCrc; // zero to remove the field
+	SchemaField m_Field;  // translator and converter, the field is found when the map is built
+};
+
+typedef std::map< uint32_t, const MetaClass* > ClassRenameMap;
+typedef std::multimap< const MetaStruct*, Migration > MigrationMap;
+typedef std::map< const MetaStruct*, SchemaMap > StructureMap;
+static ClassRenameMap g_ClassRenames;
+static MigrationMap g_Migrations;
+static StructureMap g_Maps;
+static Mutex g_SchemaLock;
+
+static void AddMigration( const MetaStruct* structure, const char* oldName, const char* newName, Translator* oldTranslator, FieldConverter converter )
+{
+	HELIUM_ASSERT( structure && oldName );
+
+	Migration migration;
+	migration.m_OldCrc = Crc32( oldName );
+	migration.m_NewCrc = newName ? Crc32( newName ) : 0;
+	migration.m_Field.m_Name = oldName;
+	migration.m_Field.m_Field = NULL;
+	migration.m_Field.m_Translator = oldTranslator;
+	migration.m_Field.m_Converter = converter;
+	migration.m_Field.m_Migrated = true;
+
+	MutexScopeLock lock ( g_SchemaLock );
+
+	// readers keep pointers into the maps, they can't change once built
+	HELIUM_ASSERT( g_Maps.find( structure ) == g_Maps.end() );
+	g_Migrations.insert( MigrationMap::value_type( structure, migration ) );
+}
+
+// follow a migration through later renames (and at most one conversion) to the current field it ends up in,
+//  false if the chain never reaches one
+static bool ResolveMigration( const SchemaMap& map, const std::map< uint32_t, const Migration* >& migrations, const Migration& migration, SchemaField& field )
+{
+	uint32_t next = migration.m_NewCrc;
+	for ( size_t hops = 0; hops <= migrations.size(); ++hops )
+	{
+		SchemaMap::const_iterator target = map.find( next );
+		if ( target != map.end() && !target->second.m_Migrated )
+		{
+			field.m_Field = target->second.m_Field;
+			return true;
+		}
+
+		std::map< uint32_t, const Migration* >::const_iterator chained = migrations.find( next );
+		if ( chained == migrations.end() )
+		{
+			return false;
+		}
+
+		const Migration& later = *chained->second;
+		if ( !later.m_NewCrc )
+		{
+			// removed in a later build, so is the older data
+			field.m_Field = NULL;
+			field.m_Translator = NULL;
+			field.m_Converter = NULL;
+			return true;
+		}
+
+		if ( later.m_Field.m_Converter )
+		{
+			// the older value would need converting twice, and there is nothing to hold the value in between
+			if ( field.m_Converter )
+			{
+				return false;
+			}
+
+			field.m_Translator = later.m_Field.m_Translator;
+			field.m_Converter = later.m_Field.m_Converter;
+		}
+
+		next = later.m_NewCrc;
+	}
+
+	// the renames go round in a circle
+	return false;
+}
+
+void Schema::RenameClass( const char* oldName, const MetaClass* type )
+{
+	HELIUM_ASSERT( oldName && type );
+
+	MutexScopeLock lock ( g_SchemaLock );
+	g_ClassRenames[ Crc32( oldName ) ] = type;
+}
+
+void Schema::RenameField( const MetaStruct* structure, const char* oldName, const char* newName )
+{
+	AddMigration( structure, oldName, newName, NULL, NULL );
+}
+
+void Schema::ConvertField( const MetaStruct* structure, const char* oldName, const char* newName, Translator* oldTranslator, FieldConverter converter )
+{
+	HELIUM_ASSERT( newName && oldTranslator && converter );
+	AddMigration( structure, oldName, newName, oldTranslator, converter );
+}
+
+void Schema::RemoveField( const MetaStruct* structure, const char* oldName )
+{
+	AddMigration( structure, oldName, NULL, NULL, NULL );
+}
+
+const MetaClass* Schema::FindClass( uint32_t crc, bool* renamed )
+{
+	if ( renamed )
+	{
+		*renamed = false;
+	}
+
+	const MetaClass* type = Registry::GetInstance()->GetMetaClass( crc );
+	if ( type )
+	{
+		return type;
+	}
+
+	MutexScopeLock lock ( g_SchemaLock );
+
+	ClassRenameMap::const_iterator found = g_ClassRenames.find( crc );
+	if ( found == g_ClassRenames.end() )
+	{
+		return NULL;
+	}
+
+	if ( renamed )
+	{
+		*renamed = true;
+	}
+
+	return found->second;
+}
+
+const SchemaMap* Schema::GetMap( const MetaStruct* structure )
+{
+	MutexScopeLock lock ( g_SchemaLock );
+
+	StructureMap::iterator found = g_Maps.find( structure );
+	if ( found != g_Maps.end() )
+	{
+		return &found->second;
+	}
+
+	SchemaMap& map = g_Maps[ structure ];
+
+	// current fields, including inherited ones, under their own names
+	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
+	{
+		for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end; ++itr )
+		{
+			// a derived structure's field hides a base one with the same name
+			uint32_t crc = Crc32( itr->m_Name );
+			if ( map.find( crc ) == map.end() )
+			{
+				SchemaField& field = map[ crc ];
+				field.m_Name = itr->m_Name;
+				field.m_Field = &*itr;
+				field.m_Translator = NULL;
+				field.m_Converter = NULL;
+				field.m_Migrated = false;
+			}
+		}
+	}
+
+	// then old names, a migration registered on a base structure applies to everything derived from it
+	//  (unless the derived structure registered one for the same name)
+	std::map< uint32_t, const Migration* > migrations;
+	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
+	{
+		std::pair< MigrationMap::const_iterator, MigrationMap::const_iterator > range = g_Migrations.equal_range( current );
+		for ( MigrationMap::const_iterator itr = range.first; itr != range.second; ++itr )
+		{
+			migrations.insert( std::make_pair( itr->second.m_OldCrc, &itr->second ) );
+		}
+	}
+
+	for ( std::map< uint32_t, const Migration* >::const_iterator itr = migrations.begin(), end = migrations.end(); itr != end; ++itr )
+	{
+		const Migration& migration = *itr->second;
+		if ( map.find( migration.m_OldCrc ) != map.end() )
+		{
+			// a current field has that name again, it wins
+			continue;
+		}
+
+		SchemaField field = migration.m_Field;
+		if ( migration.m_NewCrc && !HELIUM_VERIFY( ResolveMigration( map, migrations, migration, field ) ) )
+		{
+			// renamed to something that doesn't exist (anymore), treat the old data as removed
+			field.m_Field = NULL;
+			field.m_Translator = NULL;
+			field.m_Converter = NULL;
+		}
+
+		map[ migration.m_OldCrc ] = field;
+	}
+
+	return &map;
+}
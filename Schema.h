@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Reflect/MetaClass.h"
+#include "Reflect/Translator.h"
+
+#include "Persist/API.h"
+
+#include <map>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		// turns the value a field had in an older build (held in a variable of its old type) into the current field
+		typedef void (*FieldConverter)( Reflect::Pointer oldValue, Reflect::Pointer field, Reflect::Object* object );
+
+		struct SchemaField
+		{
+			const char*           m_Name;       // the value is written under, old names must outlive the schema
+			const Reflect::Field* m_Field;      // NULL skips the value
+			Reflect::Translator*  m_Translator; // of the old value, when converting
+			FieldConverter        m_Converter;
+			bool                  m_Migrated;   // renamed, converted, or removed
+		};
+
+		// on-disk field keys of a structure (CRC-32 of their names) and what to do with each
+		typedef std::map< uint32_t, SchemaField > SchemaMap;
+
+		//
+		// Schema: renames, conversions, and removals that let archives written by older builds be read,
+		//  the map for each structure is built once (on first use) and then shared by every reader
+		//
+
+		class HELIUM_PERSIST_API Schema
+		{
+		public:
+			// register these before reading anything that uses the structure
+			static void RenameClass( const char* oldName, const Reflect::MetaClass* type );
+			static void RenameField( const Reflect::MetaStruct* structure, const char* oldName, const char* newName );
+			static void ConvertField( const Reflect::MetaStruct* structure, const char* oldName, const char* newName, Reflect::Translator* oldTranslator, FieldConverter converter );
+			static void RemoveField( const Reflect::MetaStruct* structure, const char* oldName );
+
+			// current classes first, then renamed ones
+			static const Reflect::MetaClass* FindClass( uint32_t crc, bool* renamed = NULL );
+			static const SchemaMap*          GetMap( const Reflect::MetaStruct* structure );
+		};
+	}
+}
@@ -0,0 +1,661 @@
+//
+// persist-tool: inspects, converts, times, and verifies archives outside the engine
+//
+//  persist-tool [-plugin <library>]... [-schema] <command> ...
+//
+//   stat    <archive>                     object and class counts, bytes per class and field
+//   convert <input> <output> [-crc]       format to format (by extension), without loading any objects
+//   bench   <archive> [-n <count>]        repeated reads and writes, with timings and allocation counts
+//   verify  <archive> [-format <type>]    writes what was read (in its own format, or the one given), reads it back, and compares
+//   profile <archive> [-report text|json|trace]  writes what was read, reporting the bytes and time of each structure and field
+//
+//  the classes in an archive have to be registered for bench and verify (and for stat and convert to use the schema),
+//  a plugin is a shared library exporting PersistToolRegisterTypes, which it calls after it is loaded
+//
+
+#include "Platform/Atomic.h"
+#include "Platform/Exception.h"
+#include "Platform/Timer.h"
+
+#include "Foundation/DynamicArray.h"
+#include "Foundation/FilePath.h"
+#include "Foundation/MemoryStream.h"
+
+#include "Reflect/TranslatorDeduction.h"
+
+#include "Persist/Archive.h"
+#include "Persist/ArchiveProfile.h"
+#include "Persist/Transcode.h"
+
+#include <map>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HELIUM_OS_WIN
+# include <windows.h>
+#else
+# include <dlfcn.h>
+#endif
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+typedef void (*RegisterTypesFunc)();
+
+//
+// Allocation counting, only what goes through operator new (the heaps of the engine's modules bypass it)
+//
+
+static volatile int32_t g_Allocations = 0;
+
+void* operator new( size_t size )
+{
+	AtomicIncrementUnsafe( g_Allocations );
+	void* memory = malloc( size ? size : 1 );
+	if ( !memory )
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+void operator delete( void* memory ) throw()
+{
+	free( memory );
+}
+
+void operator delete[]( void* memory ) throw()
+{
+	free( memory );
+}
+
+//
+// Options
+//
+
+static bool LoadPlugin( const char* path )
+{
+#if HELIUM_OS_WIN
+	HMODULE module = LoadLibraryA( path );
+	RegisterTypesFunc registerTypes = module ? reinterpret_cast< RegisterTypesFunc >( GetProcAddress( module, "PersistToolRegisterTypes" ) ) : NULL;
+#else
+	void* module = dlopen( path, RTLD_NOW | RTLD_GLOBAL );
+	RegisterTypesFunc registerTypes = module ? reinterpret_cast< RegisterTypesFunc >( dlsym( module, "PersistToolRegisterTypes" ) ) : NULL;
+#endif
+
+	if ( !module )
+	{
+		fprintf( stderr, "Failed to load plugin '%s'\n", path );
+		return false;
+	}
+
+	// a plugin may register its types as it loads, the function is optional
+	if ( registerTypes )
+	{
+		registerTypes();
+	}
+
+	return true;
+}
+
+static bool ParseArchiveType( const char* name, ArchiveType& archiveType )
+{
+	for ( int i=0; i<ArchiveTypes::Count; ++i )
+	{
+		if ( CaseInsensitiveCompareString( name, ArchiveExtensions[ i ] ) == 0 )
+		{
+			archiveType = static_cast< ArchiveType >( i );
+			return true;
+		}
+	}
+
+	fprintf( stderr, "Unknown archive type '%s'\n", name );
+	return false;
+}
+
+static ArchiveType GetArchiveType( const FilePath& path )
+{
+	ArchiveType archiveType = ArchiveTypes::Auto;
+	ParseArchiveType( path.Extension().c_str(), archiveType );
+	return archiveType;
+}
+
+static const char* GetArgument( int argc, const char** argv, const char* name )
+{
+	for ( int i=0; i<argc-1; ++i )
+	{
+		if ( strcmp( argv[ i ], name ) == 0 )
+		{
+			return argv[ i+1 ];
+		}
+	}
+
+	return NULL;
+}
+
+static bool HasArgument( int argc, const char** argv, const char* name )
+{
+	for ( int i=0; i<argc; ++i )
+	{
+		if ( strcmp( argv[ i ], name ) == 0 )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Comparison, field by field through the translators (objects are compared once, so cycles terminate)
+//
+
+class Comparer
+{
+public:
+	Comparer()
+		: m_Structure( NULL )
+		, m_Field( NULL )
+	{
+	}
+
+	bool Compare( const ObjectPtr& a, const ObjectPtr& b );
+
+	const MetaStruct* m_Structure; // of the first difference
+	const Field*      m_Field;
+
+private:
+	bool CompareInstance( void* a, void* b, const MetaStruct* structure, Object* objectA, Object* objectB );
+	bool CompareTranslator( Pointer a, Pointer b, Translator* translator );
+	bool HasPointers( Translator* translator );
+
+	std::set< std::pair< const Object*, const Object* > > m_Compared;
+	std::map< const Translator*, bool >                 m_Pointers;
+};
+
+bool Comparer::Compare( const ObjectPtr& a, const ObjectPtr& b )
+{
+	if ( !a || !b )
+	{
+		return !a && !b;
+	}
+
+	if ( a->GetMetaClass() != b->GetMetaClass() )
+	{
+		m_Structure = a->GetMetaClass();
+		return false;
+	}
+
+	if ( !m_Compared.insert( std::make_pair( a.Ptr(), b.Ptr() ) ).second )
+	{
+		return true;
+	}
+
+	return CompareInstance( a, b, a->GetMetaClass(), a, b );
+}
+
+bool Comparer::CompareInstance( void* a, void* b, const MetaStruct* structure, Object* objectA, Object* objectB )
+{
+	for ( const MetaStruct* current = structure; current != NULL; current = current->m_Base )
+	{
+		for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end; ++itr )
+		{
+			// never written, so never expected to survive
+			const Field* field = &*itr;
+			if ( field->m_Flags & FieldFlags::Discard )
+			{
+				continue;
+			}
+
+			for ( uint32_t i=0; i<field->m_Count; ++i )
+			{
+				if ( !CompareTranslator( Pointer ( field, a, objectA, i ), Pointer ( field, b, objectB, i ), field->m_Translator ) )
+				{
+					if ( !m_Field )
+					{
+						m_Structure = structure;
+						m_Field = field;
+					}
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool Comparer::CompareTranslator( Pointer a, Pointer b, Translator* translator )
+{
+	// plain data (including containers and structures of it) is compared in one go by its translator
+	if ( !HasPointers( translator ) )
+	{
+		return translator->Equals( a, b );
+	}
+
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		return Compare( a.As< ObjectPtr >(), b.As< ObjectPtr >() );
+
+	case MetaIds::StructureTranslator:
+		{
+			StructureTranslator* structure = static_cast< StructureTranslator* >( translator );
+			return CompareInstance( a.m_Address, b.m_Address, structure->GetMetaStruct(), NULL, NULL );
+		}
+
+	case MetaIds::SequenceTranslator:
+		{
+			SequenceTranslator* sequence = static_cast< SequenceTranslator* >( translator );
+			Translator* itemTranslator = sequence->GetItemTranslator();
+			size_t length = sequence->GetLength( a );
+			if ( length != sequence->GetLength( b ) )
+			{
+				return false;
+			}
+
+			for ( size_t i=0; i<length; ++i )
+			{
+				if ( !CompareTranslator( sequence->GetItem( a, i ), sequence->GetItem( b, i ), itemTranslator ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+	case MetaIds::SetTranslator:
+		{
+			// sets of pointers are ordered by address, which a round trip doesn't keep, the best we can do is their size
+			SetTranslator* set = static_cast< SetTranslator* >( translator );
+			return set->GetLength( a ) == set->GetLength( b );
+		}
+
+	case MetaIds::AssociationTranslator:
+		{
+			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+			if ( association->GetLength( a ) != association->GetLength( b ) )
+			{
+				return false;
+			}
+
+			// only keys without pointers keep their order, otherwise (like sets) compare sizes
+			if ( HasPointers( association->GetKeyTranslator() ) )
+			{
+				return true;
+			}
+
+			DynamicArray< Pointer > keysA, valuesA, keysB, valuesB;
+			association->GetItems( a, keysA, valuesA );
+			association->GetItems( b, keysB, valuesB );
+			for ( size_t i=0; i<keysA.GetSize(); ++i )
+			{
+				if ( !association->GetKeyTranslator()->Equals( keysA[ i ], keysB[ i ] )
+					|| !CompareTranslator( valuesA[ i ], valuesB[ i ], association->GetValueTranslator() ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+	default:
+		HELIUM_BREAK(); // scalars have no pointers
+		return false;
+	}
+}
+
+bool Comparer::HasPointers( Translator* translator )
+{
+	std::map< const Translator*, bool >::const_iterator found = m_Pointers.find( translator );
+	if ( found != m_Pointers.end() )
+	{
+		return found->second;
+	}
+
+	bool pointers = false;
+	switch ( translator->GetMetaId() )
+	{
+	case MetaIds::PointerTranslator:
+		pointers = true;
+		break;
+
+	case MetaIds::StructureTranslator:
+		{
+			const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+			for ( const MetaStruct* current = structure; current != NULL && !pointers; current = current->m_Base )
+			{
+				for ( DynamicArray< Field >::ConstIterator itr = current->m_Fields.Begin(), end = current->m_Fields.End(); itr != end && !pointers; ++itr )
+				{
+					pointers = HasPointers( itr->m_Translator );
+				}
+			}
+			break;
+		}
+
+	case MetaIds::SequenceTranslator:
+		pointers = HasPointers( static_cast< SequenceTranslator* >( translator )->GetItemTranslator() );
+		break;
+
+	case MetaIds::SetTranslator:
+		pointers = HasPointers( static_cast< SetTranslator* >( translator )->GetItemTranslator() );
+		break;
+
+	case MetaIds::AssociationTranslator:
+		{
+			AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+			pointers = HasPointers( association->GetKeyTranslator() ) || HasPointers( association->GetValueTranslator() );
+			break;
+		}
+
+	default:
+		break;
+	}
+
+	m_Pointers[ translator ] = pointers;
+	return pointers;
+}
+
+//
+// Commands
+//
+
+static int Stat( const FilePath& path, bool schema )
+{
+	ArchiveSizes sizes;
+	std::string error;
+	if ( !Transcoder::MeasureFile( path, sizes, ArchiveTypes::Auto, &error, 0x0, schema ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return 1;
+	}
+
+	printf( "%s: %" PRIu32 " objects, %" PRIu64 " bytes (uncompressed)\n", path.c_str(), sizes.m_Objects, sizes.m_Bytes );
+
+	for ( std::map< std::string, ArchiveSizes::ClassSizes >::const_iterator itr = sizes.m_Classes.begin(), end = sizes.m_Classes.end(); itr != end; ++itr )
+	{
+		const ArchiveSizes::ClassSizes& classSizes = itr->second;
+		printf( "\n%s: %" PRIu32 " instances, %" PRIu64 " bytes\n", itr->first.c_str(), classSizes.m_Count, classSizes.m_Bytes );
+
+		for ( std::map< std::string, uint64_t >::const_iterator field = classSizes.m_Fields.begin(), fieldEnd = classSizes.m_Fields.end(); field != fieldEnd; ++field )
+		{
+			printf( "\t%-32s %12" PRIu64 " bytes\n", field->first.c_str(), field->second );
+		}
+	}
+
+	return 0;
+}
+
+static int Convert( const FilePath& input, const FilePath& output, uint32_t flags, bool schema )
+{
+	std::string error;
+	if ( !Transcoder::TranscodeFile( input, output, ArchiveTypes::Auto, ArchiveTypes::Auto, &error, flags, schema ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return 1;
+	}
+
+	return 0;
+}
+
+static int Bench( const FilePath& path, uint32_t count )
+{
+	ArchiveType archiveType = GetArchiveType( path );
+	if ( archiveType == ArchiveTypes::Auto )
+	{
+		return 1;
+	}
+
+	DynamicArray< ObjectPtr > objects;
+	float readMilliseconds = 0.f, writeMilliseconds = 0.f;
+	int32_t readAllocations = 0, writeAllocations = 0;
+	size_t written = 0;
+
+	for ( uint32_t i=0; i<count; ++i )
+	{
+		objects.Clear();
+
+		std::string error;
+		int32_t allocations = g_Allocations;
+		uint64_t start = TimerGetClock();
+		if ( !ArchiveReader::ReadFromFile( path, objects, NULL, archiveType, &error ) )
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+			return 1;
+		}
+		readMilliseconds += TimerTicksToMilliseconds( TimerGetClock() - start );
+		readAllocations += g_Allocations - allocations;
+
+		// to memory, so the disk doesn't drown out the encoding
+		DynamicArray< uint8_t > buffer;
+		DynamicMemoryStream stream ( &buffer );
+		allocations = g_Allocations;
+		start = TimerGetClock();
+		ArchiveWriter::WriteToStream( objects.GetData(), objects.GetSize(), stream, archiveType );
+		writeMilliseconds += TimerTicksToMilliseconds( TimerGetClock() - start );
+		writeAllocations += g_Allocations - allocations;
+		written = buffer.GetSize();
+	}
+
+	printf( "%s: %" PRIu64 " objects, %" PRIu64 " bytes written, %" PRIu32 " iterations\n", path.c_str(), static_cast< uint64_t >( objects.GetSize() ), static_cast< uint64_t >( written ), count );
+	printf( "\tread:  %10.3f ms %10" PRId32 " allocations (average)\n", readMilliseconds / count, readAllocations / static_cast< int32_t >( count ) );
+	printf( "\twrite: %10.3f ms %10" PRId32 " allocations (average)\n", writeMilliseconds / count, writeAllocations / static_cast< int32_t >( count ) );
+	return 0;
+}
+
+static int Verify( const FilePath& path, ArchiveType archiveType )
+{
+	ArchiveType inputType = GetArchiveType( path );
+	if ( inputType == ArchiveTypes::Auto )
+	{
+		return 1;
+	}
+
+	if ( archiveType == ArchiveTypes::Auto )
+	{
+		archiveType = inputType;
+	}
+
+	DynamicArray< ObjectPtr > objects, copies;
+	try
+	{
+		std::string error;
+		if ( !ArchiveReader::ReadFromFile( path, objects, NULL, inputType, &error ) )
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+			return 1;
+		}
+
+		DynamicArray< uint8_t > buffer;
+		DynamicMemoryStream stream ( &buffer );
+		ArchiveWriter::WriteToStream( objects.GetData(), objects.GetSize(), stream, archiveType );
+
+		StaticMemoryStream copy ( buffer.GetData(), buffer.GetSize() );
+		ArchiveReader::ReadFromStream( copy, copies, archiveType );
+	}
+	catch ( Helium::Exception& ex )
+	{
+		fprintf( stderr, "While verifying '%s': %s\n", path.c_str(), ex.Get().c_str() );
+		return 1;
+	}
+
+	if ( objects.GetSize() != copies.GetSize() )
+	{
+		fprintf( stderr, "%s: read %" PRIu64 " objects, got %" PRIu64 " back\n", path.c_str(), static_cast< uint64_t >( objects.GetSize() ), static_cast< uint64_t >( copies.GetSize() ) );
+		return 1;
+	}
+
+	Comparer comparer;
+	for ( size_t i=0; i<objects.GetSize(); ++i )
+	{
+		if ( !comparer.Compare( objects[ i ], copies[ i ] ) )
+		{
+			fprintf(
+				stderr,
+				"%s: object %" PRIu64 " differs (%s%s%s)\n",
+				path.c_str(),
+				static_cast< uint64_t >( i ),
+				comparer.m_Structure ? comparer.m_Structure->m_Name : "null",
+				comparer.m_Field ? "::" : "",
+				comparer.m_Field ? comparer.m_Field->m_Name : "" );
+			return 1;
+		}
+	}
+
+	printf( "%s: %" PRIu64 " objects round trip through %s\n", path.c_str(), static_cast< uint64_t >( objects.GetSize() ), ArchiveExtensions[ archiveType ] );
+	return 0;
+}
+
+static int Profile( const FilePath& path, const char* report )
+{
+	ArchiveType archiveType = GetArchiveType( path );
+	if ( archiveType == ArchiveTypes::Auto )
+	{
+		return 1;
+	}
+
+	ArchiveProfile profile;
+	try
+	{
+		DynamicArray< ObjectPtr > objects;
+		std::string error;
+		if ( !ArchiveReader::ReadFromFile( path, objects, NULL, archiveType, &error ) )
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+			return 1;
+		}
+
+		DynamicArray< uint8_t > buffer;
+		DynamicMemoryStream stream ( &buffer );
+		SmartPtr< ArchiveWriter > writer = ArchiveWriter::GetWriter( &stream, archiveType );
+		writer->SetProfile( &profile );
+		writer->BeginSteps( objects.GetData(), objects.GetSize() );
+		writer->Step( 0 ); // no budget, it all gets written
+		writer->Close();
+	}
+	catch ( Helium::Exception& ex )
+	{
+		fprintf( stderr, "While profiling '%s': %s\n", path.c_str(), ex.Get().c_str() );
+		return 1;
+	}
+
+	DynamicArray< uint8_t > output;
+	DynamicMemoryStream stream ( &output );
+	if ( !report || strcmp( report, "text" ) == 0 )
+	{
+		profile.WriteText( stream );
+	}
+	else if ( strcmp( report, "json" ) == 0 )
+	{
+		profile.WriteJson( stream );
+	}
+	else if ( strcmp( report, "trace" ) == 0 )
+	{
+		profile.WriteChromeTrace( stream );
+	}
+	else
+	{
+		fprintf( stderr, "Unknown report '%s'\n", report );
+		return 1;
+	}
+
+	fwrite( output.GetData(), 1, output.GetSize(), stdout );
+	return 0;
+}
+
+static int Usage()
+{
+	fprintf( stderr,
+		"Usage: persist-tool [-plugin <library>]... [-schema] <command> ...\n"
+		"  stat    <archive>\n"
+		"  convert <input> <output> [-crc]\n"
+		"  bench   <archive> [-n <count>]\n"
+		"  verify  <archive> [-format <type>]\n"
+		"  profile <archive> [-report text|json|trace]\n" );
+	return 1;
+}
+
+int main( int argc, const char** argv )
+{
+	int arg = 1;
+	bool schema = false;
+	for ( ; arg < argc && argv[ arg ][ 0 ] == '-'; ++arg )
+	{
+		if ( strcmp( argv[ arg ], "-plugin" ) == 0 && arg + 1 < argc )
+		{
+			if ( !LoadPlugin( argv[ ++arg ] ) )
+			{
+				return 1;
+			}
+		}
+		else if ( strcmp( argv[ arg ], "-schema" ) == 0 )
+		{
+			schema = true;
+		}
+		else
+		{
+			return Usage();
+		}
+	}
+
+	if ( argc - arg < 2 )
+	{
+		return Usage();
+	}
+
+	const char* command = argv[ arg ];
+	FilePath path ( argv[ arg + 1 ] );
+	int optionCount = argc - arg - 2;
+	const char** options = argv + arg + 2;
+
+	try
+	{
+		if ( strcmp( command, "stat" ) == 0 )
+		{
+			return Stat( path, schema );
+		}
+
+		if ( strcmp( command, "convert" ) == 0 && optionCount >= 1 )
+		{
+			uint32_t flags = HasArgument( optionCount, options, "-crc" ) ? ArchiveFlags::StringCrc : 0x0;
+			return Convert( path, FilePath ( options[ 0 ] ), flags, schema );
+		}
+
+		if ( strcmp( command, "bench" ) == 0 )
+		{
+			const char* count = GetArgument( optionCount, options, "-n" );
+			return Bench( path, count ? Max( atoi( count ), 1 ) : 10 );
+		}
+
+		if ( strcmp( command, "profile" ) == 0 )
+		{
+			return Profile( path, GetArgument( optionCount, options, "-report" ) );
+		}
+
+		if ( strcmp( command, "verify" ) == 0 )
+		{
+			ArchiveType archiveType = ArchiveTypes::Auto;
+			const char* format = GetArgument( optionCount, options, "-format" );
+			if ( format && !ParseArchiveType( format, archiveType ) )
+			{
+				return 1;
+			}
+			return Verify( path, archiveType );
+		}
+	}
+	catch ( Helium::Exception& ex )
+	{
+		fprintf( stderr, "%s\n", ex.Get().c_str() );
+		return 1;
+	}
+
+	return Usage();
+}
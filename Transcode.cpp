@@ -0,0 +1,1775 @@
+#include "PersistPch.h"
+#include "Persist/Transcode.h"
+
+#include "Platform/Exception.h"
+#include "Platform/Process.h"
+
+#include "Foundation/Crc32.h"
+#include "Foundation/FileStream.h"
+
+#include "Reflect/MetaStruct.h"
+#include "Reflect/TranslatorDeduction.h"
+
+#include "Persist/ArchiveBson.h"
+#include "Persist/ArchiveJson.h"
+#include "Persist/ArchiveMessagePack.h"
+#include "Persist/CompressedStream.h"
+#include "Persist/ReadAheadStream.h"
+
+#include <sstream>
+
+using namespace Helium;
+using namespace Helium::Reflect;
+using namespace Helium::Persist;
+
+namespace Helium
+{
+	namespace Persist
+	{
+		namespace TokenTypes
+		{
+			enum TokenType
+			{
+				Null,
+				Boolean,
+				Signed,
+				Unsigned,
+				Float,
+				String,
+				Array,
+				Map,
+				Date,     // bson only
+				ObjectId, // bson only
+			};
+		}
+		typedef TokenTypes::TokenType TokenType;
+
+		// the values of an archive in document order, the entries of a map are its key followed by its value
+		class TranscodeSource
+		{
+		public:
+			virtual ~TranscodeSource() {}
+
+			virtual TokenType Peek() = 0;
+			virtual void      Skip() = 0; // the next value, containers included
+			virtual bool      ReadBoolean() = 0;
+			virtual int64_t   ReadSigned() = 0;
+			virtual uint64_t  ReadUnsigned() = 0;
+			virtual float64_t ReadFloat() = 0;
+			virtual void      ReadString( Helium::String& value ) = 0;
+			virtual int64_t   ReadDate() { HELIUM_BREAK(); return 0; }
+			virtual void      ReadObjectId( uint8_t* bytes ) { HELIUM_BREAK(); }
+			virtual uint32_t  BeginArray() = 0; // returns the number of items
+			virtual void      EndArray() = 0;
+			virtual uint32_t  BeginMap() = 0;   // returns the number of entries
+			virtual void      EndMap() = 0;
+		};
+
+		class TranscodeSink
+		{
+		public:
+			virtual ~TranscodeSink() {}
+
+			virtual void WriteNull() = 0;
+			virtual void WriteBoolean( bool value ) = 0;
+			virtual void WriteSigned( int64_t value ) = 0;
+			virtual void WriteUnsigned( uint64_t value ) = 0;
+			virtual void WriteFloat( float64_t value ) = 0;
+			virtual void WriteString( const char* value ) = 0;
+			virtual void WriteDate( int64_t millis );           // as the BsonDate structure
+			virtual void WriteObjectId( const uint8_t* bytes ); // as the BsonObjectId structure
+			virtual void BeginArray( uint32_t length ) = 0;
+			virtual void EndArray() = 0;
+			virtual void BeginMap( uint32_t length ) = 0;
+			virtual void EndMap() = 0;
+			virtual void Finish() = 0;
+			virtual int64_t GetPosition() const = 0; // bytes encoded so far
+			virtual bool HasNumericKeys() const { return false; }
+		};
+	}
+}
+
+void TranscodeSink::WriteDate( int64_t millis )
+{
+	BeginMap( 1 );
+	WriteString( "millis" );
+	WriteSigned( millis );
+	EndMap();
+}
+
+void TranscodeSink::WriteObjectId( const uint8_t* bytes )
+{
+	BeginMap( 1 );
+	WriteString( "bytes" );
+	BeginArray( sizeof( bson_oid_t ) );
+	for ( size_t i=0; i<sizeof( bson_oid_t ); ++i )
+	{
+		WriteUnsigned( bytes[ i ] );
+	}
+	EndArray();
+	EndMap();
+}
+
+//
+// Json
+//
+
+class JsonSource : public TranscodeSource
+{
+public:
+	JsonSource( Stream& stream, uint32_t flags );
+
+	virtual TokenType Peek() HELIUM_OVERRIDE;
+	virtual void      Skip() HELIUM_OVERRIDE;
+	virtual bool      ReadBoolean() HELIUM_OVERRIDE;
+	virtual int64_t   ReadSigned() HELIUM_OVERRIDE;
+	virtual uint64_t  ReadUnsigned() HELIUM_OVERRIDE;
+	virtual float64_t ReadFloat() HELIUM_OVERRIDE;
+	virtual void      ReadString( String& value ) HELIUM_OVERRIDE;
+	virtual uint32_t  BeginArray() HELIUM_OVERRIDE;
+	virtual void      EndArray() HELIUM_OVERRIDE;
+	virtual uint32_t  BeginMap() HELIUM_OVERRIDE;
+	virtual void      EndMap() HELIUM_OVERRIDE;
+
+private:
+	rapidjson::Value* Current();
+	void              Advance();
+
+	struct Level
+	{
+		rapidjson::Value* m_Value;
+		uint32_t          m_Index; // of the item or member
+		bool              m_Key;   // at the name of the member
+	};
+
+	DynamicArray< uint8_t > m_Buffer;
+	rapidjson::Document     m_Document;
+	DynamicArray< Level >   m_Levels;
+};
+
+JsonSource::JsonSource( Stream& stream, uint32_t flags )
+{
+	if ( flags & ArchiveFlags::Pipeline )
+	{
+		RapidJsonInputStream input ( stream );
+		m_Document.ParseStream< 0 >( input );
+	}
+	else
+	{
+		stream.Seek( 0, SeekOrigins::End );
+		int64_t size = stream.Tell();
+		stream.Seek( 0, SeekOrigins::Begin );
+
+		m_Buffer.Resize( static_cast< size_t >( size + 1 ) );
+		stream.Read( m_Buffer.GetData(), static_cast< size_t >( size ), 1 );
+		m_Buffer[ static_cast< size_t >( size ) ] = '\0';
+		m_Document.ParseInsitu< 0 >( reinterpret_cast< char* >( m_Buffer.GetData() ) );
+	}
+
+	if ( m_Document.HasParseError() )
+	{
+		throw Persist::Exception( "Error parsing JSON (offset %d): %s", m_Document.GetErrorOffset(), m_Document.GetParseError() );
+	}
+}
+
+rapidjson::Value* JsonSource::Current()
+{
+	if ( m_Levels.IsEmpty() )
+	{
+		return &m_Document;
+	}
+
+	Level& level = m_Levels.GetLast();
+	if ( level.m_Value->IsArray() )
+	{
+		return &(*level.m_Value)[ level.m_Index ];
+	}
+
+	rapidjson::Value::Member* member = level.m_Value->MemberBegin() + level.m_Index;
+	return level.m_Key ? &member->name : &member->value;
+}
+
+void JsonSource::Advance()
+{
+	if ( m_Levels.IsEmpty() )
+	{
+		return;
+	}
+
+	Level& level = m_Levels.GetLast();
+	if ( level.m_Value->IsObject() && level.m_Key )
+	{
+		level.m_Key = false;
+	}
+	else
+	{
+		level.m_Index++;
+		level.m_Key = true;
+	}
+}
+
+TokenType JsonSource::Peek()
+{
+	rapidjson::Value* value = Current();
+	if ( value->IsBool() )
+	{
+		return TokenTypes::Boolean;
+	}
+	else if ( value->IsString() )
+	{
+		return TokenTypes::String;
+	}
+	else if ( value->IsArray() )
+	{
+		return TokenTypes::Array;
+	}
+	else if ( value->IsObject() )
+	{
+		return TokenTypes::Map;
+	}
+	else if ( value->IsDouble() )
+	{
+		return TokenTypes::Float;
+	}
+	else if ( value->IsUint64() )
+	{
+		return TokenTypes::Unsigned;
+	}
+	else if ( value->IsNumber() )
+	{
+		return TokenTypes::Signed;
+	}
+
+	return TokenTypes::Null;
+}
+
+void JsonSource::Skip()
+{
+	Advance();
+}
+
+bool JsonSource::ReadBoolean()
+{
+	bool value = Current()->IsTrue();
+	Advance();
+	return value;
+}
+
+int64_t JsonSource::ReadSigned()
+{
+	int64_t value = Current()->GetInt64();
+	Advance();
+	return value;
+}
+
+uint64_t JsonSource::ReadUnsigned()
+{
+	uint64_t value = Current()->GetUint64();
+	Advance();
+	return value;
+}
+
+float64_t JsonSource::ReadFloat()
+{
+	float64_t value = Current()->GetDouble();
+	Advance();
+	return value;
+}
+
+void JsonSource::ReadString( String& value )
+{
+	value = Current()->GetString();
+	Advance();
+}
+
+uint32_t JsonSource::BeginArray()
+{
+	Level level;
+	level.m_Value = Current();
+	level.m_Index = 0;
+	level.m_Key = false;
+	m_Levels.Push( level );
+	return level.m_Value->Size();
+}
+
+void JsonSource::EndArray()
+{
+	m_Levels.Pop();
+	Advance();
+}
+
+uint32_t JsonSource::BeginMap()
+{
+	Level level;
+	level.m_Value = Current();
+	level.m_Index = 0;
+	level.m_Key = true;
+	m_Levels.Push( level );
+	return static_cast< uint32_t >( level.m_Value->MemberEnd() - level.m_Value->MemberBegin() );
+}
+
+void JsonSource::EndMap()
+{
+	m_Levels.Pop();
+	Advance();
+}
+
+class JsonSink : public TranscodeSink
+{
+public:
+	JsonSink( Stream& stream );
+
+	virtual void WriteNull() HELIUM_OVERRIDE;
+	virtual void WriteBoolean( bool value ) HELIUM_OVERRIDE;
+	virtual void WriteSigned( int64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteUnsigned( uint64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteFloat( float64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteString( const char* value ) HELIUM_OVERRIDE;
+	virtual void BeginArray( uint32_t length ) HELIUM_OVERRIDE;
+	virtual void EndArray() HELIUM_OVERRIDE;
+	virtual void BeginMap( uint32_t length ) HELIUM_OVERRIDE;
+	virtual void EndMap() HELIUM_OVERRIDE;
+	virtual void Finish() HELIUM_OVERRIDE;
+	virtual int64_t GetPosition() const HELIUM_OVERRIDE;
+
+private:
+	Stream&               m_Stream;
+	RapidJsonOutputStream m_Output;
+	RapidJsonWriter       m_Writer;
+};
+
+JsonSink::JsonSink( Stream& stream )
+	: m_Stream( stream )
+	, m_Writer( m_Output )
+{
+	m_Output.SetStream( &stream );
+	m_Writer.SetIndent('\t', 1);
+}
+
+void JsonSink::WriteNull()
+{
+	m_Writer.Null();
+}
+
+void JsonSink::WriteBoolean( bool value )
+{
+	m_Writer.Bool( value );
+}
+
+void JsonSink::WriteSigned( int64_t value )
+{
+	if ( value >= INT32_MIN && value <= INT32_MAX )
+	{
+		m_Writer.Int( static_cast< int32_t >( value ) );
+	}
+	else
+	{
+		m_Writer.Int64( value );
+	}
+}
+
+void JsonSink::WriteUnsigned( uint64_t value )
+{
+	if ( value <= UINT32_MAX )
+	{
+		m_Writer.Uint( static_cast< uint32_t >( value ) );
+	}
+	else
+	{
+		m_Writer.Uint64( value );
+	}
+}
+
+void JsonSink::WriteFloat( float64_t value )
+{
+	m_Writer.Double( value );
+}
+
+void JsonSink::WriteString( const char* value )
+{
+	m_Writer.String( value );
+}
+
+void JsonSink::BeginArray( uint32_t length )
+{
+	m_Writer.StartArray();
+}
+
+void JsonSink::EndArray()
+{
+	m_Writer.EndArray();
+}
+
+void JsonSink::BeginMap( uint32_t length )
+{
+	m_Writer.StartObject();
+}
+
+void JsonSink::EndMap()
+{
+	m_Writer.EndObject();
+}
+
+void JsonSink::Finish()
+{
+	m_Stream.Flush();
+}
+
+int64_t JsonSink::GetPosition() const
+{
+	return m_Stream.Tell();
+}
+
+//
+// Bson
+//
+
+class BsonSource : public TranscodeSource
+{
+public:
+	BsonSource( Stream& stream );
+	~BsonSource();
+
+	virtual TokenType Peek() HELIUM_OVERRIDE;
+	virtual void      Skip() HELIUM_OVERRIDE;
+	virtual bool      ReadBoolean() HELIUM_OVERRIDE;
+	virtual int64_t   ReadSigned() HELIUM_OVERRIDE;
+	virtual uint64_t  ReadUnsigned() HELIUM_OVERRIDE;
+	virtual float64_t ReadFloat() HELIUM_OVERRIDE;
+	virtual void      ReadString( String& value ) HELIUM_OVERRIDE;
+	virtual int64_t   ReadDate() HELIUM_OVERRIDE;
+	virtual void      ReadObjectId( uint8_t* bytes ) HELIUM_OVERRIDE;
+	virtual uint32_t  BeginArray() HELIUM_OVERRIDE;
+	virtual void      EndArray() HELIUM_OVERRIDE;
+	virtual uint32_t  BeginMap() HELIUM_OVERRIDE;
+	virtual void      EndMap() HELIUM_OVERRIDE;
+
+private:
+	bson_iterator* Current();
+	bool           AtKey();
+	void           Advance();
+	uint32_t       Begin( bool map );
+
+	struct Level
+	{
+		bson_iterator m_Iterator[1];
+		bool          m_Map;
+		bool          m_Key; // at the name of the element
+	};
+
+	DynamicArray< uint8_t > m_Buffer;
+	bson                    m_Bson[1];
+	bson_iterator           m_Root[1]; // the objects array is the root value
+	DynamicArray< Level >   m_Levels;
+};
+
+BsonSource::BsonSource( Stream& stream )
+{
+	stream.Seek( 0, SeekOrigins::End );
+	int64_t size = stream.Tell();
+	stream.Seek( 0, SeekOrigins::Begin );
+
+	m_Buffer.Resize( static_cast< size_t >( size + 1 ) );
+	m_Buffer[ static_cast< size_t >( size ) ] = '\0';
+	if ( size && stream.Read( m_Buffer.GetData(), static_cast< size_t >( size ), 1 ) != 1 )
+	{
+		throw Persist::StreamException( TXT( "Unexpected end of stream" ) );
+	}
+
+	if ( !HELIUM_VERIFY( BSON_OK == bson_init_finished_data( m_Bson, reinterpret_cast< char* >( m_Buffer.GetData() ), false ) ) )
+	{
+		throw Persist::Exception( "Bson error: %s", GetBsonErrorString( m_Bson->err ) );
+	}
+
+	bson_iterator_init( m_Root, m_Bson );
+}
+
+BsonSource::~BsonSource()
+{
+	bson_destroy( m_Bson );
+}
+
+bson_iterator* BsonSource::Current()
+{
+	return m_Levels.IsEmpty() ? m_Root : m_Levels.GetLast().m_Iterator;
+}
+
+bool BsonSource::AtKey()
+{
+	return !m_Levels.IsEmpty() && m_Levels.GetLast().m_Key;
+}
+
+void BsonSource::Advance()
+{
+	if ( m_Levels.IsEmpty() )
+	{
+		return;
+	}
+
+	Level& level = m_Levels.GetLast();
+	if ( level.m_Key )
+	{
+		level.m_Key = false;
+	}
+	else
+	{
+		bson_iterator_next( level.m_Iterator );
+		level.m_Key = level.m_Map;
+	}
+}
+
+TokenType BsonSource::Peek()
+{
+	if ( AtKey() )
+	{
+		return TokenTypes::String;
+	}
+
+	switch ( bson_iterator_type( Current() ) )
+	{
+	case BSON_BOOL:
+		return TokenTypes::Boolean;
+
+	case BSON_INT:
+	case BSON_LONG:
+		return TokenTypes::Signed;
+
+	case BSON_DOUBLE:
+		return TokenTypes::Float;
+
+	case BSON_STRING:
+		return TokenTypes::String;
+
+	case BSON_ARRAY:
+		return TokenTypes::Array;
+
+	case BSON_OBJECT:
+		return TokenTypes::Map;
+
+	case BSON_DATE:
+		return TokenTypes::Date;
+
+	case BSON_OID:
+		return TokenTypes::ObjectId;
+
+	default:
+		return TokenTypes::Null;
+	}
+}
+
+void BsonSource::Skip()
+{
+	Advance();
+}
+
+bool BsonSource::ReadBoolean()
+{
+	bool value = bson_iterator_bool( Current() ) != 0;
+	Advance();
+	return value;
+}
+
+int64_t BsonSource::ReadSigned()
+{
+	int64_t value = bson_iterator_long( Current() );
+	Advance();
+	return value;
+}
+
+uint64_t BsonSource::ReadUnsigned()
+{
+	// bson has no unsigned types, see ArchiveWriterBson
+	return static_cast< uint64_t >( ReadSigned() );
+}
+
+float64_t BsonSource::ReadFloat()
+{
+	float64_t value = bson_iterator_double( Current() );
+	Advance();
+	return value;
+}
+
+void BsonSource::ReadString( String& value )
+{
+	value = AtKey() ? bson_iterator_key( Current() ) : bson_iterator_string( Current() );
+	Advance();
+}
+
+int64_t BsonSource::ReadDate()
+{
+	int64_t value = bson_iterator_date( Current() );
+	Advance();
+	return value;
+}
+
+void BsonSource::ReadObjectId( uint8_t* bytes )
+{
+	MemoryCopy( bytes, bson_iterator_oid( Current() ), sizeof( bson_oid_t ) );
+	Advance();
+}
+
+uint32_t BsonSource::Begin( bool map )
+{
+	bson_iterator* current = Current();
+
+	// bson doesn't store the number of elements, but counting them is just a walk over their headers
+	uint32_t length = 0;
+	bson_iterator count[1];
+	bson_iterator_subiterator( current, count );
+	while ( bson_iterator_next( count ) )
+	{
+		++length;
+	}
+
+	Level level;
+	bson_iterator_subiterator( current, level.m_Iterator );
+	bson_iterator_next( level.m_Iterator );
+	level.m_Map = map;
+	level.m_Key = map;
+	m_Levels.Push( level );
+
+	return length;
+}
+
+uint32_t BsonSource::BeginArray()
+{
+	return Begin( false );
+}
+
+void BsonSource::EndArray()
+{
+	m_Levels.Pop();
+	Advance();
+}
+
+uint32_t BsonSource::BeginMap()
+{
+	return Begin( true );
+}
+
+void BsonSource::EndMap()
+{
+	m_Levels.Pop();
+	Advance();
+}
+
+class BsonSink : public TranscodeSink
+{
+public:
+	BsonSink( Stream& stream );
+	~BsonSink();
+
+	virtual void WriteNull() HELIUM_OVERRIDE;
+	virtual void WriteBoolean( bool value ) HELIUM_OVERRIDE;
+	virtual void WriteSigned( int64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteUnsigned( uint64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteFloat( float64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteString( const char* value ) HELIUM_OVERRIDE;
+	virtual void WriteDate( int64_t millis ) HELIUM_OVERRIDE;
+	virtual void WriteObjectId( const uint8_t* bytes ) HELIUM_OVERRIDE;
+	virtual void BeginArray( uint32_t length ) HELIUM_OVERRIDE;
+	virtual void EndArray() HELIUM_OVERRIDE;
+	virtual void BeginMap( uint32_t length ) HELIUM_OVERRIDE;
+	virtual void EndMap() HELIUM_OVERRIDE;
+	virtual void Finish() HELIUM_OVERRIDE;
+	virtual int64_t GetPosition() const HELIUM_OVERRIDE;
+
+private:
+	const char* Name(); // of the element being appended
+
+	struct Level
+	{
+		bool     m_Map;
+		bool     m_Key;   // the next string is the name of an element
+		uint32_t m_Index; // of the next item
+	};
+
+	Stream&               m_Stream;
+	bson                  m_Bson[1];
+	bool                  m_Building;
+	DynamicArray< Level > m_Levels;
+	String                m_Key;
+	char                  m_Number[16];
+};
+
+BsonSink::BsonSink( Stream& stream )
+	: m_Stream( stream )
+	, m_Building( false )
+{
+}
+
+BsonSink::~BsonSink()
+{
+	if ( m_Building )
+	{
+		bson_destroy( m_Bson );
+	}
+}
+
+const char* BsonSink::Name()
+{
+	Level& level = m_Levels.GetLast();
+	if ( level.m_Map )
+	{
+		level.m_Key = true;
+		return m_Key.GetData();
+	}
+
+	Helium::StringPrint( m_Number, "%d", level.m_Index++ );
+	return m_Number;
+}
+
+void BsonSink::WriteNull()
+{
+	HELIUM_VERIFY( BSON_OK == bson_append_null( m_Bson, Name() ) );
+}
+
+void BsonSink::WriteBoolean( bool value )
+{
+	HELIUM_VERIFY( BSON_OK == bson_append_bool( m_Bson, Name(), value ) );
+}
+
+void BsonSink::WriteSigned( int64_t value )
+{
+	if ( value >= INT32_MIN && value <= INT32_MAX )
+	{
+		HELIUM_VERIFY( BSON_OK == bson_append_int( m_Bson, Name(), static_cast< int32_t >( value ) ) );
+	}
+	else
+	{
+		HELIUM_VERIFY( BSON_OK == bson_append_long( m_Bson, Name(), value ) );
+	}
+}
+
+void BsonSink::WriteUnsigned( uint64_t value )
+{
+	// uint64_t isn't supported, just hope for the best (like ArchiveWriterBson)
+	WriteSigned( static_cast< int64_t >( value ) );
+}
+
+void BsonSink::WriteFloat( float64_t value )
+{
+	HELIUM_VERIFY( BSON_OK == bson_append_double( m_Bson, Name(), value ) );
+}
+
+void BsonSink::WriteString( const char* value )
+{
+	Level& level = m_Levels.GetLast();
+	if ( level.m_Map && level.m_Key )
+	{
+		m_Key = value;
+		level.m_Key = false;
+		return;
+	}
+
+	HELIUM_VERIFY( BSON_OK == bson_append_string( m_Bson, Name(), value ) );
+}
+
+void BsonSink::WriteDate( int64_t millis )
+{
+	bson_append_date( m_Bson, Name(), millis );
+}
+
+void BsonSink::WriteObjectId( const uint8_t* bytes )
+{
+	bson_oid_t oid;
+	MemoryCopy( oid.bytes, bytes, sizeof( bson_oid_t ) );
+	bson_append_oid( m_Bson, Name(), &oid );
+}
+
+void BsonSink::BeginArray( uint32_t length )
+{
+	if ( m_Levels.IsEmpty() )
+	{
+		// the document that holds the objects array, just like ArchiveWriterBson's
+		bson_init( m_Bson );
+		m_Building = true;
+		HELIUM_VERIFY( BSON_OK == bson_append_start_array( m_Bson, "objects" ) );
+	}
+	else
+	{
+		HELIUM_VERIFY( BSON_OK == bson_append_start_array( m_Bson, Name() ) );
+	}
+
+	Level level;
+	level.m_Map = false;
+	level.m_Key = false;
+	level.m_Index = 0;
+	m_Levels.Push( level );
+}
+
+void BsonSink::EndArray()
+{
+	HELIUM_VERIFY( BSON_OK == bson_append_finish_array( m_Bson ) );
+	m_Levels.Pop();
+}
+
+void BsonSink::BeginMap( uint32_t length )
+{
+	if ( m_Levels.IsEmpty() )
+	{
+		throw Persist::Exception( TXT( "Bson archives start with the array of objects" ) );
+	}
+
+	HELIUM_VERIFY( BSON_OK == bson_append_start_object( m_Bson, Name() ) );
+
+	Level level;
+	level.m_Map = true;
+	level.m_Key = true;
+	level.m_Index = 0;
+	m_Levels.Push( level );
+}
+
+void BsonSink::EndMap()
+{
+	HELIUM_VERIFY( BSON_OK == bson_append_finish_object( m_Bson ) );
+	m_Levels.Pop();
+}
+
+void BsonSink::Finish()
+{
+	HELIUM_ASSERT( m_Building && m_Levels.IsEmpty() );
+	HELIUM_VERIFY( BSON_OK == bson_finish( m_Bson ) );
+	m_Stream.Write( bson_data( m_Bson ), bson_size( m_Bson ), 1 );
+	m_Stream.Flush();
+
+	bson_destroy( m_Bson );
+	m_Building = false;
+}
+
+int64_t BsonSink::GetPosition() const
+{
+	// nothing reaches the stream before Finish, count what has been built
+	return m_Building ? m_Bson->cur - m_Bson->data : m_Stream.Tell();
+}
+
+//
+// MessagePack
+//
+
+class MessagePackSource : public TranscodeSource
+{
+public:
+	MessagePackSource( Stream& stream );
+
+	virtual TokenType Peek() HELIUM_OVERRIDE;
+	virtual void      Skip() HELIUM_OVERRIDE;
+	virtual bool      ReadBoolean() HELIUM_OVERRIDE;
+	virtual int64_t   ReadSigned() HELIUM_OVERRIDE;
+	virtual uint64_t  ReadUnsigned() HELIUM_OVERRIDE;
+	virtual float64_t ReadFloat() HELIUM_OVERRIDE;
+	virtual void      ReadString( String& value ) HELIUM_OVERRIDE;
+	virtual uint32_t  BeginArray() HELIUM_OVERRIDE;
+	virtual void      EndArray() HELIUM_OVERRIDE;
+	virtual uint32_t  BeginMap() HELIUM_OVERRIDE;
+	virtual void      EndMap() HELIUM_OVERRIDE;
+
+private:
+	MessagePackReader m_Reader;
+};
+
+MessagePackSource::MessagePackSource( Stream& stream )
+{
+	m_Reader.SetStream( &stream );
+
+	// parse the first byte of the stream
+	m_Reader.Advance();
+}
+
+TokenType MessagePackSource::Peek()
+{
+	if ( m_Reader.IsBoolean() )
+	{
+		return TokenTypes::Boolean;
+	}
+	else if ( m_Reader.IsNumber() )
+	{
+		switch ( m_Reader.Type() )
+		{
+		case MessagePackTypes::Float32:
+		case MessagePackTypes::Float64:
+			return TokenTypes::Float;
+
+		case MessagePackTypes::UInt64:
+			return TokenTypes::Unsigned;
+
+		default:
+			// everything else fits
+			return TokenTypes::Signed;
+		}
+	}
+	else if ( m_Reader.IsRaw() )
+	{
+		return TokenTypes::String;
+	}
+	else if ( m_Reader.IsArray() )
+	{
+		return TokenTypes::Array;
+	}
+	else if ( m_Reader.IsMap() )
+	{
+		return TokenTypes::Map;
+	}
+
+	return TokenTypes::Null;
+}
+
+void MessagePackSource::Skip()
+{
+	m_Reader.Skip();
+}
+
+bool MessagePackSource::ReadBoolean()
+{
+	bool value = false;
+	m_Reader.Read( value, NULL );
+	return value;
+}
+
+int64_t MessagePackSource::ReadSigned()
+{
+	int64_t value = 0;
+	m_Reader.ReadNumber( value, true, NULL );
+	return value;
+}
+
+uint64_t MessagePackSource::ReadUnsigned()
+{
+	uint64_t value = 0;
+	m_Reader.ReadNumber( value, true, NULL );
+	return value;
+}
+
+float64_t MessagePackSource::ReadFloat()
+{
+	float64_t value = 0.0;
+	m_Reader.ReadNumber( value, true, NULL );
+	return value;
+}
+
+void MessagePackSource::ReadString( String& value )
+{
+	m_Reader.Read( value );
+}
+
+uint32_t MessagePackSource::BeginArray()
+{
+	uint32_t length = m_Reader.ReadArrayLength();
+	m_Reader.BeginArray( length );
+	return length;
+}
+
+void MessagePackSource::EndArray()
+{
+	m_Reader.EndArray();
+}
+
+uint32_t MessagePackSource::BeginMap()
+{
+	uint32_t length = m_Reader.ReadMapLength();
+	m_Reader.BeginMap( length );
+	return length;
+}
+
+void MessagePackSource::EndMap()
+{
+	m_Reader.EndMap();
+}
+
+class MessagePackSink : public TranscodeSink
+{
+public:
+	MessagePackSink( Stream& stream );
+
+	virtual void WriteNull() HELIUM_OVERRIDE;
+	virtual void WriteBoolean( bool value ) HELIUM_OVERRIDE;
+	virtual void WriteSigned( int64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteUnsigned( uint64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteFloat( float64_t value ) HELIUM_OVERRIDE;
+	virtual void WriteString( const char* value ) HELIUM_OVERRIDE;
+	virtual void BeginArray( uint32_t length ) HELIUM_OVERRIDE;
+	virtual void EndArray() HELIUM_OVERRIDE;
+	virtual void BeginMap( uint32_t length ) HELIUM_OVERRIDE;
+	virtual void EndMap() HELIUM_OVERRIDE;
+	virtual void Finish() HELIUM_OVERRIDE;
+	virtual int64_t GetPosition() const HELIUM_OVERRIDE;
+	virtual bool HasNumericKeys() const HELIUM_OVERRIDE { return true; }
+
+private:
+	Stream&           m_Stream;
+	MessagePackWriter m_Writer;
+};
+
+MessagePackSink::MessagePackSink( Stream& stream )
+	: m_Stream( stream )
+{
+	m_Writer.SetStream( &stream );
+}
+
+void MessagePackSink::WriteNull()
+{
+	m_Writer.WriteNil();
+}
+
+void MessagePackSink::WriteBoolean( bool value )
+{
+	m_Writer.Write( value );
+}
+
+void MessagePackSink::WriteSigned( int64_t value )
+{
+	// the text formats (and bson) don't keep the width the writer used, so pick the narrowest that holds the value
+	if ( value >= 0 )
+	{
+		WriteUnsigned( static_cast< uint64_t >( value ) );
+	}
+	else if ( value >= INT8_MIN )
+	{
+		m_Writer.Write( static_cast< int8_t >( value ) );
+	}
+	else if ( value >= INT16_MIN )
+	{
+		m_Writer.Write( static_cast< int16_t >( value ) );
+	}
+	else if ( value >= INT32_MIN )
+	{
+		m_Writer.Write( static_cast< int32_t >( value ) );
+	}
+	else
+	{
+		m_Writer.Write( value );
+	}
+}
+
+void MessagePackSink::WriteUnsigned( uint64_t value )
+{
+	if ( value <= UINT8_MAX )
+	{
+		m_Writer.Write( static_cast< uint8_t >( value ) );
+	}
+	else if ( value <= UINT16_MAX )
+	{
+		m_Writer.Write( static_cast< uint16_t >( value ) );
+	}
+	else if ( value <= UINT32_MAX )
+	{
+		m_Writer.Write( static_cast< uint32_t >( value ) );
+	}
+	else
+	{
+		m_Writer.Write( value );
+	}
+}
+
+void MessagePackSink::WriteFloat( float64_t value )
+{
+	// float32_t fields come back from the text formats as doubles
+	float32_t narrow = static_cast< float32_t >( value );
+	if ( static_cast< float64_t >( narrow ) == value )
+	{
+		m_Writer.Write( narrow );
+	}
+	else
+	{
+		m_Writer.Write( value );
+	}
+}
+
+void MessagePackSink::WriteString( const char* value )
+{
+	m_Writer.Write( value );
+}
+
+void MessagePackSink::BeginArray( uint32_t length )
+{
+	m_Writer.BeginArray( length );
+}
+
+void MessagePackSink::EndArray()
+{
+	m_Writer.EndArray();
+}
+
+void MessagePackSink::BeginMap( uint32_t length )
+{
+	m_Writer.BeginMap( length );
+}
+
+void MessagePackSink::EndMap()
+{
+	m_Writer.EndMap();
+}
+
+void MessagePackSink::Finish()
+{
+	m_Stream.Flush();
+}
+
+int64_t MessagePackSink::GetPosition() const
+{
+	return m_Stream.Tell();
+}
+
+//
+// Measuring
+//
+
+// discards everything written to it, counting the bytes
+class CountingStream : public Stream
+{
+public:
+	CountingStream()
+		: m_Count( 0 )
+	{
+	}
+
+	virtual void    Close() HELIUM_OVERRIDE {}
+	virtual bool    IsOpen() const HELIUM_OVERRIDE { return true; }
+	virtual bool    CanRead() const HELIUM_OVERRIDE { return false; }
+	virtual bool    CanWrite() const HELIUM_OVERRIDE { return true; }
+	virtual bool    CanSeek() const HELIUM_OVERRIDE { return false; }
+	virtual size_t  Read( void* buffer, size_t size, size_t count ) HELIUM_OVERRIDE { return 0; }
+	virtual size_t  Write( const void* buffer, size_t size, size_t count ) HELIUM_OVERRIDE { m_Count += size * count; return count; }
+	virtual void    Flush() HELIUM_OVERRIDE {}
+	virtual int64_t Seek( int64_t offset, SeekOrigin origin ) HELIUM_OVERRIDE { return m_Count; }
+	virtual int64_t Tell() const HELIUM_OVERRIDE { return m_Count; }
+	virtual int64_t GetSize() const HELIUM_OVERRIDE { return m_Count; }
+
+private:
+	int64_t m_Count;
+};
+
+//
+// Transcoder
+//
+
+static ArchiveType GetArchiveType( const FilePath& path )
+{
+	for ( int i=0; i<ArchiveTypes::Count; ++i )
+	{
+		if ( CaseInsensitiveCompareString( path.Extension().c_str(), ArchiveExtensions[ i ] ) == 0 )
+		{
+			return static_cast< ArchiveType >( i );
+		}
+	}
+
+	throw Persist::StreamException( TXT( "Unknown archive type (%s)" ), path.c_str() );
+}
+
+static TranscodeSource* CreateSource( Stream& stream, ArchiveType archiveType, uint32_t flags )
+{
+	switch ( archiveType )
+	{
+	case ArchiveTypes::Bson:
+		return new BsonSource( stream );
+
+	case ArchiveTypes::Json:
+		return new JsonSource( stream, flags );
+
+	case ArchiveTypes::MessagePack:
+		return new MessagePackSource( stream );
+
+	default:
+		HELIUM_ASSERT( false );
+		break;
+	}
+
+	throw Persist::StreamException( TXT( "Unknown archive type" ) );
+}
+
+static TranscodeSink* CreateSink( Stream& stream, ArchiveType archiveType )
+{
+	switch ( archiveType )
+	{
+	case ArchiveTypes::Bson:
+		return new BsonSink( stream );
+
+	case ArchiveTypes::Json:
+		return new JsonSink( stream );
+
+	case ArchiveTypes::MessagePack:
+		return new MessagePackSink( stream );
+
+	default:
+		HELIUM_ASSERT( false );
+		break;
+	}
+
+	throw Persist::StreamException( TXT( "Unknown archive type" ) );
+}
+
+// compressed inputs are recognized by their magic, outputs are compressed as the flags call for (see Archive::OpenStream)
+static Stream* OpenInput( const FilePath& path, uint32_t flags )
+{
+	// like Archive::OpenStream, held until a stream that owns it is returned
+	AutoPtr< Stream > stream ( new FileStream() );
+	static_cast< FileStream* >( stream.Ptr() )->Open( path, FileStream::MODE_READ );
+
+	if ( CompressedStream::IsCompressed( *stream ) )
+	{
+		Stream* input = new CompressedStream( stream.Ptr(), true );
+		stream.Release();
+		return input;
+	}
+
+	if ( flags & ArchiveFlags::Pipeline )
+	{
+		Stream* input = new ReadAheadStream( stream.Ptr(), true );
+		stream.Release();
+		return input;
+	}
+
+	return stream.Release();
+}
+
+static Stream* OpenOutput( const FilePath& path, uint32_t flags )
+{
+	AutoPtr< Stream > stream ( new FileStream() );
+	static_cast< FileStream* >( stream.Ptr() )->Open( path, FileStream::MODE_WRITE );
+
+	if ( CompressedStream::IsFramed( flags ) )
+	{
+		Stream* output = new CompressedStream( stream.Ptr(), CompressedStream::GetCodec( flags ), true, CompressedStream::DefaultBlockSize, NULL, ( flags & ArchiveFlags::Checksum ) != 0 );
+		stream.Release();
+		return output;
+	}
+
+	return stream.Release();
+}
+
+void Transcoder::TranscodeStream( Stream& input, ArchiveType inputType, Stream& output, ArchiveType outputType, uint32_t flags, bool schema )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Transcode" );
+
+	AutoPtr< TranscodeSource > source ( CreateSource( input, inputType, flags ) );
+	AutoPtr< TranscodeSink > sink ( CreateSink( output, outputType ) );
+
+	// only message pack can write names as CRC-32s, the others always write the strings
+	bool stringCrc = outputType == ArchiveTypes::MessagePack && ( flags & ArchiveFlags::StringCrc );
+
+	Transcoder transcoder ( *source, *sink, stringCrc, schema );
+	transcoder.Transcode();
+}
+
+void Transcoder::Measure( Stream& input, ArchiveType archiveType, ArchiveSizes& sizes, uint32_t flags, bool schema )
+{
+	HELIUM_PERSIST_SCOPE_TIMER( "Reflect - Measure" );
+
+	CountingStream output;
+	AutoPtr< TranscodeSource > source ( CreateSource( input, archiveType, flags ) );
+	AutoPtr< TranscodeSink > sink ( CreateSink( output, archiveType ) );
+
+	// names stay as they were written (unless the schema changes them)
+	Transcoder transcoder ( *source, *sink, false, schema );
+	transcoder.m_Sizes = &sizes;
+	transcoder.Transcode();
+
+	sizes.m_Bytes += output.Tell();
+}
+
+bool Transcoder::MeasureFile( const FilePath& path, ArchiveSizes& sizes, ArchiveType archiveType, std::string* error, uint32_t flags, bool schema )
+{
+	HELIUM_ASSERT( !path.empty() );
+
+	try
+	{
+		if ( archiveType == ArchiveTypes::Auto )
+		{
+			archiveType = GetArchiveType( path );
+		}
+
+		AutoPtr< Stream > stream ( OpenInput( path, flags ) );
+		Measure( *stream, archiveType, sizes, flags, schema );
+		stream->Close();
+	}
+	catch ( Helium::Exception& ex )
+	{
+		std::stringstream str;
+		str << "While measuring '" << path.c_str() << "': " << ex.Get();
+
+		if ( error )
+		{
+			*error = str.str();
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+bool Transcoder::TranscodeFile( const FilePath& input, const FilePath& output, ArchiveType inputType, ArchiveType outputType, std::string* error, uint32_t flags, bool schema )
+{
+	HELIUM_ASSERT( !input.empty() && !output.empty() );
+	Log::Debug( TXT( "Transcoding '%s' to '%s'\n" ), input.c_str(), output.c_str() );
+
+	output.MakePath();
+
+	// build a path to a unique file for this process, like ArchiveWriter::WriteToFile
+	FilePath safetyPath( output.Directory() + Helium::GetProcessString() );
+	safetyPath.ReplaceExtension( output.Extension() );
+
+	try
+	{
+		if ( inputType == ArchiveTypes::Auto )
+		{
+			inputType = GetArchiveType( input );
+		}
+
+		if ( outputType == ArchiveTypes::Auto )
+		{
+			outputType = GetArchiveType( output );
+		}
+
+		AutoPtr< Stream > inputStream ( OpenInput( input, flags ) );
+		AutoPtr< Stream > outputStream ( OpenOutput( safetyPath, flags ) );
+
+		TranscodeStream( *inputStream, inputType, *outputStream, outputType, flags, schema );
+
+		outputStream->Close();
+		inputStream->Close();
+	}
+	catch ( Helium::Exception& ex )
+	{
+		std::stringstream str;
+		str << "While transcoding '" << input.c_str() << "' to '" << output.c_str() << "': " << ex.Get();
+
+		if ( error )
+		{
+			*error = str.str();
+		}
+
+		safetyPath.Delete();
+		return false;
+	}
+
+	try
+	{
+		output.Delete();
+		safetyPath.Move( output );
+	}
+	catch ( Helium::Exception& ex )
+	{
+		std::stringstream str;
+		str << "While moving '" << safetyPath.c_str() << "' to '" << output.c_str() << "': " << ex.Get();
+
+		if ( error )
+		{
+			*error = str.str();
+		}
+
+		safetyPath.Delete();
+		return false;
+	}
+
+	return true;
+}
+
+Transcoder::Transcoder( TranscodeSource& source, TranscodeSink& sink, bool stringCrc, bool schema )
+	: m_Source( source )
+	, m_Sink( sink )
+	, m_StringCrc( stringCrc )
+	, m_Schema( schema )
+	, m_Sizes( NULL )
+{
+}
+
+void Transcoder::Transcode()
+{
+	if ( m_Source.Peek() != TokenTypes::Array )
+	{
+		throw Persist::Exception( TXT( "Input doesn't start with the array of objects" ) );
+	}
+
+	uint32_t length = m_Source.BeginArray();
+	m_Sink.BeginArray( length );
+
+	if ( m_Sizes )
+	{
+		m_Sizes->m_Objects += length;
+	}
+
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		CopyObject();
+	}
+
+	m_Source.EndArray();
+	m_Sink.EndArray();
+	m_Sink.Finish();
+}
+
+void Transcoder::CopyObject()
+{
+	if ( m_Source.Peek() != TokenTypes::Map )
+	{
+		CopyValue( NULL );
+		return;
+	}
+
+	// the class name, then the instance (there is only one entry, but an empty map stands for a null object)
+	uint32_t length = m_Source.BeginMap();
+	m_Sink.BeginMap( length );
+
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		String buffer;
+		uint32_t crc = ReadName( buffer );
+		const char* name = buffer.IsEmpty() ? NULL : buffer.GetData();
+
+		const MetaClass* type = NULL;
+		if ( m_Schema )
+		{
+			bool renamed = false;
+			type = Schema::FindClass( crc, &renamed );
+			if ( type )
+			{
+				name = type->m_Name;
+				if ( renamed )
+				{
+					crc = Crc32( type->m_Name );
+				}
+			}
+		}
+
+		int64_t start = m_Sizes ? m_Sink.GetPosition() : 0;
+		if ( WriteName( name, crc ) )
+		{
+			ArchiveSizes::ClassSizes* sizes = m_Sizes ? GetSizes( name, crc ) : NULL;
+			CopyInstance( type, sizes );
+			if ( sizes )
+			{
+				sizes->m_Count++;
+				sizes->m_Bytes += m_Sink.GetPosition() - start;
+			}
+		}
+		else
+		{
+			HELIUM_TRACE(
+				TraceLevels::Warning,
+				"Transcoder::CopyObject - Dropping an object of unknown class (CRC-32 = %" PRIu32 ")\n",
+				crc);
+			m_Source.Skip();
+		}
+	}
+
+	m_Source.EndMap();
+	m_Sink.EndMap();
+}
+
+void Transcoder::CopyInstance( const MetaStruct* structure, ArchiveSizes::ClassSizes* sizes )
+{
+	if ( m_Source.Peek() != TokenTypes::Map )
+	{
+		CopyValue( NULL );
+		return;
+	}
+
+	uint32_t length = m_Source.BeginMap();
+	m_Sink.BeginMap( length );
+
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		String buffer;
+		uint32_t crc = ReadName( buffer );
+		const char* name = buffer.IsEmpty() ? NULL : buffer.GetData();
+
+		// without a structure (or the schema) the names are copied as they are, and so are their values
+		const Field* field = NULL;
+		Translator* translator = NULL;
+		const SchemaField* mapped = structure ? FindField( structure, crc ) : NULL;
+		if ( mapped )
+		{
+			if ( mapped->m_Field && !mapped->m_Converter )
+			{
+				// renamed values move to their current name
+				field = mapped->m_Field;
+				name = field->m_Name;
+				if ( mapped->m_Migrated )
+				{
+					crc = Crc32( name );
+				}
+			}
+			else
+			{
+				// converted and removed ones keep theirs, the reader migrates them
+				name = mapped->m_Name;
+				translator = mapped->m_Translator;
+			}
+		}
+
+		int64_t start = sizes ? m_Sink.GetPosition() : 0;
+		if ( !WriteName( name, crc ) )
+		{
+			HELIUM_TRACE(
+				TraceLevels::Warning,
+				"Transcoder::CopyInstance - Dropping a value of unknown field (CRC-32 = %" PRIu32 ") in '%s'\n",
+				crc,
+				structure ? structure->m_Name : "unknown class");
+			m_Source.Skip();
+			continue;
+		}
+
+		if ( field )
+		{
+			CopyField( field );
+		}
+		else
+		{
+			CopyValue( translator );
+		}
+
+		if ( sizes )
+		{
+			if ( !name )
+			{
+				buffer.Format( "0x%08" PRIX32, crc );
+				name = buffer.GetData();
+			}
+			sizes->m_Fields[ name ] += m_Sink.GetPosition() - start;
+		}
+	}
+
+	m_Source.EndMap();
+	m_Sink.EndMap();
+}
+
+void Transcoder::CopyField( const Field* field )
+{
+	if ( field->m_Count > 1 && m_Source.Peek() == TokenTypes::Array )
+	{
+		CopyArray( field->m_Translator );
+	}
+	else
+	{
+		CopyValue( field->m_Translator );
+	}
+}
+
+void Transcoder::CopyValue( Translator* translator )
+{
+	switch ( m_Source.Peek() )
+	{
+	case TokenTypes::Null:
+		m_Source.Skip();
+		m_Sink.WriteNull();
+		break;
+
+	case TokenTypes::Boolean:
+		m_Sink.WriteBoolean( m_Source.ReadBoolean() );
+		break;
+
+	case TokenTypes::Signed:
+		m_Sink.WriteSigned( m_Source.ReadSigned() );
+		break;
+
+	case TokenTypes::Unsigned:
+		m_Sink.WriteUnsigned( m_Source.ReadUnsigned() );
+		break;
+
+	case TokenTypes::Float:
+		m_Sink.WriteFloat( m_Source.ReadFloat() );
+		break;
+
+	case TokenTypes::String:
+		m_Source.ReadString( m_String );
+		m_Sink.WriteString( m_String.GetData() );
+		break;
+
+	case TokenTypes::Date:
+		m_Sink.WriteDate( m_Source.ReadDate() );
+		break;
+
+	case TokenTypes::ObjectId:
+		{
+			uint8_t bytes[ sizeof( bson_oid_t ) ];
+			m_Source.ReadObjectId( bytes );
+			m_Sink.WriteObjectId( bytes );
+			break;
+		}
+
+	case TokenTypes::Array:
+		{
+			// translators are only known with the schema
+			Translator* itemTranslator = NULL;
+			if ( translator && translator->GetMetaId() == MetaIds::SequenceTranslator )
+			{
+				itemTranslator = static_cast< SequenceTranslator* >( translator )->GetItemTranslator();
+			}
+			else if ( translator && translator->GetMetaId() == MetaIds::SetTranslator )
+			{
+				itemTranslator = static_cast< SetTranslator* >( translator )->GetItemTranslator();
+			}
+
+			CopyArray( itemTranslator );
+			break;
+		}
+
+	case TokenTypes::Map:
+		{
+			if ( translator && translator->GetMetaId() == MetaIds::StructureTranslator )
+			{
+				const MetaStruct* structure = static_cast< StructureTranslator* >( translator )->GetMetaStruct();
+				ArchiveSizes::ClassSizes* sizes = m_Sizes ? GetSizes( structure->m_Name, 0 ) : NULL;
+				int64_t start = sizes ? m_Sink.GetPosition() : 0;
+				CopyInstance( structure, sizes );
+				if ( sizes )
+				{
+					sizes->m_Count++;
+					sizes->m_Bytes += m_Sink.GetPosition() - start;
+				}
+			}
+			else if ( translator && translator->GetMetaId() == MetaIds::PointerTranslator )
+			{
+				// an object written in place (json)
+				CopyObject();
+			}
+			else if ( translator && translator->GetMetaId() == MetaIds::AssociationTranslator )
+			{
+				AssociationTranslator* association = static_cast< AssociationTranslator* >( translator );
+				CopyMap( association->GetKeyTranslator(), association->GetValueTranslator() );
+			}
+			else
+			{
+				CopyMap( NULL, NULL );
+			}
+			break;
+		}
+	}
+}
+
+void Transcoder::CopyArray( Translator* itemTranslator )
+{
+	uint32_t length = m_Source.BeginArray();
+	m_Sink.BeginArray( length );
+
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		CopyValue( itemTranslator );
+	}
+
+	m_Source.EndArray();
+	m_Sink.EndArray();
+}
+
+void Transcoder::CopyMap( Translator* keyTranslator, Translator* valueTranslator )
+{
+	uint32_t length = m_Source.BeginMap();
+	m_Sink.BeginMap( length );
+
+	for ( uint32_t i=0; i<length; ++i )
+	{
+		CopyKey( keyTranslator );
+		CopyValue( valueTranslator );
+	}
+
+	m_Source.EndMap();
+	m_Sink.EndMap();
+}
+
+void Transcoder::CopyKey( Translator* translator )
+{
+	TokenType type = m_Source.Peek();
+	if ( type == TokenTypes::String || m_Sink.HasNumericKeys() )
+	{
+		CopyValue( translator );
+		return;
+	}
+
+	// message pack keys can be anything, the other formats want strings (printed as the bson writer prints them)
+	switch ( type )
+	{
+	case TokenTypes::Boolean:
+		m_String = m_Source.ReadBoolean() ? "1" : "0";
+		break;
+
+	case TokenTypes::Signed:
+		m_String.Format( "%" PRId64, m_Source.ReadSigned() );
+		break;
+
+	case TokenTypes::Unsigned:
+		m_String.Format( "%" PRIu64, m_Source.ReadUnsigned() );
+		break;
+
+	case TokenTypes::Float:
+		m_String.Format( "%g", m_Source.ReadFloat() );
+		break;
+
+	default:
+		throw Persist::Exception( TXT( "Map key can't be written as a string" ) );
+	}
+
+	m_Sink.WriteString( m_String.GetData() );
+}
+
+uint32_t Transcoder::ReadName( String& name )
+{
+	switch ( m_Source.Peek() )
+	{
+	case TokenTypes::String:
+		m_Source.ReadString( name );
+		return ( m_Schema || m_StringCrc ) ? Crc32( name.GetData() ) : 0;
+
+	case TokenTypes::Signed:
+		return static_cast< uint32_t >( m_Source.ReadSigned() );
+
+	case TokenTypes::Unsigned:
+		return static_cast< uint32_t >( m_Source.ReadUnsigned() );
+
+	default:
+		m_Source.Skip();
+		return 0;
+	}
+}
+
+bool Transcoder::WriteName( const char* name, uint32_t crc )
+{
+	if ( m_StringCrc )
+	{
+		m_Sink.WriteUnsigned( crc );
+		return true;
+	}
+
+	if ( name )
+	{
+		m_Sink.WriteString( name );
+		return true;
+	}
+
+	if ( m_Sink.HasNumericKeys() )
+	{
+		m_Sink.WriteUnsigned( crc );
+		return true;
+	}
+
+	if ( !m_Schema )
+	{
+		throw Persist::Exception( TXT( "Input names classes and fields by CRC-32, converting it to a text format needs the schema" ) );
+	}
+
+	return false;
+}
+
+const SchemaField* Transcoder::FindField( const MetaStruct* structure, uint32_t crc )
+{
+	const SchemaMap*& map = m_SchemaMaps[ structure ];
+	if ( !map )
+	{
+		map = Schema::GetMap( structure );
+	}
+
+	SchemaMap::const_iterator found = map->find( crc );
+	return found != map->end() ? &found->second : NULL;
+}
+
+ArchiveSizes::ClassSizes* Transcoder::GetSizes( const char* name, uint32_t crc )
+{
+	if ( name )
+	{
+		return &m_Sizes->m_Classes[ name ];
+	}
+
+	String hex;
+	hex.Format( "0x%08" PRIX32, crc );
+	return &m_Sizes->m_Classes[ hex.GetData() ];
+}
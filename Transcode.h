@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Foundation/FilePath.h"
+#include "Foundation/Stream.h"
+
+#include "Persist/Archive.h"
+
+#include <map>
+#include <string>
+
+namespace Helium
+{
+	namespace Persist
+	{
+		class TranscodeSource;
+		class TranscodeSink;
+
+		// what the classes and fields of an archive take up in its encoding (see Transcoder::Measure)
+		struct ArchiveSizes
+		{
+			struct ClassSizes
+			{
+				ClassSizes()
+					: m_Count( 0 )
+					, m_Bytes( 0 )
+				{
+				}
+
+				uint32_t                          m_Count;  // objects, or structures
+				uint64_t                          m_Bytes;  // including the objects they own
+				std::map< std::string, uint64_t > m_Fields; // names included
+			};
+
+			ArchiveSizes()
+				: m_Objects( 0 )
+				, m_Bytes( 0 )
+			{
+			}
+
+			uint32_t                            m_Objects; // top-level
+			uint64_t                            m_Bytes;
+			std::map< std::string, ClassSizes > m_Classes; // names written as CRC-32s are reported in hex
+		};
+
+		//
+		// Transcoder: copies an archive into another format value by value, straight from one format's parser into
+		//  the other's encoder, without allocating any objects (or running any of their callbacks)
+		//
+
+		class HELIUM_PERSIST_API Transcoder
+		{
+		public:
+			// flags are the writer's (StringCrc, compression, checksums) plus Pipeline for the input
+			//  with the schema, CRC-32 names are named again and renamed classes and fields get their current names,
+			//  without it values are copied under the names they have, which a text format needs to be strings
+			static void TranscodeStream( Stream& input, ArchiveType inputType, Stream& output, ArchiveType outputType, uint32_t flags = 0x0, bool schema = false );
+			static bool TranscodeFile( const FilePath& input, const FilePath& output, ArchiveType inputType = ArchiveTypes::Auto, ArchiveType outputType = ArchiveTypes::Auto, std::string* error = NULL, uint32_t flags = 0x0, bool schema = false );
+
+			// transcode into the same format, keeping count of where the bytes go instead of writing them
+			//  (what Persist would write, which is the input itself unless the schema renames something)
+			static void Measure( Stream& input, ArchiveType archiveType, ArchiveSizes& sizes, uint32_t flags = 0x0, bool schema = false );
+			static bool MeasureFile( const FilePath& path, ArchiveSizes& sizes, ArchiveType archiveType = ArchiveTypes::Auto, std::string* error = NULL, uint32_t flags = 0x0, bool schema = false );
+
+		private:
+			Transcoder( TranscodeSource& source, TranscodeSink& sink, bool stringCrc, bool schema );
+
+			void Transcode();
+			void CopyObject();
+			void CopyInstance( const Reflect::MetaStruct* structure, ArchiveSizes::ClassSizes* sizes );
+			void CopyField( const Reflect::Field* field );
+			void CopyValue( Reflect::Translator* translator );
+			void CopyArray( Reflect::Translator* itemTranslator );
+			void CopyMap( Reflect::Translator* keyTranslator, Reflect::Translator* valueTranslator );
+			void CopyKey( Reflect::Translator* translator );
+			uint32_t ReadName( String& name );
+			bool WriteName( const char* name, uint32_t crc );
+			const SchemaField* FindField( const Reflect::MetaStruct* structure, uint32_t crc );
+			ArchiveSizes::ClassSizes* GetSizes( const char* name, uint32_t crc );
+
+			TranscodeSource&                                         m_Source;
+			TranscodeSink&                                           m_Sink;
+			const bool                                               m_StringCrc;  // write names as their CRC-32
+			const bool                                               m_Schema;
+			String                                                   m_String;     // of the value being copied
+			ArchiveSizes*                                            m_Sizes;      // when measuring
+			std::map< const Reflect::MetaStruct*, const SchemaMap* > m_SchemaMaps;
+		};
+	}
+}